@@ -0,0 +1,254 @@
+#include "BatchEncoder.hpp"
+#include "imageExtension/PPMImage.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+BatchEncoder::BatchEncoder(const BatchSettings &settings)
+    : settings(settings)
+{
+}
+
+bool BatchEncoder::addInput(const string &path)
+{
+    std::error_code error;
+    if (fs::is_directory(path, error))
+    {
+        // Sorted so that the output does not depend on the directory order.
+        // The tree below path is mirrored: a/img.ppm and b/img.ppm do not collide
+        vector<Input> found;
+        for (const fs::directory_entry &entry : fs::recursive_directory_iterator(path, error))
+        {
+            string extension = entry.path().extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+            if (entry.is_regular_file(error) && extension == ".ppm")
+            {
+                fs::path output = entry.path().lexically_relative(path).replace_extension(".jpg");
+                found.push_back({entry.path().string(), output.string()});
+            }
+        }
+        std::sort(found.begin(), found.end(), [](const Input &a, const Input &b)
+                  { return a.path < b.path; });
+        inputs.insert(inputs.end(), found.begin(), found.end());
+        return true;
+    }
+
+    if (!fs::exists(path, error))
+    {
+        cerr << "Error: no such file or directory " << path << endl;
+        return false;
+    }
+    inputs.push_back({path, fs::path(path).filename().replace_extension(".jpg").string()});
+    return true;
+}
+
+bool BatchEncoder::addListFile(const string &path)
+{
+    ifstream list(path);
+    if (!list.is_open())
+    {
+        cerr << "Error: cannot open list " << path << endl;
+        return false;
+    }
+
+    bool ok = true;
+    string line;
+    while (getline(list, line))
+    {
+        // Trailing spaces and CR of files written on Windows
+        while (!line.empty() && isspace(static_cast<unsigned char>(line.back())))
+        {
+            line.pop_back();
+        }
+        if (!line.empty())
+        {
+            ok = addInput(line) && ok;
+        }
+    }
+    return ok;
+}
+
+size_t BatchEncoder::inputCount() const
+{
+    return inputs.size();
+}
+
+/**
+ * @brief Load, encode and write one image
+ *   Baseline files with the Annex K tables go through the streaming encoder
+ *   (memory bounded by the image width); optimized and progressive ones, and
+ *   those with a size budget, need the whole frame.
+ */
+bool BatchEncoder::encodeJob(const Job &job, JPEGCompressor &compressor, uint64_t &bytesOut) const
+{
+    PPMImage image;
+    image.setInputDirectory("");
+    if (!image.loadView(job.input))
+    {
+        return false;
+    }
+
+    compressor.reset(image);
+    compressor.setQuality(settings.quality); // encodeToSize() changes it
+
+    FileSink out(job.output);
+    if (!out.isOpen())
+    {
+        return false;
+    }
+
+    bool encoded;
+    if (settings.targetBytes > 0)
+    {
+        encoded = compressor.encodeToSize(out, settings.targetBytes);
+        if (!encoded && out.bytesWritten() == 0)
+        {
+            cerr << "Does not fit in " << settings.targetBytes << " bytes: " << job.input << endl;
+            std::error_code error;
+            fs::remove(job.output, error);
+            return false;
+        }
+    }
+    else if (settings.progressive || settings.optimizeHuffman)
+    {
+        compressor.compress();
+        encoded = compressor.encode(out);
+    }
+    else
+    {
+        encoded = compressor.encodeStreaming(out);
+    }
+
+    bytesOut = out.bytesWritten();
+    if (!encoded)
+    {
+        cerr << "Error while writing: " << job.output << endl;
+    }
+    return encoded;
+}
+
+BatchResult BatchEncoder::run()
+{
+    auto start = std::chrono::steady_clock::now();
+    BatchResult result;
+
+    std::error_code error;
+    fs::create_directories(settings.outputDirectory, error);
+
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    unsigned inFlight = settings.inFlight != 0 ? settings.inFlight : cores;
+    inFlight = static_cast<unsigned>(std::min<size_t>(inFlight, std::max<size_t>(1, inputs.size())));
+
+    // 1. Probe the headers (only the first page of each file is read)
+    vector<Job> jobs(inputs.size());
+    ThreadPool::shared().parallelFor(inputs.size(), 64, [this, &jobs](size_t first, size_t last)
+                                     {
+        for (size_t i = first; i < last; ++i)
+        {
+            Job &job = jobs[i];
+            job.input = inputs[i].path;
+            job.output = (fs::path(settings.outputDirectory) / inputs[i].output).lexically_normal().string();
+
+            PPMImage header;
+            header.setInputDirectory("");
+            std::error_code sizeError;
+            job.valid = header.loadHeader(job.input);
+            job.pixels = job.valid ? static_cast<uint64_t>(header.getWidth()) * header.getHeight() : 0;
+            job.bytes = fs::file_size(job.input, sizeError);
+            if (sizeError)
+            {
+                job.bytes = 0;
+            }
+        } });
+
+    // 2. One input per output file: the first one listed keeps it, the others
+    //    fail instead of overwriting it. Subdirectories are created here, once
+    std::set<string> outputs;
+    for (Job &job : jobs)
+    {
+        if (!outputs.insert(job.output).second)
+        {
+            cerr << "Error: " << job.input << " would overwrite " << job.output << endl;
+            job.valid = false;
+        }
+        else if (job.valid)
+        {
+            fs::create_directories(fs::path(job.output).parent_path(), error);
+        }
+    }
+
+    // 3. Largest images first: a big one started last would run alone at the end
+    std::stable_sort(jobs.begin(), jobs.end(), [](const Job &a, const Job &b)
+                     { return a.pixels > b.pixels; });
+
+    // 4. inFlight workers take the next image until none is left
+    std::atomic<size_t> next{0};
+    std::mutex totalsLock;
+    auto worker = [this, &jobs, &next, &totalsLock, &result]()
+    {
+        // One encoder per worker, reset for every image: its buffers are reused
+        JPEGCompressor compressor;
+        compressor.setSubsampling(settings.subsampling);
+        compressor.setRestartInterval(settings.restartInterval);
+        compressor.setProgressive(settings.progressive);
+        compressor.setOptimizeHuffman(settings.optimizeHuffman);
+        compressor.setBlockMemoization(settings.blockMemoization);
+
+        for (size_t i = next++; i < jobs.size(); i = next++)
+        {
+            const Job &job = jobs[i];
+            uint64_t bytesOut = 0;
+            bool encoded = job.valid && encodeJob(job, compressor, bytesOut);
+
+            std::lock_guard<std::mutex> guard(totalsLock);
+            if (encoded)
+            {
+                result.images++;
+                result.pixels += job.pixels;
+                result.bytesIn += job.bytes;
+                result.bytesOut += bytesOut;
+            }
+            else
+            {
+                result.failures++;
+            }
+        }
+    };
+
+    vector<std::thread> workers;
+    for (unsigned t = 1; t < inFlight; ++t)
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (std::thread &thread : workers)
+    {
+        thread.join();
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+void BatchEncoder::printSummary(const BatchResult &result, ostream &out)
+{
+    double seconds = std::max(result.seconds, 1e-9);
+    out << std::fixed << std::setprecision(2)
+        << result.images << " images encoded, " << result.failures << " failed, in " << result.seconds << " s" << endl
+        << result.images / seconds << " images/s, " << result.pixels / seconds / 1e6 << " MP/s" << endl
+        << "in : " << result.bytesIn << " bytes (" << result.bytesIn / seconds / 1e6 << " MB/s), "
+        << "out : " << result.bytesOut << " bytes (" << result.bytesOut / seconds / 1e6 << " MB/s)";
+    if (result.bytesOut > 0)
+    {
+        out << ", ratio " << static_cast<double>(result.bytesIn) / result.bytesOut << ":1";
+    }
+    out << endl;
+}
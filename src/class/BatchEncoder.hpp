@@ -0,0 +1,105 @@
+#ifndef _BATCHENCODER_HPP_
+#define _BATCHENCODER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "JPEGCompressor.hpp"
+
+using namespace std;
+
+/**
+ * @brief Encoder settings shared by every image of a batch
+ */
+struct BatchSettings
+{
+    string outputDirectory = ".";
+    int quality = 50;
+    size_t targetBytes = 0; // > 0: highest quality fitting in targetBytes instead of quality
+    Subsampling subsampling = Subsampling::Mode420;
+    bool progressive = false;
+    bool optimizeHuffman = false;
+    bool blockMemoization = false;
+    int restartInterval = 0;
+    unsigned inFlight = 0; // images encoded at the same time (0 = one per core)
+};
+
+/**
+ * @brief Totals of a batch
+ */
+struct BatchResult
+{
+    size_t images = 0;   // encoded
+    size_t failures = 0; // not loadable or not writable
+    uint64_t pixels = 0;
+    uint64_t bytesIn = 0; // size of the input files
+    uint64_t bytesOut = 0;
+    double seconds = 0;
+};
+
+/**
+ * @brief Encode many PPM files to JPEG in parallel
+ *   Each worker thread loads (memory mapped), encodes and writes one image at
+ *   a time, so at most inFlight images are in memory. Headers are probed
+ *   first and the largest images are started first, which keeps the workers
+ *   busy until the end of the batch. The stages of an image share the
+ *   process pool between the workers; every worker keeps one encoder and
+ *   resets it for each image, so its buffers are allocated once.
+ *   Output: outputDirectory/<path below the directory given>.jpg for the
+ *   files found in a directory, outputDirectory/<name>.jpg for the files
+ *   given one by one; an input whose output is already taken fails.
+ */
+class BatchEncoder
+{
+public:
+    explicit BatchEncoder(const BatchSettings &settings);
+
+    /**
+     * @brief Add a file, or every .ppm file below a directory
+     *
+     * @return false (with a message on cerr) if the path does not exist
+     */
+    bool addInput(const string &path);
+
+    /**
+     * @brief Add the paths listed in a text file, one per line (files or directories)
+     */
+    bool addListFile(const string &path);
+
+    size_t inputCount() const;
+
+    /**
+     * @brief Encode every input (failures are reported on cerr and counted)
+     */
+    BatchResult run();
+
+    /**
+     * @brief Images/s, MP/s and bytes in/out of a batch
+     */
+    static void printSummary(const BatchResult &result, ostream &out);
+
+private:
+    struct Input
+    {
+        string path;
+        string output; // relative to outputDirectory
+    };
+
+    struct Job
+    {
+        string input;
+        string output;
+        uint64_t pixels = 0;
+        uint64_t bytes = 0;
+        bool valid = false;
+    };
+
+    bool encodeJob(const Job &job, JPEGCompressor &compressor, uint64_t &bytesOut) const;
+
+    BatchSettings settings;
+    vector<Input> inputs;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include "BitWriter.hpp"
+
+void BitWriter::flush()
+{
+    int pending = 64 - freeBits;
+    if (pending == 0)
+    {
+        return;
+    }
+
+    // Pad to a whole byte with 1 bits
+    int padding = (8 - pending % 8) % 8;
+    accumulator = (accumulator << padding) | ((uint64_t(1) << padding) - 1);
+    pending += padding;
+
+    reserve(16);
+    for (int shift = pending - 8; shift >= 0; shift -= 8)
+    {
+        uint8_t byte = static_cast<uint8_t>(accumulator >> shift);
+        buffer[length++] = byte;
+        // byte‑stuffing obligatoire en JPEG :
+        if (byte == 0xFF)
+        {
+            buffer[length++] = 0x00;
+        }
+    }
+
+    accumulator = 0;
+    freeBits = 64;
+}
+
+void BitWriter::writeMarker(uint8_t marker)
+{
+    flush();
+    reserve(2);
+    buffer[length++] = 0xFF;
+    buffer[length++] = marker;
+}
+
+void BitWriter::clear()
+{
+    length = 0;
+    accumulator = 0;
+    freeBits = 64;
+}
+
+void BitWriter::clearBytes()
+{
+    length = 0;
+}
+
+const uint8_t *BitWriter::data() const
+{
+    return buffer.data();
+}
+
+size_t BitWriter::size() const
+{
+    return length;
+}
@@ -0,0 +1,123 @@
+#ifndef _BITWRITER_HPP_
+#define _BITWRITER_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Entropy coded segment writer
+ *   Bits are packed MSB first into a 64-bit accumulator. Every time it is
+ *   full the whole word goes to the output buffer at once; the JPEG
+ *   0xFF -> 0xFF 0x00 stuffing is only done byte by byte for the (rare)
+ *   words that contain a 0xFF byte.
+ *   Every encoder (or restart segment) owns its writer, there is no shared
+ *   state, and the output buffer keeps its capacity across clear().
+ */
+class BitWriter
+{
+public:
+    /**
+     * @brief Append the length low bits of bits, most significant first
+     *
+     * @param bits value (right aligned, upper bits ignored)
+     * @param length number of bits, 1..32
+     */
+    inline void writeBits(uint32_t bits, int length)
+    {
+        uint64_t value = bits & ((uint64_t(1) << length) - 1);
+        if (length < freeBits)
+        {
+            accumulator = (accumulator << length) | value;
+            freeBits -= length;
+            return;
+        }
+
+        // Complete the word with the top of value, keep the rest for the next one
+        int overflow = length - freeBits;
+        flushWord((accumulator << freeBits) | (value >> overflow));
+        accumulator = value & ((uint64_t(1) << overflow) - 1);
+        freeBits = 64 - overflow;
+    }
+
+    /**
+     * @brief Complete the current byte with 1 bits (JPEG padding) and output every pending byte
+     */
+    void flush();
+
+    /**
+     * @brief Flush then write a 0xFF marker byte pair, without stuffing
+     *
+     * @param marker second byte of the marker (e.g. 0xD0 for RST0)
+     */
+    void writeMarker(uint8_t marker);
+
+    /**
+     * @brief Forget the written bytes and any pending bits
+     */
+    void clear();
+
+    /**
+     * @brief Forget the bytes already handed out, pending bits are kept
+     */
+    void clearBytes();
+
+    /**
+     * @brief Bytes written so far (pending bits excluded)
+     */
+    const uint8_t *data() const;
+    size_t size() const;
+
+private:
+    vector<uint8_t> buffer;
+    size_t length = 0;
+    uint64_t accumulator = 0;
+    int freeBits = 64;
+
+    /**
+     * @brief Make room for at least extra more bytes
+     */
+    inline void reserve(size_t extra)
+    {
+        if (length + extra > buffer.size())
+        {
+            buffer.resize(std::max(buffer.size() * 2, length + extra + 4096));
+        }
+    }
+
+    /**
+     * @brief Output a full 64-bit word, stuffing a 0x00 after every 0xFF
+     */
+    inline void flushWord(uint64_t word)
+    {
+        reserve(16);
+
+        // A byte of word is 0xFF <=> the same byte of ~word is zero
+        uint64_t inverted = ~word;
+        bool hasFF = ((inverted - 0x0101010101010101ULL) & ~inverted & 0x8080808080808080ULL) != 0;
+
+        if (!hasFF)
+        {
+            uint64_t bigEndian = __builtin_bswap64(word);
+            std::memcpy(&buffer[length], &bigEndian, 8);
+            length += 8;
+            return;
+        }
+
+        for (int shift = 56; shift >= 0; shift -= 8)
+        {
+            uint8_t byte = static_cast<uint8_t>(word >> shift);
+            buffer[length++] = byte;
+            if (byte == 0xFF)
+            {
+                buffer[length++] = 0x00;
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef _BLOCKSTORE_HPP_
+#define _BLOCKSTORE_HPP_
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <utility>
+
+using namespace std;
+
+/**
+ * @brief Flat storage for 8x8 blocks
+ *   Every block is a fixed T[64] (row major, block[y * 8 + x]) and all
+ *   blocks of a component live in one 64-byte aligned allocation.
+ *   The allocation is kept when the store shrinks, so refilling it
+ *   with the same number of blocks costs nothing.
+ *
+ * @tparam T coefficient type
+ */
+template <typename T>
+class BlockStore
+{
+public:
+    static const size_t ALIGNMENT = 64;
+
+    BlockStore() = default;
+
+    BlockStore(const BlockStore &other)
+    {
+        *this = other;
+    }
+
+    BlockStore(BlockStore &&other) noexcept
+    {
+        swap(other);
+    }
+
+    BlockStore &operator=(const BlockStore &other)
+    {
+        if (this != &other)
+        {
+            resize(other.count);
+            if (count > 0)
+            {
+                std::memcpy(blocks, other.blocks, count * sizeof(T) * 64);
+            }
+        }
+        return *this;
+    }
+
+    BlockStore &operator=(BlockStore &&other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    ~BlockStore()
+    {
+        release();
+    }
+
+    /**
+     * @brief Set the number of blocks, reallocates only when growing past capacity
+     *   Block contents are not preserved on reallocation
+     *
+     * @param newCount number of blocks
+     */
+    void resize(size_t newCount)
+    {
+        if (newCount > capacity)
+        {
+            release();
+            blocks = static_cast<T *>(::operator new(newCount * sizeof(T) * 64, std::align_val_t(ALIGNMENT)));
+            capacity = newCount;
+        }
+        count = newCount;
+    }
+
+    /**
+     * @brief Forget every block, keeps the allocation
+     */
+    void clear()
+    {
+        count = 0;
+    }
+
+    /**
+     * @brief Give the memory back
+     */
+    void release()
+    {
+        if (blocks != nullptr)
+        {
+            ::operator delete(blocks, std::align_val_t(ALIGNMENT));
+        }
+        blocks = nullptr;
+        count = 0;
+        capacity = 0;
+    }
+
+    void swap(BlockStore &other) noexcept
+    {
+        std::swap(blocks, other.blocks);
+        std::swap(count, other.count);
+        std::swap(capacity, other.capacity);
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    /**
+     * @brief Get block number index (64 coefficients)
+     */
+    T *operator[](size_t index)
+    {
+        return blocks + index * 64;
+    }
+
+    const T *operator[](size_t index) const
+    {
+        return blocks + index * 64;
+    }
+
+    /**
+     * @brief First coefficient of the first block, blocks are contiguous
+     */
+    T *data()
+    {
+        return blocks;
+    }
+
+    const T *data() const
+    {
+        return blocks;
+    }
+
+private:
+    T *blocks = nullptr;
+    size_t count = 0;
+    size_t capacity = 0;
+};
+
+#endif
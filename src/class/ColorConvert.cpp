@@ -0,0 +1,906 @@
+#include "ColorConvert.hpp"
+
+static_assert(sizeof(Pixel) == 3, "kernels read Pixel data as packed RGB bytes");
+
+// 14-bit fixed-point BT.601 coefficients, each row sums to 2^14 (Y) or 0 (Cb, Cr)
+static const int SCALE_BITS = 14;
+static const int Y_R = 4899, Y_G = 9617, Y_B = 1868;
+static const int CB_R = -2764, CB_G = -5428, CB_B = 8192;
+static const int CR_R = 8192, CR_G = -6860, CR_B = -1332;
+static const int32_t ROUND = 1 << (SCALE_BITS - 1);
+static const int32_t CHROMA_OFFSET = (128 << SCALE_BITS) + ROUND;
+
+/**
+ * @brief Byte layout of a pixel format: bytes per pixel and offset of each channel
+ *   margin: pixels an AVX2 load of 8 pixels reads past them (3-byte formats only)
+ */
+template <int BYTES, int R, int G, int B>
+struct Layout
+{
+    static const int bytes = BYTES;
+    static const int r = R, g = G, b = B;
+    static const int margin = BYTES == 3 ? 3 : 0;
+};
+
+typedef Layout<3, 0, 1, 2> RGBLayout;
+typedef Layout<3, 2, 1, 0> BGRLayout;
+typedef Layout<4, 0, 1, 2> RGBALayout;
+typedef Layout<4, 2, 1, 0> BGRALayout;
+
+// Run fn with the layout of format (an empty object, fn(Layout) picks the instantiation)
+template <typename Fn>
+static void withLayout(PixelFormat format, Fn fn)
+{
+    switch (format)
+    {
+    case PixelFormat::RGB:
+        fn(RGBLayout());
+        break;
+    case PixelFormat::BGR:
+        fn(BGRLayout());
+        break;
+    case PixelFormat::RGBA:
+        fn(RGBALayout());
+        break;
+    case PixelFormat::BGRA:
+        fn(BGRALayout());
+        break;
+    }
+}
+
+static inline int clampSample(int value)
+{
+    return value > 255 ? 255 : value;
+}
+
+// Output policies: 8-bit samples as is, int16 samples level-shifted
+static inline void storeSample(uint8_t *out, int value)
+{
+    *out = static_cast<uint8_t>(value);
+}
+
+static inline void storeSample(int16_t *out, int value)
+{
+    *out = static_cast<int16_t>(value - 128);
+}
+
+template <class L, typename T>
+static void convertScalar(const uint8_t *in, size_t count, T *y, T *cb, T *cr)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint8_t *pixel = in + i * L::bytes;
+        int r = pixel[L::r];
+        int g = pixel[L::g];
+        int b = pixel[L::b];
+
+        // Y never leaves 0..255, Cb/Cr can reach 256 (pure blue/red) and never go below 0
+        storeSample(y + i, (Y_R * r + Y_G * g + Y_B * b + ROUND) >> SCALE_BITS);
+        storeSample(cb + i, clampSample((CB_R * r + CB_G * g + CB_B * b + CHROMA_OFFSET) >> SCALE_BITS));
+        storeSample(cr + i, clampSample((CR_R * r + CR_G * g + CR_B * b + CHROMA_OFFSET) >> SCALE_BITS));
+    }
+}
+
+template <class L>
+static void lumaScalar(const uint8_t *in, size_t count, uint8_t *y)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const uint8_t *pixel = in + i * L::bytes;
+        y[i] = static_cast<uint8_t>((Y_R * pixel[L::r] + Y_G * pixel[L::g] + Y_B * pixel[L::b] + ROUND) >> SCALE_BITS);
+    }
+}
+
+/**
+ * @brief Fused 4:2:0 conversion from pixel first (even) to the end of the rows
+ *   Chroma is computed once per 2x2 square from the summed products, so the
+ *   average is rounded a single time. n pixels in a square (4, 2 at the odd
+ *   edges, 1 in the corner): (sum + n * offset) >> (14 + log2 n).
+ */
+template <class L>
+static void convert420Scalar(const uint8_t *row0, const uint8_t *row1, size_t first, size_t width,
+                             uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+    for (size_t x = first; x < width; x += 2)
+    {
+        int sumR = 0, sumG = 0, sumB = 0, n = 0;
+        for (int dy = 0; dy < 2; ++dy)
+        {
+            const uint8_t *row = dy == 0 ? row0 : row1;
+            uint8_t *y = dy == 0 ? y0 : y1;
+            if (row == nullptr)
+            {
+                continue;
+            }
+            for (size_t xx = x; xx < x + 2 && xx < width; ++xx)
+            {
+                const uint8_t *pixel = row + xx * L::bytes;
+                int r = pixel[L::r];
+                int g = pixel[L::g];
+                int b = pixel[L::b];
+                y[xx] = static_cast<uint8_t>((Y_R * r + Y_G * g + Y_B * b + ROUND) >> SCALE_BITS);
+                sumR += r;
+                sumG += g;
+                sumB += b;
+                n++;
+            }
+        }
+
+        int shift = SCALE_BITS + (n == 4 ? 2 : n / 2);
+        cb[x / 2] = static_cast<uint8_t>(clampSample((CB_R * sumR + CB_G * sumG + CB_B * sumB + CHROMA_OFFSET * n) >> shift));
+        cr[x / 2] = static_cast<uint8_t>(clampSample((CR_R * sumR + CR_G * sumG + CR_B * sumB + CHROMA_OFFSET * n) >> shift));
+    }
+}
+
+/**
+ * @brief Fused 4:4:0 conversion of two rows from pixel first to the end
+ *   Chroma once per vertical pair, from the summed products of both rows:
+ *   (sum + 2 offset) >> 15, one rounding as in convert420Scalar().
+ */
+template <class L>
+static void convert440Scalar(const uint8_t *row0, const uint8_t *row1, size_t first, size_t width,
+                             uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+    for (size_t x = first; x < width; ++x)
+    {
+        const uint8_t *top = row0 + x * L::bytes;
+        const uint8_t *bottom = row1 + x * L::bytes;
+        y0[x] = static_cast<uint8_t>((Y_R * top[L::r] + Y_G * top[L::g] + Y_B * top[L::b] + ROUND) >> SCALE_BITS);
+        y1[x] = static_cast<uint8_t>((Y_R * bottom[L::r] + Y_G * bottom[L::g] + Y_B * bottom[L::b] + ROUND) >> SCALE_BITS);
+
+        int sumR = top[L::r] + bottom[L::r];
+        int sumG = top[L::g] + bottom[L::g];
+        int sumB = top[L::b] + bottom[L::b];
+        cb[x] = static_cast<uint8_t>(clampSample((CB_R * sumR + CB_G * sumG + CB_B * sumB + CHROMA_OFFSET * 2) >> (SCALE_BITS + 1)));
+        cr[x] = static_cast<uint8_t>(clampSample((CR_R * sumR + CR_G * sumG + CR_B * sumB + CHROMA_OFFSET * 2) >> (SCALE_BITS + 1)));
+    }
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define JPEG_HAVE_X86_COLOR_KERNELS 1
+#include <immintrin.h>
+
+/**
+ * @brief Two int16 coefficients for _mm_madd_epi16: a multiplies the even lanes, b the odd ones
+ */
+static inline int32_t coefficientPair(int a, int b)
+{
+    return static_cast<int32_t>((static_cast<uint32_t>(static_cast<uint16_t>(b)) << 16) | static_cast<uint16_t>(a));
+}
+
+// ---------------------------------------------------------------- SSE2
+
+/**
+ * @brief Split 16 packed RGB pixels (48 bytes) into 16 R, 16 G and 16 B bytes
+ *   SSE2 has no byte shuffle: four rounds of byte interleaving sort the samples.
+ */
+static inline void deinterleaveSSE2(const uint8_t *in, __m128i &r, __m128i &g, __m128i &b)
+{
+    __m128i t00 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+    __m128i t01 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16));
+    __m128i t02 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 32));
+
+    __m128i t10 = _mm_unpacklo_epi8(t00, _mm_unpackhi_epi64(t01, t01));
+    __m128i t11 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t00, t00), t02);
+    __m128i t12 = _mm_unpacklo_epi8(t01, _mm_unpackhi_epi64(t02, t02));
+
+    __m128i t20 = _mm_unpacklo_epi8(t10, _mm_unpackhi_epi64(t11, t11));
+    __m128i t21 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t10, t10), t12);
+    __m128i t22 = _mm_unpacklo_epi8(t11, _mm_unpackhi_epi64(t12, t12));
+
+    __m128i t30 = _mm_unpacklo_epi8(t20, _mm_unpackhi_epi64(t21, t21));
+    __m128i t31 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t20, t20), t22);
+    __m128i t32 = _mm_unpacklo_epi8(t21, _mm_unpackhi_epi64(t22, t22));
+
+    r = _mm_unpacklo_epi8(t30, _mm_unpackhi_epi64(t31, t31));
+    g = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t30, t30), t32);
+    b = _mm_unpacklo_epi8(t31, _mm_unpackhi_epi64(t32, t32));
+}
+
+/**
+ * @brief Load 16 pixels of layout L as 16 R, 16 G and 16 B bytes
+ *   4-byte pixels: each channel is masked out of the 32-bit words and packed.
+ */
+template <class L>
+static inline void loadSSE2(const uint8_t *in, __m128i &r, __m128i &g, __m128i &b)
+{
+    if (L::bytes == 3)
+    {
+        __m128i channels[3];
+        deinterleaveSSE2(in, channels[0], channels[1], channels[2]);
+        r = channels[L::r];
+        g = channels[L::g];
+        b = channels[L::b];
+        return;
+    }
+
+    const __m128i low = _mm_set1_epi32(0xFF);
+    __m128i words[4];
+    for (int k = 0; k < 4; ++k)
+    {
+        words[k] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16 * k));
+    }
+
+    __m128i *out[3] = {&r, &g, &b};
+    const int offsets[3] = {L::r, L::g, L::b};
+    for (int c = 0; c < 3; ++c)
+    {
+        __m128i w[4];
+        for (int k = 0; k < 4; ++k)
+        {
+            w[k] = _mm_and_si128(_mm_srli_epi32(words[k], 8 * offsets[c]), low);
+        }
+        *out[c] = _mm_packus_epi16(_mm_packs_epi32(w[0], w[1]), _mm_packs_epi32(w[2], w[3]));
+    }
+}
+
+/**
+ * @brief One output channel for 8 pixels given as (R,G) and (B,0) int16 pairs
+ */
+static inline __m128i channelSSE2(__m128i rgLo, __m128i rgHi, __m128i bLo, __m128i bHi,
+                                  __m128i coefRG, __m128i coefB, __m128i offset)
+{
+    __m128i lo = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rgLo, coefRG), _mm_madd_epi16(bLo, coefB)), offset);
+    __m128i hi = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rgHi, coefRG), _mm_madd_epi16(bHi, coefB)), offset);
+    return _mm_packs_epi32(_mm_srai_epi32(lo, SCALE_BITS), _mm_srai_epi32(hi, SCALE_BITS));
+}
+
+// 16 int16 samples (0..256) to the output plane
+static inline void storeSSE2(uint8_t *out, __m128i lo, __m128i hi)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(lo, hi));
+}
+
+static inline void storeSSE2(int16_t *out, __m128i lo, __m128i hi)
+{
+    const __m128i max = _mm_set1_epi16(255);
+    const __m128i shift = _mm_set1_epi16(128);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_sub_epi16(_mm_min_epi16(lo, max), shift));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), _mm_sub_epi16(_mm_min_epi16(hi, max), shift));
+}
+
+/**
+ * @return number of pixels converted (a multiple of 16)
+ */
+template <class L, typename T>
+static size_t convertSSE2(const uint8_t *in, size_t count, T *y, T *cb, T *cr)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i yRG = _mm_set1_epi32(coefficientPair(Y_R, Y_G)), yB = _mm_set1_epi32(coefficientPair(Y_B, 0));
+    const __m128i cbRG = _mm_set1_epi32(coefficientPair(CB_R, CB_G)), cbB = _mm_set1_epi32(coefficientPair(CB_B, 0));
+    const __m128i crRG = _mm_set1_epi32(coefficientPair(CR_R, CR_G)), crB = _mm_set1_epi32(coefficientPair(CR_B, 0));
+    const __m128i lumaOffset = _mm_set1_epi32(ROUND);
+    const __m128i chromaOffset = _mm_set1_epi32(CHROMA_OFFSET);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i r, g, b;
+        loadSSE2<L>(in + i * L::bytes, r, g, b);
+
+        __m128i outY[2], outCb[2], outCr[2];
+        for (int half = 0; half < 2; ++half)
+        {
+            __m128i r16 = half == 0 ? _mm_unpacklo_epi8(r, zero) : _mm_unpackhi_epi8(r, zero);
+            __m128i g16 = half == 0 ? _mm_unpacklo_epi8(g, zero) : _mm_unpackhi_epi8(g, zero);
+            __m128i b16 = half == 0 ? _mm_unpacklo_epi8(b, zero) : _mm_unpackhi_epi8(b, zero);
+
+            __m128i rgLo = _mm_unpacklo_epi16(r16, g16);
+            __m128i rgHi = _mm_unpackhi_epi16(r16, g16);
+            __m128i bLo = _mm_unpacklo_epi16(b16, zero);
+            __m128i bHi = _mm_unpackhi_epi16(b16, zero);
+
+            outY[half] = channelSSE2(rgLo, rgHi, bLo, bHi, yRG, yB, lumaOffset);
+            outCb[half] = channelSSE2(rgLo, rgHi, bLo, bHi, cbRG, cbB, chromaOffset);
+            outCr[half] = channelSSE2(rgLo, rgHi, bLo, bHi, crRG, crB, chromaOffset);
+        }
+
+        storeSSE2(y + i, outY[0], outY[1]);
+        storeSSE2(cb + i, outCb[0], outCb[1]);
+        storeSSE2(cr + i, outCr[0], outCr[1]);
+    }
+    return i;
+}
+
+/**
+ * @return number of pixels converted (a multiple of 16)
+ */
+template <class L>
+static size_t lumaSSE2(const uint8_t *in, size_t count, uint8_t *y)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i yRG = _mm_set1_epi32(coefficientPair(Y_R, Y_G)), yB = _mm_set1_epi32(coefficientPair(Y_B, 0));
+    const __m128i lumaOffset = _mm_set1_epi32(ROUND);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i r, g, b;
+        loadSSE2<L>(in + i * L::bytes, r, g, b);
+
+        __m128i outY[2];
+        for (int half = 0; half < 2; ++half)
+        {
+            __m128i r16 = half == 0 ? _mm_unpacklo_epi8(r, zero) : _mm_unpackhi_epi8(r, zero);
+            __m128i g16 = half == 0 ? _mm_unpacklo_epi8(g, zero) : _mm_unpackhi_epi8(g, zero);
+            __m128i b16 = half == 0 ? _mm_unpacklo_epi8(b, zero) : _mm_unpackhi_epi8(b, zero);
+
+            outY[half] = channelSSE2(_mm_unpacklo_epi16(r16, g16), _mm_unpackhi_epi16(r16, g16),
+                                     _mm_unpacklo_epi16(b16, zero), _mm_unpackhi_epi16(b16, zero),
+                                     yRG, yB, lumaOffset);
+        }
+        storeSSE2(y + i, outY[0], outY[1]);
+    }
+    return i;
+}
+
+/**
+ * @brief Chroma of 4 squares from the products of their two rows
+ *   lo/hi: 4 pixels each, sums of both rows; adjacent pixels are added here.
+ */
+static inline __m128i squareSSE2(__m128i lo, __m128i hi, __m128i offset)
+{
+    __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)));
+    return _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(even, odd), offset), SCALE_BITS + 2);
+}
+
+/**
+ * @return number of pixels of each row converted (a multiple of 16)
+ */
+template <class L>
+static size_t convert420SSE2(const uint8_t *row0, const uint8_t *row1, size_t width,
+                             uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i yRG = _mm_set1_epi32(coefficientPair(Y_R, Y_G)), yB = _mm_set1_epi32(coefficientPair(Y_B, 0));
+    const __m128i cbRG = _mm_set1_epi32(coefficientPair(CB_R, CB_G)), cbB = _mm_set1_epi32(coefficientPair(CB_B, 0));
+    const __m128i crRG = _mm_set1_epi32(coefficientPair(CR_R, CR_G)), crB = _mm_set1_epi32(coefficientPair(CR_B, 0));
+    const __m128i lumaOffset = _mm_set1_epi32(ROUND);
+    const __m128i squareOffset = _mm_set1_epi32(CHROMA_OFFSET * 4);
+
+    const uint8_t *in[2] = {row0, row1};
+    uint8_t *outY[2] = {y0, y1};
+
+    size_t i = 0;
+    for (; i + 16 <= width; i += 16)
+    {
+        // Sums over both rows of the chroma products, 4 pixels per register
+        __m128i cbDot[4] = {zero, zero, zero, zero};
+        __m128i crDot[4] = {zero, zero, zero, zero};
+
+        for (int row = 0; row < 2; ++row)
+        {
+            __m128i r, g, b;
+            loadSSE2<L>(in[row] + i * L::bytes, r, g, b);
+
+            __m128i lumaHalf[2];
+            for (int half = 0; half < 2; ++half)
+            {
+                __m128i r16 = half == 0 ? _mm_unpacklo_epi8(r, zero) : _mm_unpackhi_epi8(r, zero);
+                __m128i g16 = half == 0 ? _mm_unpacklo_epi8(g, zero) : _mm_unpackhi_epi8(g, zero);
+                __m128i b16 = half == 0 ? _mm_unpacklo_epi8(b, zero) : _mm_unpackhi_epi8(b, zero);
+
+                __m128i rgLo = _mm_unpacklo_epi16(r16, g16);
+                __m128i rgHi = _mm_unpackhi_epi16(r16, g16);
+                __m128i bLo = _mm_unpacklo_epi16(b16, zero);
+                __m128i bHi = _mm_unpackhi_epi16(b16, zero);
+
+                lumaHalf[half] = channelSSE2(rgLo, rgHi, bLo, bHi, yRG, yB, lumaOffset);
+
+                cbDot[half * 2] = _mm_add_epi32(cbDot[half * 2], _mm_add_epi32(_mm_madd_epi16(rgLo, cbRG), _mm_madd_epi16(bLo, cbB)));
+                cbDot[half * 2 + 1] = _mm_add_epi32(cbDot[half * 2 + 1], _mm_add_epi32(_mm_madd_epi16(rgHi, cbRG), _mm_madd_epi16(bHi, cbB)));
+                crDot[half * 2] = _mm_add_epi32(crDot[half * 2], _mm_add_epi32(_mm_madd_epi16(rgLo, crRG), _mm_madd_epi16(bLo, crB)));
+                crDot[half * 2 + 1] = _mm_add_epi32(crDot[half * 2 + 1], _mm_add_epi32(_mm_madd_epi16(rgHi, crRG), _mm_madd_epi16(bHi, crB)));
+            }
+            storeSSE2(outY[row] + i, lumaHalf[0], lumaHalf[1]);
+        }
+
+        __m128i cb16 = _mm_packs_epi32(squareSSE2(cbDot[0], cbDot[1], squareOffset), squareSSE2(cbDot[2], cbDot[3], squareOffset));
+        __m128i cr16 = _mm_packs_epi32(squareSSE2(crDot[0], crDot[1], squareOffset), squareSSE2(crDot[2], crDot[3], squareOffset));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(cb + i / 2), _mm_packus_epi16(cb16, cb16));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(cr + i / 2), _mm_packus_epi16(cr16, cr16));
+    }
+    return i;
+}
+
+/**
+ * @return number of pixels of each row converted (a multiple of 16)
+ */
+template <class L>
+static size_t convert440SSE2(const uint8_t *row0, const uint8_t *row1, size_t width,
+                             uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i yRG = _mm_set1_epi32(coefficientPair(Y_R, Y_G)), yB = _mm_set1_epi32(coefficientPair(Y_B, 0));
+    const __m128i cbRG = _mm_set1_epi32(coefficientPair(CB_R, CB_G)), cbB = _mm_set1_epi32(coefficientPair(CB_B, 0));
+    const __m128i crRG = _mm_set1_epi32(coefficientPair(CR_R, CR_G)), crB = _mm_set1_epi32(coefficientPair(CR_B, 0));
+    const __m128i lumaOffset = _mm_set1_epi32(ROUND);
+    const __m128i pairOffset = _mm_set1_epi32(CHROMA_OFFSET * 2);
+
+    const uint8_t *in[2] = {row0, row1};
+    uint8_t *outY[2] = {y0, y1};
+
+    size_t i = 0;
+    for (; i + 16 <= width; i += 16)
+    {
+        // Sums over both rows of the chroma products, 4 pixels per register
+        __m128i cbDot[4] = {pairOffset, pairOffset, pairOffset, pairOffset};
+        __m128i crDot[4] = {pairOffset, pairOffset, pairOffset, pairOffset};
+
+        for (int row = 0; row < 2; ++row)
+        {
+            __m128i r, g, b;
+            loadSSE2<L>(in[row] + i * L::bytes, r, g, b);
+
+            __m128i lumaHalf[2];
+            for (int half = 0; half < 2; ++half)
+            {
+                __m128i r16 = half == 0 ? _mm_unpacklo_epi8(r, zero) : _mm_unpackhi_epi8(r, zero);
+                __m128i g16 = half == 0 ? _mm_unpacklo_epi8(g, zero) : _mm_unpackhi_epi8(g, zero);
+                __m128i b16 = half == 0 ? _mm_unpacklo_epi8(b, zero) : _mm_unpackhi_epi8(b, zero);
+
+                __m128i rgLo = _mm_unpacklo_epi16(r16, g16);
+                __m128i rgHi = _mm_unpackhi_epi16(r16, g16);
+                __m128i bLo = _mm_unpacklo_epi16(b16, zero);
+                __m128i bHi = _mm_unpackhi_epi16(b16, zero);
+
+                lumaHalf[half] = channelSSE2(rgLo, rgHi, bLo, bHi, yRG, yB, lumaOffset);
+
+                cbDot[half * 2] = _mm_add_epi32(cbDot[half * 2], _mm_add_epi32(_mm_madd_epi16(rgLo, cbRG), _mm_madd_epi16(bLo, cbB)));
+                cbDot[half * 2 + 1] = _mm_add_epi32(cbDot[half * 2 + 1], _mm_add_epi32(_mm_madd_epi16(rgHi, cbRG), _mm_madd_epi16(bHi, cbB)));
+                crDot[half * 2] = _mm_add_epi32(crDot[half * 2], _mm_add_epi32(_mm_madd_epi16(rgLo, crRG), _mm_madd_epi16(bLo, crB)));
+                crDot[half * 2 + 1] = _mm_add_epi32(crDot[half * 2 + 1], _mm_add_epi32(_mm_madd_epi16(rgHi, crRG), _mm_madd_epi16(bHi, crB)));
+            }
+            storeSSE2(outY[row] + i, lumaHalf[0], lumaHalf[1]);
+        }
+
+        __m128i pair[2][4];
+        for (int k = 0; k < 4; ++k)
+        {
+            pair[0][k] = _mm_srai_epi32(cbDot[k], SCALE_BITS + 1);
+            pair[1][k] = _mm_srai_epi32(crDot[k], SCALE_BITS + 1);
+        }
+        storeSSE2(cb + i, _mm_packs_epi32(pair[0][0], pair[0][1]), _mm_packs_epi32(pair[0][2], pair[0][3]));
+        storeSSE2(cr + i, _mm_packs_epi32(pair[1][0], pair[1][1]), _mm_packs_epi32(pair[1][2], pair[1][3]));
+    }
+    return i;
+}
+
+// ---------------------------------------------------------------- AVX2
+
+/**
+ * @brief One output channel for 8 pixels given as (R,G) and (B,0) int16 pairs
+ */
+__attribute__((target("avx2"))) static inline __m256i channelAVX2(__m256i rg, __m256i b, __m256i coefRG, __m256i coefB, __m256i offset)
+{
+    __m256i sum = _mm256_add_epi32(_mm256_add_epi32(_mm256_madd_epi16(rg, coefRG), _mm256_madd_epi16(b, coefB)), offset);
+    return _mm256_srai_epi32(sum, SCALE_BITS);
+}
+
+/**
+ * @brief Load 8 pixels of layout L as (R,G) and (B,0) int16 pairs
+ *   3-byte pixels: the 24 bytes are spread over the two lanes (12 each) first;
+ *   4-byte pixels already are 4 per lane. Then one byte shuffle gives the
+ *   (R,G) pairs and another the (B,0) pairs.
+ */
+template <class L>
+__attribute__((target("avx2"))) static inline void loadAVX2(const uint8_t *in, __m256i &rg, __m256i &b)
+{
+    const int S = L::bytes, R = L::r, G = L::g, B = L::b;
+    const __m256i rgMask = _mm256_setr_epi8(R, -1, G, -1, S + R, -1, S + G, -1, 2 * S + R, -1, 2 * S + G, -1, 3 * S + R, -1, 3 * S + G, -1,
+                                            R, -1, G, -1, S + R, -1, S + G, -1, 2 * S + R, -1, 2 * S + G, -1, 3 * S + R, -1, 3 * S + G, -1);
+    const __m256i bMask = _mm256_setr_epi8(B, -1, -1, -1, S + B, -1, -1, -1, 2 * S + B, -1, -1, -1, 3 * S + B, -1, -1, -1,
+                                           B, -1, -1, -1, S + B, -1, -1, -1, 2 * S + B, -1, -1, -1, 3 * S + B, -1, -1, -1);
+
+    __m256i raw = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in));
+    if (S == 3)
+    {
+        raw = _mm256_permutevar8x32_epi32(raw, _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0));
+    }
+    rg = _mm256_shuffle_epi8(raw, rgMask);
+    b = _mm256_shuffle_epi8(raw, bMask);
+}
+
+// Two registers of 8 int32 samples to 16 int16 samples, pixel order kept
+__attribute__((target("avx2"))) static inline __m256i packAVX2(__m256i a, __m256i b)
+{
+    // packs works per 128-bit lane: restore the pixel order
+    return _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+}
+
+__attribute__((target("avx2"))) static inline void storeAVX2(uint8_t *out, __m256i first, __m256i second)
+{
+    __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(first, second), 0xD8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), bytes);
+}
+
+__attribute__((target("avx2"))) static inline void storeAVX2(int16_t *out, __m256i first, __m256i second)
+{
+    const __m256i max = _mm256_set1_epi16(255);
+    const __m256i shift = _mm256_set1_epi16(128);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_sub_epi16(_mm256_min_epi16(first, max), shift));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 16), _mm256_sub_epi16(_mm256_min_epi16(second, max), shift));
+}
+
+/**
+ * @return number of pixels converted (a multiple of 32)
+ */
+template <class L, typename T>
+__attribute__((target("avx2"))) static size_t convertAVX2(const uint8_t *in, size_t count, T *y, T *cb, T *cr)
+{
+    const __m256i yRG = _mm256_set1_epi32(coefficientPair(Y_R, Y_G)), yB = _mm256_set1_epi32(coefficientPair(Y_B, 0));
+    const __m256i cbRG = _mm256_set1_epi32(coefficientPair(CB_R, CB_G)), cbB = _mm256_set1_epi32(coefficientPair(CB_B, 0));
+    const __m256i crRG = _mm256_set1_epi32(coefficientPair(CR_R, CR_G)), crB = _mm256_set1_epi32(coefficientPair(CR_B, 0));
+    const __m256i lumaOffset = _mm256_set1_epi32(ROUND);
+    const __m256i chromaOffset = _mm256_set1_epi32(CHROMA_OFFSET);
+
+    size_t i = 0;
+
+    // With 3-byte pixels the last 32-byte load reads 8 bytes past its 8 pixels:
+    // keep L::margin pixels of margin
+    for (; i + 32 + L::margin <= count; i += 32)
+    {
+        __m256i outY[4], outCb[4], outCr[4];
+        for (int group = 0; group < 4; ++group)
+        {
+            __m256i rg, b;
+            loadAVX2<L>(in + (i + group * 8) * L::bytes, rg, b);
+
+            outY[group] = channelAVX2(rg, b, yRG, yB, lumaOffset);
+            outCb[group] = channelAVX2(rg, b, cbRG, cbB, chromaOffset);
+            outCr[group] = channelAVX2(rg, b, crRG, crB, chromaOffset);
+        }
+
+        storeAVX2(y + i, packAVX2(outY[0], outY[1]), packAVX2(outY[2], outY[3]));
+        storeAVX2(cb + i, packAVX2(outCb[0], outCb[1]), packAVX2(outCb[2], outCb[3]));
+        storeAVX2(cr + i, packAVX2(outCr[0], outCr[1]), packAVX2(outCr[2], outCr[3]));
+    }
+    return i;
+}
+
+/**
+ * @return number of pixels converted (a multiple of 32)
+ */
+template <class L>
+__attribute__((target("avx2"))) static size_t lumaAVX2(const uint8_t *in, size_t count, uint8_t *y)
+{
+    const __m256i yRG = _mm256_set1_epi32(coefficientPair(Y_R, Y_G)), yB = _mm256_set1_epi32(coefficientPair(Y_B, 0));
+    const __m256i lumaOffset = _mm256_set1_epi32(ROUND);
+
+    size_t i = 0;
+
+    // Same margin as convertAVX2()
+    for (; i + 32 + L::margin <= count; i += 32)
+    {
+        __m256i outY[4];
+        for (int group = 0; group < 4; ++group)
+        {
+            __m256i rg, b;
+            loadAVX2<L>(in + (i + group * 8) * L::bytes, rg, b);
+            outY[group] = channelAVX2(rg, b, yRG, yB, lumaOffset);
+        }
+        storeAVX2(y + i, packAVX2(outY[0], outY[1]), packAVX2(outY[2], outY[3]));
+    }
+    return i;
+}
+
+/**
+ * @brief Chroma of 8 squares from the products of 16 pixels (two groups of 8, both rows summed)
+ */
+__attribute__((target("avx2"))) static inline __m256i squareAVX2(__m256i first, __m256i second, __m256i offset)
+{
+    // hadd pairs adjacent pixels per 128-bit lane, the permute restores the order
+    __m256i sums = _mm256_permute4x64_epi64(_mm256_hadd_epi32(first, second), 0xD8);
+    return _mm256_srai_epi32(_mm256_add_epi32(sums, offset), SCALE_BITS + 2);
+}
+
+/**
+ * @return number of pixels of each row converted (a multiple of 32)
+ */
+template <class L>
+__attribute__((target("avx2"))) static size_t convert420AVX2(const uint8_t *row0, const uint8_t *row1, size_t width,
+                                                             uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+    const __m256i yRG = _mm256_set1_epi32(coefficientPair(Y_R, Y_G)), yB = _mm256_set1_epi32(coefficientPair(Y_B, 0));
+    const __m256i cbRG = _mm256_set1_epi32(coefficientPair(CB_R, CB_G)), cbB = _mm256_set1_epi32(coefficientPair(CB_B, 0));
+    const __m256i crRG = _mm256_set1_epi32(coefficientPair(CR_R, CR_G)), crB = _mm256_set1_epi32(coefficientPair(CR_B, 0));
+    const __m256i lumaOffset = _mm256_set1_epi32(ROUND);
+    const __m256i squareOffset = _mm256_set1_epi32(CHROMA_OFFSET * 4);
+
+    const uint8_t *in[2] = {row0, row1};
+    uint8_t *outY[2] = {y0, y1};
+
+    size_t i = 0;
+
+    // Same margin as convertAVX2()
+    for (; i + 32 + L::margin <= width; i += 32)
+    {
+        __m256i cbDot[4], crDot[4];
+        for (int row = 0; row < 2; ++row)
+        {
+            __m256i luma[4];
+            for (int group = 0; group < 4; ++group)
+            {
+                __m256i rg, b;
+                loadAVX2<L>(in[row] + (i + group * 8) * L::bytes, rg, b);
+
+                luma[group] = channelAVX2(rg, b, yRG, yB, lumaOffset);
+
+                __m256i cbProduct = _mm256_add_epi32(_mm256_madd_epi16(rg, cbRG), _mm256_madd_epi16(b, cbB));
+                __m256i crProduct = _mm256_add_epi32(_mm256_madd_epi16(rg, crRG), _mm256_madd_epi16(b, crB));
+                cbDot[group] = row == 0 ? cbProduct : _mm256_add_epi32(cbDot[group], cbProduct);
+                crDot[group] = row == 0 ? crProduct : _mm256_add_epi32(crDot[group], crProduct);
+            }
+            storeAVX2(outY[row] + i, packAVX2(luma[0], luma[1]), packAVX2(luma[2], luma[3]));
+        }
+
+        __m256i cb16 = packAVX2(squareAVX2(cbDot[0], cbDot[1], squareOffset), squareAVX2(cbDot[2], cbDot[3], squareOffset));
+        __m256i cr16 = packAVX2(squareAVX2(crDot[0], crDot[1], squareOffset), squareAVX2(crDot[2], crDot[3], squareOffset));
+        __m256i cb8 = _mm256_permute4x64_epi64(_mm256_packus_epi16(cb16, cb16), 0xD8);
+        __m256i cr8 = _mm256_permute4x64_epi64(_mm256_packus_epi16(cr16, cr16), 0xD8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(cb + i / 2), _mm256_castsi256_si128(cb8));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(cr + i / 2), _mm256_castsi256_si128(cr8));
+    }
+    return i;
+}
+/**
+ * @return number of pixels of each row converted (a multiple of 32)
+ */
+template <class L>
+__attribute__((target("avx2"))) static size_t convert440AVX2(const uint8_t *row0, const uint8_t *row1, size_t width,
+                                                             uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+    const __m256i yRG = _mm256_set1_epi32(coefficientPair(Y_R, Y_G)), yB = _mm256_set1_epi32(coefficientPair(Y_B, 0));
+    const __m256i cbRG = _mm256_set1_epi32(coefficientPair(CB_R, CB_G)), cbB = _mm256_set1_epi32(coefficientPair(CB_B, 0));
+    const __m256i crRG = _mm256_set1_epi32(coefficientPair(CR_R, CR_G)), crB = _mm256_set1_epi32(coefficientPair(CR_B, 0));
+    const __m256i lumaOffset = _mm256_set1_epi32(ROUND);
+    const __m256i pairOffset = _mm256_set1_epi32(CHROMA_OFFSET * 2);
+
+    const uint8_t *in[2] = {row0, row1};
+    uint8_t *outY[2] = {y0, y1};
+
+    size_t i = 0;
+
+    // Same margin as convertAVX2()
+    for (; i + 32 + L::margin <= width; i += 32)
+    {
+        __m256i cbDot[4], crDot[4];
+        for (int row = 0; row < 2; ++row)
+        {
+            __m256i luma[4];
+            for (int group = 0; group < 4; ++group)
+            {
+                __m256i rg, b;
+                loadAVX2<L>(in[row] + (i + group * 8) * L::bytes, rg, b);
+
+                luma[group] = channelAVX2(rg, b, yRG, yB, lumaOffset);
+
+                __m256i cbProduct = _mm256_add_epi32(_mm256_madd_epi16(rg, cbRG), _mm256_madd_epi16(b, cbB));
+                __m256i crProduct = _mm256_add_epi32(_mm256_madd_epi16(rg, crRG), _mm256_madd_epi16(b, crB));
+                cbDot[group] = _mm256_add_epi32(row == 0 ? pairOffset : cbDot[group], cbProduct);
+                crDot[group] = _mm256_add_epi32(row == 0 ? pairOffset : crDot[group], crProduct);
+            }
+            storeAVX2(outY[row] + i, packAVX2(luma[0], luma[1]), packAVX2(luma[2], luma[3]));
+        }
+
+        for (int group = 0; group < 4; ++group)
+        {
+            cbDot[group] = _mm256_srai_epi32(cbDot[group], SCALE_BITS + 1);
+            crDot[group] = _mm256_srai_epi32(crDot[group], SCALE_BITS + 1);
+        }
+        storeAVX2(cb + i, packAVX2(cbDot[0], cbDot[1]), packAVX2(cbDot[2], cbDot[3]));
+        storeAVX2(cr + i, packAVX2(crDot[0], crDot[1]), packAVX2(crDot[2], crDot[3]));
+    }
+    return i;
+}
+#endif
+
+ColorKernel bestColorKernel()
+{
+#ifdef JPEG_HAVE_X86_COLOR_KERNELS
+    static const ColorKernel best = __builtin_cpu_supports("avx2") ? ColorKernel::AVX2 : ColorKernel::SSE2;
+    return best;
+#else
+    return ColorKernel::Scalar;
+#endif
+}
+
+template <class L, typename T>
+static void convert(const uint8_t *in, size_t count, T *y, T *cb, T *cr, ColorKernel kernel)
+{
+    size_t done = 0;
+
+#ifdef JPEG_HAVE_X86_COLOR_KERNELS
+    if (kernel == ColorKernel::AVX2 && bestColorKernel() == ColorKernel::AVX2)
+    {
+        done = convertAVX2<L>(in, count, y, cb, cr);
+    }
+    if (kernel != ColorKernel::Scalar)
+    {
+        done += convertSSE2<L>(in + done * L::bytes, count - done, y + done, cb + done, cr + done);
+    }
+#endif
+
+    // Remaining pixels (or everything without SIMD)
+    convertScalar<L>(in + done * L::bytes, count - done, y + done, cb + done, cr + done);
+}
+
+template <class L>
+static void convert420(const uint8_t *row0, const uint8_t *row1, size_t width,
+                       uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr, ColorKernel kernel)
+{
+    size_t done = 0;
+
+#ifdef JPEG_HAVE_X86_COLOR_KERNELS
+    // Squares one pixel high: the kernels sum row0 twice, (2 p + 4 offset) >> 16
+    // is exactly (p + 2 offset) >> 15
+    const uint8_t *second = row1 != nullptr ? row1 : row0;
+    uint8_t *secondY = row1 != nullptr ? y1 : y0;
+    if (kernel == ColorKernel::AVX2 && bestColorKernel() == ColorKernel::AVX2)
+    {
+        done = convert420AVX2<L>(row0, second, width, y0, secondY, cb, cr);
+    }
+    if (kernel != ColorKernel::Scalar)
+    {
+        done += convert420SSE2<L>(row0 + done * L::bytes, second + done * L::bytes, width - done,
+                                  y0 + done, secondY + done, cb + done / 2, cr + done / 2);
+    }
+#endif
+
+    convert420Scalar<L>(row0, row1, done, width, y0, y1, cb, cr);
+}
+
+template <class L>
+static void convert440(const uint8_t *row0, const uint8_t *row1, size_t width,
+                       uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr, ColorKernel kernel)
+{
+    // A row without a pair below (odd height): its own chroma
+    if (row1 == nullptr)
+    {
+        convert<L>(row0, width, y0, cb, cr, kernel);
+        return;
+    }
+
+    size_t done = 0;
+
+#ifdef JPEG_HAVE_X86_COLOR_KERNELS
+    if (kernel == ColorKernel::AVX2 && bestColorKernel() == ColorKernel::AVX2)
+    {
+        done = convert440AVX2<L>(row0, row1, width, y0, y1, cb, cr);
+    }
+    if (kernel != ColorKernel::Scalar)
+    {
+        done += convert440SSE2<L>(row0 + done * L::bytes, row1 + done * L::bytes, width - done,
+                                  y0 + done, y1 + done, cb + done, cr + done);
+    }
+#endif
+
+    convert440Scalar<L>(row0, row1, done, width, y0, y1, cb, cr);
+}
+
+template <class L>
+static void convertLuma(const uint8_t *in, size_t count, uint8_t *y, ColorKernel kernel)
+{
+    size_t done = 0;
+
+#ifdef JPEG_HAVE_X86_COLOR_KERNELS
+    if (kernel == ColorKernel::AVX2 && bestColorKernel() == ColorKernel::AVX2)
+    {
+        done = lumaAVX2<L>(in, count, y);
+    }
+    if (kernel != ColorKernel::Scalar)
+    {
+        done += lumaSSE2<L>(in + done * L::bytes, count - done, y + done);
+    }
+#endif
+
+    lumaScalar<L>(in + done * L::bytes, count - done, y + done);
+}
+
+static inline const uint8_t *bytesOf(const Pixel *pixels)
+{
+    return reinterpret_cast<const uint8_t *>(pixels);
+}
+
+void rgbToYCbCr(const Pixel *pixels, size_t count, uint8_t *y, uint8_t *cb, uint8_t *cr)
+{
+    convert<RGBLayout>(bytesOf(pixels), count, y, cb, cr, bestColorKernel());
+}
+
+void rgbToYCbCr(const Pixel *pixels, size_t count, uint8_t *y, uint8_t *cb, uint8_t *cr, ColorKernel kernel)
+{
+    convert<RGBLayout>(bytesOf(pixels), count, y, cb, cr, kernel);
+}
+
+void rgbToYCbCr(const Pixel *pixels, size_t count, int16_t *y, int16_t *cb, int16_t *cr)
+{
+    convert<RGBLayout>(bytesOf(pixels), count, y, cb, cr, bestColorKernel());
+}
+
+void rgbToYCbCr(const Pixel *pixels, size_t count, int16_t *y, int16_t *cb, int16_t *cr, ColorKernel kernel)
+{
+    convert<RGBLayout>(bytesOf(pixels), count, y, cb, cr, kernel);
+}
+
+void rgbToYCbCr(const uint8_t *pixels, PixelFormat format, size_t count, uint8_t *y, uint8_t *cb, uint8_t *cr)
+{
+    rgbToYCbCr(pixels, format, count, y, cb, cr, bestColorKernel());
+}
+
+void rgbToYCbCr(const uint8_t *pixels, PixelFormat format, size_t count, uint8_t *y, uint8_t *cb, uint8_t *cr, ColorKernel kernel)
+{
+    withLayout(format, [&](auto layout)
+               { convert<decltype(layout)>(pixels, count, y, cb, cr, kernel); });
+}
+
+void rgbToYCbCr420(const Pixel *row0, const Pixel *row1, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+    convert420<RGBLayout>(bytesOf(row0), bytesOf(row1), width, y0, y1, cb, cr, bestColorKernel());
+}
+
+void rgbToYCbCr420(const Pixel *row0, const Pixel *row1, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr, ColorKernel kernel)
+{
+    convert420<RGBLayout>(bytesOf(row0), bytesOf(row1), width, y0, y1, cb, cr, kernel);
+}
+
+void rgbToYCbCr420(const uint8_t *row0, const uint8_t *row1, PixelFormat format, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+    rgbToYCbCr420(row0, row1, format, width, y0, y1, cb, cr, bestColorKernel());
+}
+
+void rgbToYCbCr420(const uint8_t *row0, const uint8_t *row1, PixelFormat format, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr, ColorKernel kernel)
+{
+    withLayout(format, [&](auto layout)
+               { convert420<decltype(layout)>(row0, row1, width, y0, y1, cb, cr, kernel); });
+}
+
+void rgbToYCbCr440(const Pixel *row0, const Pixel *row1, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+    convert440<RGBLayout>(bytesOf(row0), bytesOf(row1), width, y0, y1, cb, cr, bestColorKernel());
+}
+
+void rgbToYCbCr440(const Pixel *row0, const Pixel *row1, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr, ColorKernel kernel)
+{
+    convert440<RGBLayout>(bytesOf(row0), bytesOf(row1), width, y0, y1, cb, cr, kernel);
+}
+
+void rgbToYCbCr440(const uint8_t *row0, const uint8_t *row1, PixelFormat format, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr)
+{
+    rgbToYCbCr440(row0, row1, format, width, y0, y1, cb, cr, bestColorKernel());
+}
+
+void rgbToYCbCr440(const uint8_t *row0, const uint8_t *row1, PixelFormat format, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr, ColorKernel kernel)
+{
+    withLayout(format, [&](auto layout)
+               { convert440<decltype(layout)>(row0, row1, width, y0, y1, cb, cr, kernel); });
+}
+
+void rgbToLuma(const Pixel *pixels, size_t count, uint8_t *y)
+{
+    convertLuma<RGBLayout>(bytesOf(pixels), count, y, bestColorKernel());
+}
+
+void rgbToLuma(const Pixel *pixels, size_t count, uint8_t *y, ColorKernel kernel)
+{
+    convertLuma<RGBLayout>(bytesOf(pixels), count, y, kernel);
+}
+
+void rgbToLuma(const uint8_t *pixels, PixelFormat format, size_t count, uint8_t *y)
+{
+    rgbToLuma(pixels, format, count, y, bestColorKernel());
+}
+
+void rgbToLuma(const uint8_t *pixels, PixelFormat format, size_t count, uint8_t *y, ColorKernel kernel)
+{
+    withLayout(format, [&](auto layout)
+               { convertLuma<decltype(layout)>(pixels, count, y, kernel); });
+}
@@ -0,0 +1,100 @@
+#ifndef _COLORCONVERT_HPP_
+#define _COLORCONVERT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include "Image.hpp"
+#include "ImageView.hpp"
+
+using namespace std;
+
+/**
+ * @brief RGB -> YCbCr kernels (BT.601 full range, JFIF)
+ *
+ *   Every kernel uses the same 14-bit fixed-point coefficients, so the SIMD
+ *   versions give exactly the scalar result:
+ *     Y  = ( 4899 R + 9617 G + 1868 B + 2^13) >> 14
+ *     Cb = (-2764 R - 5428 G + 8192 B + 128 * 2^14 + 2^13) >> 14
+ *     Cr = ( 8192 R - 6860 G - 1332 B + 128 * 2^14 + 2^13) >> 14
+ *   clamped to 0..255. Packed Pixel data goes straight to planar buffers;
+ *   the uint8_t overloads read any PixelFormat in place.
+ */
+enum class ColorKernel
+{
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+/**
+ * @brief Best kernel this CPU can run (what rgbToYCbCr() uses)
+ */
+ColorKernel bestColorKernel();
+
+/**
+ * @brief Convert count pixels to three 8-bit planes
+ *
+ * @param pixels packed RGB input
+ * @param count number of pixels
+ * @param y, cb, cr count samples each
+ * @param kernel implementation, bestColorKernel() by default (falls back if unsupported)
+ */
+void rgbToYCbCr(const Pixel *pixels, size_t count, uint8_t *y, uint8_t *cb, uint8_t *cr);
+void rgbToYCbCr(const Pixel *pixels, size_t count, uint8_t *y, uint8_t *cb, uint8_t *cr, ColorKernel kernel);
+void rgbToYCbCr(const uint8_t *pixels, PixelFormat format, size_t count, uint8_t *y, uint8_t *cb, uint8_t *cr);
+void rgbToYCbCr(const uint8_t *pixels, PixelFormat format, size_t count, uint8_t *y, uint8_t *cb, uint8_t *cr, ColorKernel kernel);
+
+/**
+ * @brief Same conversion to int16 planes, level-shifted (sample - 128) for the integer DCT
+ */
+void rgbToYCbCr(const Pixel *pixels, size_t count, int16_t *y, int16_t *cb, int16_t *cr);
+void rgbToYCbCr(const Pixel *pixels, size_t count, int16_t *y, int16_t *cb, int16_t *cr, ColorKernel kernel);
+
+/**
+ * @brief Fused conversion + 4:2:0 downsampling of two scanlines
+ *   Y of both rows at full resolution; Cb and Cr once per 2x2 square, from the
+ *   sum of the fixed-point products (one rounding). An odd width gives a last
+ *   square one pixel wide, row1 = nullptr (last row of an odd height, or
+ *   every row for 4:2:2) squares one pixel high.
+ *
+ * @param row0, row1 width pixels each (row1 may be nullptr)
+ * @param y0, y1 width samples each (y1 unused without row1)
+ * @param cb, cr (width + 1) / 2 samples each
+ */
+void rgbToYCbCr420(const Pixel *row0, const Pixel *row1, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr);
+void rgbToYCbCr420(const Pixel *row0, const Pixel *row1, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr, ColorKernel kernel);
+void rgbToYCbCr420(const uint8_t *row0, const uint8_t *row1, PixelFormat format, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr);
+void rgbToYCbCr420(const uint8_t *row0, const uint8_t *row1, PixelFormat format, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr, ColorKernel kernel);
+
+/**
+ * @brief Fused conversion + 4:4:0 downsampling of two scanlines
+ *   Y of both rows; Cb and Cr once per vertical pair of pixels, from the sum
+ *   of the fixed-point products (one rounding, as rgbToYCbCr420()).
+ *   row1 = nullptr (last row of an odd height): chroma of row0 alone.
+ *
+ * @param row0, row1 width pixels each (row1 may be nullptr)
+ * @param y0, y1 width samples each (y1 unused without row1)
+ * @param cb, cr width samples each
+ */
+void rgbToYCbCr440(const Pixel *row0, const Pixel *row1, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr);
+void rgbToYCbCr440(const Pixel *row0, const Pixel *row1, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr, ColorKernel kernel);
+void rgbToYCbCr440(const uint8_t *row0, const uint8_t *row1, PixelFormat format, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr);
+void rgbToYCbCr440(const uint8_t *row0, const uint8_t *row1, PixelFormat format, size_t width,
+                   uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr, ColorKernel kernel);
+
+/**
+ * @brief Y plane only (grayscale output), same values as rgbToYCbCr()
+ */
+void rgbToLuma(const Pixel *pixels, size_t count, uint8_t *y);
+void rgbToLuma(const Pixel *pixels, size_t count, uint8_t *y, ColorKernel kernel);
+void rgbToLuma(const uint8_t *pixels, PixelFormat format, size_t count, uint8_t *y);
+void rgbToLuma(const uint8_t *pixels, PixelFormat format, size_t count, uint8_t *y, ColorKernel kernel);
+
+#endif
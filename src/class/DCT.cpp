@@ -0,0 +1,486 @@
+#include "DCT.hpp"
+#include <cmath>
+
+// 64 terms per coefficient, two cosines each
+void forwardDCTReference(const double in[64], double out[64])
+{
+    const double PI = std::acos(-1);
+    for (int u = 0; u < 8; ++u)
+    {
+        for (int v = 0; v < 8; ++v)
+        {
+            double sum = 0;
+            for (int y = 0; y < 8; ++y)
+                for (int x = 0; x < 8; ++x)
+                    sum += in[y * 8 + x] * std::cos((2 * y + 1) * u * PI / 16) * std::cos((2 * x + 1) * v * PI / 16);
+            double cu = (u == 0) ? (1.0 / std::sqrt(2)) : 1.0;
+            double cv = (v == 0) ? (1.0 / std::sqrt(2)) : 1.0;
+            out[u * 8 + v] = 0.25 * cu * cv * sum;
+        }
+    }
+}
+
+/**
+ * @brief Output scale of the AAN transform
+ *   AAN leaves coefficient (u,v) multiplied by 8 * s[u] * s[v],
+ *   with s[0] = 1 and s[k] = cos(k*PI/16) * sqrt(2).
+ *   We keep the inverse of that product for every coefficient.
+ */
+struct AANScale
+{
+    double factor[64];
+
+    AANScale()
+    {
+        const double PI = std::acos(-1);
+        double s[8];
+        s[0] = 1.0;
+        for (int k = 1; k < 8; ++k)
+        {
+            s[k] = std::cos(k * PI / 16) * std::sqrt(2.0);
+        }
+
+        for (int u = 0; u < 8; ++u)
+        {
+            for (int v = 0; v < 8; ++v)
+            {
+                factor[u * 8 + v] = 1.0 / (8.0 * s[u] * s[v]);
+            }
+        }
+    }
+};
+
+static const AANScale aanScale;
+
+/**
+ * @brief One 8-point AAN butterfly, applied in place on data[0], data[step], ..., data[7 * step]
+ */
+static inline void aan1D(double *data, int step)
+{
+    double tmp0 = data[0 * step] + data[7 * step];
+    double tmp7 = data[0 * step] - data[7 * step];
+    double tmp1 = data[1 * step] + data[6 * step];
+    double tmp6 = data[1 * step] - data[6 * step];
+    double tmp2 = data[2 * step] + data[5 * step];
+    double tmp5 = data[2 * step] - data[5 * step];
+    double tmp3 = data[3 * step] + data[4 * step];
+    double tmp4 = data[3 * step] - data[4 * step];
+
+    // Even part
+    double tmp10 = tmp0 + tmp3;
+    double tmp13 = tmp0 - tmp3;
+    double tmp11 = tmp1 + tmp2;
+    double tmp12 = tmp1 - tmp2;
+
+    data[0 * step] = tmp10 + tmp11;
+    data[4 * step] = tmp10 - tmp11;
+
+    double z1 = (tmp12 + tmp13) * 0.707106781186547524; // c4
+    data[2 * step] = tmp13 + z1;
+    data[6 * step] = tmp13 - z1;
+
+    // Odd part
+    tmp10 = tmp4 + tmp5;
+    tmp11 = tmp5 + tmp6;
+    tmp12 = tmp6 + tmp7;
+
+    double z5 = (tmp10 - tmp12) * 0.382683432365089772; // c6
+    double z2 = 0.541196100146196984 * tmp10 + z5;      // c2 - c6
+    double z4 = 1.306562964876376527 * tmp12 + z5;      // c2 + c6
+    double z3 = tmp11 * 0.707106781186547524;           // c4
+
+    double z11 = tmp7 + z3;
+    double z13 = tmp7 - z3;
+
+    data[5 * step] = z13 + z2;
+    data[3 * step] = z13 - z2;
+    data[1 * step] = z11 + z4;
+    data[7 * step] = z11 - z4;
+}
+
+// aan1D() on the rows, then the columns, then the AAN scale is removed
+void forwardDCTFast(const double in[64], double out[64])
+{
+    double data[64];
+    for (int i = 0; i < 64; ++i)
+    {
+        data[i] = in[i];
+    }
+
+    // Pass 1: rows
+    for (int y = 0; y < 8; ++y)
+    {
+        aan1D(data + y * 8, 1);
+    }
+
+    // Pass 2: columns
+    for (int x = 0; x < 8; ++x)
+    {
+        aan1D(data + x, 8);
+    }
+
+    // Remove the AAN scale so the output matches the reference transform
+    for (int i = 0; i < 64; ++i)
+    {
+        out[i] = data[i] * aanScale.factor[i];
+    }
+}
+
+/*
+ * Integer engine
+ *   Fixed-point version of the Loeffler/Ligtenberg/Moschytz transform used by
+ *   libjpeg's "islow" DCT: 13 fractional bits for the constants, 2 extra bits
+ *   kept between the row and column passes. The output is 8 times the reference
+ *   DCT, which quantization folds into its divisor.
+ */
+
+#define CONST_BITS 13
+#define PASS1_BITS 2
+
+static const int32_t FIX_0_298631336 = 2446;
+static const int32_t FIX_0_390180644 = 3196;
+static const int32_t FIX_0_541196100 = 4433;
+static const int32_t FIX_0_765366865 = 6270;
+static const int32_t FIX_0_899976223 = 7373;
+static const int32_t FIX_1_175875602 = 9633;
+static const int32_t FIX_1_501321110 = 12299;
+static const int32_t FIX_1_847759065 = 15137;
+static const int32_t FIX_1_961570560 = 16069;
+static const int32_t FIX_2_053119869 = 16819;
+static const int32_t FIX_2_562915447 = 20995;
+static const int32_t FIX_3_072711026 = 25172;
+
+static inline int32_t descale(int32_t x, int n)
+{
+    return (x + (1 << (n - 1))) >> n;
+}
+
+/**
+ * @brief One 8-point islow pass on data[0], data[step], ..., data[7 * step]
+ *
+ * @param firstPass true for the row pass (keeps PASS1_BITS of extra precision)
+ */
+static inline void islow1D(int32_t *data, int step, bool firstPass)
+{
+    int32_t tmp0 = data[0 * step] + data[7 * step];
+    int32_t tmp7 = data[0 * step] - data[7 * step];
+    int32_t tmp1 = data[1 * step] + data[6 * step];
+    int32_t tmp6 = data[1 * step] - data[6 * step];
+    int32_t tmp2 = data[2 * step] + data[5 * step];
+    int32_t tmp5 = data[2 * step] - data[5 * step];
+    int32_t tmp3 = data[3 * step] + data[4 * step];
+    int32_t tmp4 = data[3 * step] - data[4 * step];
+
+    const int shift = firstPass ? CONST_BITS - PASS1_BITS : CONST_BITS + PASS1_BITS;
+
+    // Even part
+    int32_t tmp10 = tmp0 + tmp3;
+    int32_t tmp13 = tmp0 - tmp3;
+    int32_t tmp11 = tmp1 + tmp2;
+    int32_t tmp12 = tmp1 - tmp2;
+
+    if (firstPass)
+    {
+        data[0 * step] = (tmp10 + tmp11) * (1 << PASS1_BITS);
+        data[4 * step] = (tmp10 - tmp11) * (1 << PASS1_BITS);
+    }
+    else
+    {
+        data[0 * step] = descale(tmp10 + tmp11, PASS1_BITS);
+        data[4 * step] = descale(tmp10 - tmp11, PASS1_BITS);
+    }
+
+    int32_t z1 = (tmp12 + tmp13) * FIX_0_541196100;
+    data[2 * step] = descale(z1 + tmp13 * FIX_0_765366865, shift);
+    data[6 * step] = descale(z1 - tmp12 * FIX_1_847759065, shift);
+
+    // Odd part
+    z1 = tmp4 + tmp7;
+    int32_t z2 = tmp5 + tmp6;
+    int32_t z3 = tmp4 + tmp6;
+    int32_t z4 = tmp5 + tmp7;
+    int32_t z5 = (z3 + z4) * FIX_1_175875602;
+
+    tmp4 *= FIX_0_298631336;
+    tmp5 *= FIX_2_053119869;
+    tmp6 *= FIX_3_072711026;
+    tmp7 *= FIX_1_501321110;
+    z1 *= -FIX_0_899976223;
+    z2 *= -FIX_2_562915447;
+    z3 *= -FIX_1_961570560;
+    z4 *= -FIX_0_390180644;
+
+    z3 += z5;
+    z4 += z5;
+
+    data[7 * step] = descale(tmp4 + z1 + z3, shift);
+    data[5 * step] = descale(tmp5 + z2 + z4, shift);
+    data[3 * step] = descale(tmp6 + z2 + z3, shift);
+    data[1 * step] = descale(tmp7 + z1 + z4, shift);
+}
+
+/**
+ * @brief Round-half-away-from-zero division of a scaled coefficient
+ *   The float reciprocal gives the quotient within one unit, the two
+ *   integer checks that follow make it exact.
+ *
+ * @param divisor quantization step times 8 (the islow output scale)
+ * @param reciprocal 1 / divisor
+ */
+static inline int16_t quantizeScaled(int32_t value, int32_t divisor, float reciprocal)
+{
+    int32_t n = (value < 0 ? -value : value) + (divisor >> 1);
+    int32_t q = static_cast<int32_t>(n * reciprocal);
+    if (q * divisor > n)
+    {
+        q--;
+    }
+    else if ((q + 1) * divisor <= n)
+    {
+        q++;
+    }
+    return static_cast<int16_t>(value < 0 ? -q : q);
+}
+
+void forwardDCTQuantizeIntegerScalar(const int16_t *samples, int16_t *out, size_t count, const QuantizationTable &table)
+{
+    for (size_t b = 0; b < count; ++b)
+    {
+        int32_t data[64];
+        for (int i = 0; i < 64; ++i)
+        {
+            data[i] = samples[b * 64 + i];
+        }
+
+        for (int y = 0; y < 8; ++y)
+        {
+            islow1D(data + y * 8, 1, true);
+        }
+        for (int x = 0; x < 8; ++x)
+        {
+            islow1D(data + x, 8, false);
+        }
+
+        for (int i = 0; i < 64; ++i)
+        {
+            out[b * 64 + i] = quantizeScaled(data[i], table.divisors[i], table.divisorReciprocals[i]);
+        }
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JPEG_HAVE_AVX2_KERNEL 1
+#include <immintrin.h>
+
+/**
+ * @brief Transpose an 8x8 matrix of int32 held in 8 registers
+ */
+__attribute__((target("avx2"))) static inline void transpose8x8(__m256i r[8])
+{
+    __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+    __m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+    __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+    __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+    __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+    __m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+    __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+    __m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+template <int SHIFT>
+__attribute__((target("avx2"))) static inline __m256i descaleAVX2(__m256i x)
+{
+    return _mm256_srai_epi32(_mm256_add_epi32(x, _mm256_set1_epi32(1 << (SHIFT - 1))), SHIFT);
+}
+
+__attribute__((target("avx2"))) static inline __m256i mulConst(__m256i x, int32_t c)
+{
+    return _mm256_mullo_epi32(x, _mm256_set1_epi32(c));
+}
+
+/**
+ * @brief islow1D on 8 blocks at once, lane i of every register belongs to block i
+ */
+template <bool FIRST_PASS>
+__attribute__((target("avx2"))) static inline void islow1DAVX2(__m256i d[8])
+{
+    const int SHIFT = FIRST_PASS ? CONST_BITS - PASS1_BITS : CONST_BITS + PASS1_BITS;
+
+    __m256i tmp0 = _mm256_add_epi32(d[0], d[7]);
+    __m256i tmp7 = _mm256_sub_epi32(d[0], d[7]);
+    __m256i tmp1 = _mm256_add_epi32(d[1], d[6]);
+    __m256i tmp6 = _mm256_sub_epi32(d[1], d[6]);
+    __m256i tmp2 = _mm256_add_epi32(d[2], d[5]);
+    __m256i tmp5 = _mm256_sub_epi32(d[2], d[5]);
+    __m256i tmp3 = _mm256_add_epi32(d[3], d[4]);
+    __m256i tmp4 = _mm256_sub_epi32(d[3], d[4]);
+
+    // Even part
+    __m256i tmp10 = _mm256_add_epi32(tmp0, tmp3);
+    __m256i tmp13 = _mm256_sub_epi32(tmp0, tmp3);
+    __m256i tmp11 = _mm256_add_epi32(tmp1, tmp2);
+    __m256i tmp12 = _mm256_sub_epi32(tmp1, tmp2);
+
+    if (FIRST_PASS)
+    {
+        d[0] = _mm256_slli_epi32(_mm256_add_epi32(tmp10, tmp11), PASS1_BITS);
+        d[4] = _mm256_slli_epi32(_mm256_sub_epi32(tmp10, tmp11), PASS1_BITS);
+    }
+    else
+    {
+        d[0] = descaleAVX2<PASS1_BITS>(_mm256_add_epi32(tmp10, tmp11));
+        d[4] = descaleAVX2<PASS1_BITS>(_mm256_sub_epi32(tmp10, tmp11));
+    }
+
+    __m256i z1 = mulConst(_mm256_add_epi32(tmp12, tmp13), FIX_0_541196100);
+    d[2] = descaleAVX2<SHIFT>(_mm256_add_epi32(z1, mulConst(tmp13, FIX_0_765366865)));
+    d[6] = descaleAVX2<SHIFT>(_mm256_sub_epi32(z1, mulConst(tmp12, FIX_1_847759065)));
+
+    // Odd part
+    z1 = _mm256_add_epi32(tmp4, tmp7);
+    __m256i z2 = _mm256_add_epi32(tmp5, tmp6);
+    __m256i z3 = _mm256_add_epi32(tmp4, tmp6);
+    __m256i z4 = _mm256_add_epi32(tmp5, tmp7);
+    __m256i z5 = mulConst(_mm256_add_epi32(z3, z4), FIX_1_175875602);
+
+    tmp4 = mulConst(tmp4, FIX_0_298631336);
+    tmp5 = mulConst(tmp5, FIX_2_053119869);
+    tmp6 = mulConst(tmp6, FIX_3_072711026);
+    tmp7 = mulConst(tmp7, FIX_1_501321110);
+    z1 = mulConst(z1, -FIX_0_899976223);
+    z2 = mulConst(z2, -FIX_2_562915447);
+    z3 = mulConst(z3, -FIX_1_961570560);
+    z4 = mulConst(z4, -FIX_0_390180644);
+
+    z3 = _mm256_add_epi32(z3, z5);
+    z4 = _mm256_add_epi32(z4, z5);
+
+    d[7] = descaleAVX2<SHIFT>(_mm256_add_epi32(_mm256_add_epi32(tmp4, z1), z3));
+    d[5] = descaleAVX2<SHIFT>(_mm256_add_epi32(_mm256_add_epi32(tmp5, z2), z4));
+    d[3] = descaleAVX2<SHIFT>(_mm256_add_epi32(_mm256_add_epi32(tmp6, z2), z3));
+    d[1] = descaleAVX2<SHIFT>(_mm256_add_epi32(_mm256_add_epi32(tmp7, z1), z4));
+}
+
+/**
+ * @brief Same rounding as quantizeScaled() for 8 coefficients
+ *   The float reciprocal gives the quotient within one unit, the two
+ *   integer checks that follow make it exact.
+ */
+__attribute__((target("avx2"))) static inline __m256i quantizeAVX2(__m256i value, int32_t divisor, float reciprocal)
+{
+    const __m256i div = _mm256_set1_epi32(divisor);
+    __m256i n = _mm256_add_epi32(_mm256_abs_epi32(value), _mm256_set1_epi32(divisor >> 1));
+    __m256i q = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(n), _mm256_set1_ps(reciprocal)));
+
+    // q * divisor > n  =>  q is one too big
+    q = _mm256_add_epi32(q, _mm256_cmpgt_epi32(_mm256_mullo_epi32(q, div), n));
+    // (q + 1) * divisor <= n  =>  q is one too small
+    __m256i next = _mm256_add_epi32(_mm256_mullo_epi32(q, div), div);
+    q = _mm256_sub_epi32(q, _mm256_cmpgt_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(1)), next));
+
+    return _mm256_sign_epi32(q, value);
+}
+
+/**
+ * @brief DCT + quantization of exactly 8 blocks
+ *   Rows of the 8 blocks are transposed so that each register holds the same
+ *   sample position for all 8 blocks; both passes are then plain vertical SIMD.
+ */
+__attribute__((target("avx2"))) static void forwardDCTQuantize8AVX2(const int16_t *samples, int16_t *out,
+                                                                    const int32_t divisors[64], const float reciprocals[64])
+{
+    __m256i ws[64];
+    __m256i v[8];
+
+    // Pass 1: rows
+    for (int r = 0; r < 8; ++r)
+    {
+        for (int b = 0; b < 8; ++b)
+        {
+            v[b] = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(samples + b * 64 + r * 8)));
+        }
+        transpose8x8(v);
+        islow1DAVX2<true>(v);
+        for (int k = 0; k < 8; ++k)
+        {
+            ws[r * 8 + k] = v[k];
+        }
+    }
+
+    // Pass 2: columns, then quantization
+    for (int c = 0; c < 8; ++c)
+    {
+        for (int k = 0; k < 8; ++k)
+        {
+            v[k] = ws[k * 8 + c];
+        }
+        islow1DAVX2<false>(v);
+        for (int u = 0; u < 8; ++u)
+        {
+            ws[u * 8 + c] = quantizeAVX2(v[u], divisors[u * 8 + c], reciprocals[u * 8 + c]);
+        }
+    }
+
+    // Back to one row per block, packed to int16
+    for (int u = 0; u < 8; ++u)
+    {
+        for (int c = 0; c < 8; ++c)
+        {
+            v[c] = ws[u * 8 + c];
+        }
+        transpose8x8(v);
+        for (int b = 0; b < 8; b += 2)
+        {
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(v[b], v[b + 1]), 0xD8);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + b * 64 + u * 8), _mm256_castsi256_si128(packed));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + (b + 1) * 64 + u * 8), _mm256_extracti128_si256(packed, 1));
+        }
+    }
+}
+#endif
+
+bool hasAVX2DCT()
+{
+#ifdef JPEG_HAVE_AVX2_KERNEL
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+void forwardDCTQuantizeInteger(const int16_t *samples, int16_t *out, size_t count, const QuantizationTable &table)
+{
+    size_t done = 0;
+
+#ifdef JPEG_HAVE_AVX2_KERNEL
+    if (hasAVX2DCT() && count >= 8)
+    {
+        for (; done + 8 <= count; done += 8)
+        {
+            forwardDCTQuantize8AVX2(samples + done * 64, out + done * 64, table.divisors, table.divisorReciprocals);
+        }
+    }
+#endif
+
+    // Remaining blocks (or everything without AVX2)
+    forwardDCTQuantizeIntegerScalar(samples + done * 64, out + done * 64, count - done, table);
+}
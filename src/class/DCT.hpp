@@ -0,0 +1,63 @@
+#ifndef _DCT_HPP_
+#define _DCT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include "Quantization.hpp"
+
+using namespace std;
+
+/**
+ * @brief Forward DCT engines available to the compressor
+ *
+ *   Reference : direct O(n^4) formula, two cosines per term (slow, exact)
+ *   Fast      : separable AAN row/column transform with precomputed scale factors
+ *   Integer   : fixed-point transform (libjpeg "islow" accuracy) fused with quantization,
+ *               8 blocks per pass with AVX2 when the CPU has it
+ */
+enum class DCTMode
+{
+    Reference,
+    Fast,
+    Integer
+};
+
+/**
+ * @brief Reference 8x8 forward DCT, straight from the JPEG definition
+ *
+ * @param in 64 level-shifted samples (row major)
+ * @param out 64 DCT coefficients (row major, out[u * 8 + v])
+ */
+void forwardDCTReference(const double in[64], double out[64]);
+
+/**
+ * @brief Fast 8x8 forward DCT (Arai, Agui & Nakajima), same output scale as the reference
+ *
+ * @param in 64 level-shifted samples (row major)
+ * @param out 64 DCT coefficients (row major, out[u * 8 + v])
+ */
+void forwardDCTFast(const double in[64], double out[64]);
+
+/**
+ * @brief Integer DCT + quantization of a run of blocks
+ *   Uses the AVX2 kernel (8 blocks per pass) when available, the scalar one otherwise.
+ *   Rounding matches std::round(coefficient / table) of the floating point path.
+ *
+ * @param samples count blocks of 64 level-shifted samples (row major)
+ * @param out count blocks of 64 quantized coefficients (row major)
+ * @param count number of blocks
+ * @param table quantization table (divisors and their reciprocals)
+ */
+void forwardDCTQuantizeInteger(const int16_t *samples, int16_t *out, size_t count, const QuantizationTable &table);
+
+/**
+ * @brief Portable version of forwardDCTQuantizeInteger, one block at a time
+ */
+void forwardDCTQuantizeIntegerScalar(const int16_t *samples, int16_t *out, size_t count, const QuantizationTable &table);
+
+/**
+ * @brief true when the AVX2 integer kernel can run on this CPU
+ */
+bool hasAVX2DCT();
+
+#endif
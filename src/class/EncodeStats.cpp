@@ -0,0 +1,123 @@
+#include "EncodeStats.hpp"
+#include <iomanip>
+#include <sstream>
+
+void EncodeStats::reset()
+{
+    *this = EncodeStats();
+}
+
+const char *EncodeStats::stageName(EncodeStage stage)
+{
+    switch (stage)
+    {
+    case EncodeStage::Convert:
+        return "convert";
+    case EncodeStage::Split:
+        return "split";
+    case EncodeStage::Transform:
+        return "transform";
+    case EncodeStage::Quantize:
+        return "quantize";
+    case EncodeStage::HuffmanTables:
+        return "huffmanTables";
+    case EncodeStage::Entropy:
+        return "entropy";
+    default:
+        return "unknown";
+    }
+}
+
+double EncodeStats::totalSeconds() const
+{
+    double total = 0;
+    for (double seconds : stageSeconds)
+    {
+        total += seconds;
+    }
+    return total;
+}
+
+uint64_t EncodeStats::totalBlocks() const
+{
+    uint64_t blocks = 0;
+    for (const ComponentStats &component : components)
+    {
+        blocks += component.blocks;
+    }
+    return blocks;
+}
+
+double EncodeStats::zeroACFraction() const
+{
+    uint64_t zero = 0;
+    for (const ComponentStats &component : components)
+    {
+        zero += component.zeroACBlocks;
+    }
+    uint64_t blocks = totalBlocks();
+    return blocks > 0 ? static_cast<double>(zero) / blocks : 0;
+}
+
+double EncodeStats::averageNonzeroCoefficients() const
+{
+    uint64_t nonzero = 0;
+    for (const ComponentStats &component : components)
+    {
+        nonzero += component.nonzeroCoefficients;
+    }
+    uint64_t blocks = totalBlocks();
+    return blocks > 0 ? static_cast<double>(nonzero) / blocks : 0;
+}
+
+void EncodeStats::writeJSON(ostream &out) const
+{
+    static const char *names[3] = {"Y", "Cb", "Cr"};
+
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+    out << std::setprecision(6);
+
+    out << "{\"width\":" << width << ",\"height\":" << height
+        << ",\"components\":" << componentCount << ",\"subsampling\":\"" << subsampling << "\""
+        << ",\"quality\":" << quality << ",\"progressive\":" << (progressive ? "true" : "false");
+
+    out << ",\"stageSeconds\":{";
+    for (int s = 0; s < static_cast<int>(EncodeStage::Count); ++s)
+    {
+        out << (s > 0 ? "," : "") << "\"" << stageName(static_cast<EncodeStage>(s)) << "\":" << stageSeconds[s];
+    }
+    out << ",\"total\":" << totalSeconds() << "}";
+
+    out << ",\"bytes\":{\"header\":" << headerBytes << ",\"entropy\":" << entropyBytes
+        << ",\"total\":" << headerBytes + entropyBytes << "}";
+
+    out << ",\"blocks\":" << totalBlocks() << ",\"zeroACFraction\":" << zeroACFraction()
+        << ",\"averageNonzeroCoefficients\":" << averageNonzeroCoefficients()
+        << ",\"flatBlocks\":" << flatBlocks << ",\"repeatedBlocks\":" << repeatedBlocks;
+
+    out << ",\"componentStats\":[";
+    for (int c = 0; c < componentCount && c < 3; ++c)
+    {
+        const ComponentStats &component = components[c];
+        double blocks = component.blocks > 0 ? static_cast<double>(component.blocks) : 1;
+        out << (c > 0 ? "," : "") << "{\"component\":\"" << names[c] << "\""
+            << ",\"blocks\":" << component.blocks
+            << ",\"zeroACBlocks\":" << component.zeroACBlocks
+            << ",\"zeroACFraction\":" << component.zeroACBlocks / blocks
+            << ",\"averageNonzeroCoefficients\":" << component.nonzeroCoefficients / blocks
+            << ",\"dcBits\":" << component.dcBits
+            << ",\"acBits\":" << component.acBits << "}";
+    }
+    out << "]}";
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+string EncodeStats::toJSON() const
+{
+    ostringstream out;
+    writeJSON(out);
+    return out.str();
+}
@@ -0,0 +1,126 @@
+#ifndef _ENCODESTATS_HPP_
+#define _ENCODESTATS_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+using namespace std;
+
+/**
+ * @brief Timed parts of an encode
+ */
+enum class EncodeStage
+{
+    Convert,       // colour conversion and chroma subsampling
+    Split,         // 8x8 blocks
+    Transform,     // DCT (and quantization with the integer engine)
+    Quantize,
+    HuffmanTables, // table choice (statistics pass when optimizing)
+    Entropy,       // entropy coding and output, headers included
+    Count
+};
+
+/**
+ * @brief Figures of one component
+ *   dcBits / acBits: Huffman codes and magnitude bits, byte stuffing and
+ *   padding excluded. Progressive files: bits of the scans of the
+ *   component, stuffing included; a DC scan of several components is
+ *   shared between them by block count.
+ */
+struct ComponentStats
+{
+    uint64_t blocks = 0;
+    uint64_t zeroACBlocks = 0;        // every AC coefficient quantized to 0
+    uint64_t nonzeroCoefficients = 0; // DC included
+    uint64_t dcBits = 0;
+    uint64_t acBits = 0;
+};
+
+/**
+ * @brief Statistics of an encode, filled when given to JPEGCompressor::setStats()
+ *   compress() resets them and times its stages, encode() adds the entropy
+ *   coding and the byte counts; encodeStreaming() does everything at once.
+ */
+struct EncodeStats
+{
+    int width = 0;
+    int height = 0;
+    int componentCount = 0;
+    int quality = 0;
+    bool progressive = false;
+    string subsampling;
+
+    double stageSeconds[static_cast<int>(EncodeStage::Count)] = {};
+    ComponentStats components[3];
+
+    uint64_t headerBytes = 0;  // markers and tables
+    uint64_t entropyBytes = 0; // entropy coded data, RSTn markers included
+
+    // Block memoization (JPEGCompressor::setBlockMemoization())
+    uint64_t flatBlocks = 0;     // uniform, DC computed directly
+    uint64_t repeatedBlocks = 0; // copied from an identical earlier block
+
+    void reset();
+
+    double totalSeconds() const;
+    uint64_t totalBlocks() const;
+
+    /**
+     * @brief Share of the blocks whose AC coefficients all quantized to 0
+     */
+    double zeroACFraction() const;
+    double averageNonzeroCoefficients() const;
+
+    void writeJSON(ostream &out) const;
+    string toJSON() const;
+
+    static const char *stageName(EncodeStage stage);
+};
+
+/**
+ * @brief Adds the lifetime of the object (or up to stop()) to one stage of
+ *   stats; nothing at all, not even a clock read, when stats is nullptr
+ */
+class StageTimer
+{
+public:
+    StageTimer(EncodeStats *stats, EncodeStage stage)
+        : stats(stats), stage(stage)
+    {
+        if (stats != nullptr)
+        {
+            start = chrono::steady_clock::now();
+        }
+    }
+
+    ~StageTimer()
+    {
+        stop();
+    }
+
+    /**
+     * @brief End the stage before the end of the scope
+     */
+    void stop()
+    {
+        if (stats != nullptr)
+        {
+            stats->stageSeconds[static_cast<int>(stage)] +=
+                chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            stats = nullptr;
+        }
+    }
+
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+private:
+    EncodeStats *stats;
+    EncodeStage stage;
+    chrono::steady_clock::time_point start;
+};
+
+#endif
@@ -0,0 +1,291 @@
+#include "Huffman.hpp"
+#include <climits>
+#include <cstring>
+
+// Annex K example Huffman tables (bits per code length, then symbols)
+static const uint8_t bits_dc_luminance[16] = {
+    0x00, // 1-bit codes:   0
+    0x01, // 2-bit codes:   1
+    0x05, // 3-bit codes:   5
+    0x01, // 4-bit codes:   1
+    0x01, // 5-bit codes:   1
+    0x01, // 6-bit codes:   1
+    0x01, // 7-bit codes:   1
+    0x01, // 8-bit codes:   1
+    0x01, // 9-bit codes:   1
+    0x00, // 10-bit codes:  0
+    0x00, // 11-bit codes:  0
+    0x00, // 12-bit codes:  0
+    0x00, // 13-bit codes:  0
+    0x00, // 14-bit codes:  0
+    0x00, // 15-bit codes:  0
+    0x00  // 16-bit codes:  0
+};
+static const uint8_t val_dc_luminance[12] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static const uint8_t bits_ac_luminance[16] = {
+    0x00, 0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03,
+    0x05, 0x05, 0x04, 0x04, 0x00, 0x00, 0x01, 0x7D};
+static const uint8_t val_ac_luminance[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+    0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08,
+    0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16,
+    0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+    0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+    0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+    0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+    0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6,
+    0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+    0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4,
+    0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+    0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA,
+    0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA};
+
+static const uint8_t bits_dc_chrominance[16] = {
+    0x00, 0x03, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00};
+static const uint8_t val_dc_chrominance[12] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static const uint8_t bits_ac_chrominance[16] = {
+    0x00, 0x02, 0x01, 0x02, 0x04, 0x04, 0x03, 0x04,
+    0x07, 0x05, 0x04, 0x04, 0x00, 0x01, 0x02, 0x77};
+static const uint8_t val_ac_chrominance[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+    0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+    0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+    0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34,
+    0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+    0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38,
+    0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+    0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96,
+    0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+    0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4,
+    0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+    0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2,
+    0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+    0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9,
+    0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA};
+
+static HuffmanTable makeTable(const uint8_t bits[16], const uint8_t huffval[], int count)
+{
+    HuffmanTable table = {};
+    std::memcpy(table.bits, bits, 16);
+    std::memcpy(table.huffval, huffval, count);
+    table.count = count;
+    return table;
+}
+
+const HuffmanTable &standardDCLuminanceTable()
+{
+    static const HuffmanTable table = makeTable(bits_dc_luminance, val_dc_luminance, 12);
+    return table;
+}
+
+const HuffmanTable &standardACLuminanceTable()
+{
+    static const HuffmanTable table = makeTable(bits_ac_luminance, val_ac_luminance, 162);
+    return table;
+}
+
+const HuffmanTable &standardDCChrominanceTable()
+{
+    static const HuffmanTable table = makeTable(bits_dc_chrominance, val_dc_chrominance, 12);
+    return table;
+}
+
+const HuffmanTable &standardACChrominanceTable()
+{
+    static const HuffmanTable table = makeTable(bits_ac_chrominance, val_ac_chrominance, 162);
+    return table;
+}
+
+void HuffmanStatistics::clear()
+{
+    std::memset(this, 0, sizeof(*this));
+}
+
+void HuffmanStatistics::add(const HuffmanStatistics &other)
+{
+    for (int i = 0; i < 256; ++i)
+    {
+        dcLuma[i] += other.dcLuma[i];
+        acLuma[i] += other.acLuma[i];
+        dcChroma[i] += other.dcChroma[i];
+        acChroma[i] += other.acChroma[i];
+    }
+}
+
+// Build a map from symbol→(code,length)
+void buildHuffmanCodes(const uint8_t bits[16],
+                       const uint8_t huffval[],
+                       int valCount,
+                       HuffmanCode outCodes[256])
+{
+    // JPEG canonical algorithm:
+    // 1) For each bit-length L = 1..16, there are bits[L-1] codes.
+    // 2) Starting with code = 0, assign codes in ascending order of symbol
+    uint16_t code = 0;
+    int idx = 0;
+    for (int L = 1; L <= 16; ++L)
+    {
+        for (int i = 0; i < bits[L - 1] && idx < valCount; ++i)
+        {
+            uint8_t symbol = huffval[idx++];
+            outCodes[symbol] = {code, (uint8_t)L};
+            ++code;
+        }
+        code <<= 1;
+    }
+}
+
+void buildHuffmanCodes(const HuffmanTable &table, HuffmanCode outCodes[256])
+{
+    buildHuffmanCodes(table.bits, table.huffval, table.count, outCodes);
+}
+
+void buildOptimalHuffmanTable(const uint32_t frequencies[256], HuffmanTable &table)
+{
+    const int MAX_CODE_LENGTH = 32;
+
+    // One extra symbol (256) with frequency 1 reserves the all-ones code
+    long freq[257];
+    int codesize[257];
+    int others[257];
+    for (int i = 0; i < 256; ++i)
+    {
+        freq[i] = frequencies[i];
+    }
+    freq[256] = 1;
+    for (int i = 0; i < 257; ++i)
+    {
+        codesize[i] = 0;
+        others[i] = -1;
+    }
+
+    // Huffman's algorithm: repeatedly merge the two least frequent trees
+    while (true)
+    {
+        // c1 = smallest nonzero frequency (largest symbol on ties)
+        int c1 = -1;
+        long v = LONG_MAX;
+        for (int i = 0; i <= 256; ++i)
+        {
+            if (freq[i] && freq[i] <= v)
+            {
+                v = freq[i];
+                c1 = i;
+            }
+        }
+
+        // c2 = next smallest (merged trees can pass 1e9, hence LONG_MAX too)
+        int c2 = -1;
+        v = LONG_MAX;
+        for (int i = 0; i <= 256; ++i)
+        {
+            if (freq[i] && freq[i] <= v && i != c1)
+            {
+                v = freq[i];
+                c2 = i;
+            }
+        }
+
+        // Only one tree left
+        if (c2 < 0)
+        {
+            break;
+        }
+
+        freq[c1] += freq[c2];
+        freq[c2] = 0;
+
+        // Every symbol of both trees gets one bit longer
+        codesize[c1]++;
+        while (others[c1] >= 0)
+        {
+            c1 = others[c1];
+            codesize[c1]++;
+        }
+        others[c1] = c2;
+
+        codesize[c2]++;
+        while (others[c2] >= 0)
+        {
+            c2 = others[c2];
+            codesize[c2]++;
+        }
+    }
+
+    // Number of codes of each length
+    int bits[MAX_CODE_LENGTH + 1] = {};
+    for (int i = 0; i <= 256; ++i)
+    {
+        if (codesize[i])
+        {
+            bits[codesize[i]]++;
+        }
+    }
+
+    // Limit lengths to 16 bits (Annex K.3): move pairs of long codes up the tree
+    for (int i = MAX_CODE_LENGTH; i > 16; --i)
+    {
+        while (bits[i] > 0)
+        {
+            int j = i - 2;
+            while (bits[j] == 0)
+            {
+                j--;
+            }
+            bits[i] -= 2;
+            bits[i - 1]++;
+            bits[j + 1] += 2;
+            bits[j]--;
+        }
+    }
+
+    // Drop the reserved symbol (it has the longest code)
+    int longest = 16;
+    while (longest > 0 && bits[longest] == 0)
+    {
+        longest--;
+    }
+    if (longest > 0)
+    {
+        bits[longest]--;
+    }
+
+    table = {};
+    for (int L = 1; L <= 16; ++L)
+    {
+        table.bits[L - 1] = static_cast<uint8_t>(bits[L]);
+    }
+
+    // Symbols sorted by code length (then by value)
+    int p = 0;
+    for (int L = 1; L <= MAX_CODE_LENGTH; ++L)
+    {
+        for (int symbol = 0; symbol < 256; ++symbol)
+        {
+            if (codesize[symbol] == L)
+            {
+                table.huffval[p++] = static_cast<uint8_t>(symbol);
+            }
+        }
+    }
+    table.count = p;
+}
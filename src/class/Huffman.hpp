@@ -0,0 +1,66 @@
+#ifndef _HUFFMAN_HPP_
+#define _HUFFMAN_HPP_
+
+#include <cstdint>
+
+using namespace std;
+
+// A helper struct:
+struct HuffmanCode
+{
+    uint16_t code; // left-aligned bits
+    uint8_t length;
+};
+
+/**
+ * @brief Huffman table as stored in a DHT segment
+ *   bits[L - 1] codes of length L, then the symbols in code order
+ */
+struct HuffmanTable
+{
+    uint8_t bits[16];
+    uint8_t huffval[256];
+    int count; // number of symbols
+};
+
+/**
+ * @brief Symbol frequencies of the four table classes used by the encoder
+ */
+struct HuffmanStatistics
+{
+    uint32_t dcLuma[256];
+    uint32_t acLuma[256];
+    uint32_t dcChroma[256];
+    uint32_t acChroma[256];
+
+    void clear();
+    void add(const HuffmanStatistics &other);
+};
+
+/**
+ * @brief Build a map from symbol→(code,length)
+ */
+void buildHuffmanCodes(const uint8_t bits[16],
+                       const uint8_t huffval[],
+                       int valCount,
+                       HuffmanCode outCodes[256]);
+void buildHuffmanCodes(const HuffmanTable &table, HuffmanCode outCodes[256]);
+
+/**
+ * @brief Build a length-limited (16 bits) table from symbol frequencies (JPEG Annex K.2)
+ *   Symbols with a zero frequency get no code. The all-ones code stays unused.
+ *
+ * @param freq frequency of every symbol
+ * @param table receives the table
+ */
+void buildOptimalHuffmanTable(const uint32_t freq[256], HuffmanTable &table);
+
+/**
+ * @brief Annex K example tables
+ */
+const HuffmanTable &standardDCLuminanceTable();
+const HuffmanTable &standardACLuminanceTable();
+const HuffmanTable &standardDCChrominanceTable();
+const HuffmanTable &standardACChrominanceTable();
+
+#endif
@@ -40,9 +40,20 @@ vector<Pixel> &Image::getPixels()
     return this->pixels;
 }
 
+/**
+ * @brief Get the Pixel data, viewed or owned
+ *
+ * @return const Pixel*
+ */
+const Pixel *Image::getPixelData() const
+{
+    return this->pixelView != nullptr ? this->pixelView : this->pixels.data();
+}
+
 void Image::setPixels(const vector<Pixel> &pixels)
 {
     this->pixels = pixels;
+    this->pixelView = nullptr;
 }
 
 void Image::setSize(int width, int height)
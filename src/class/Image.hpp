@@ -40,6 +40,13 @@ protected:
      */
     vector<Pixel> pixels;
 
+    /**
+     * @brief Pixels owned by someone else (e.g. a mapped file), nullptr when
+     *   the image uses its own vector
+     *
+     */
+    const Pixel *pixelView = nullptr;
+
 public:
     /**
      * @brief Destroy the Image object
@@ -94,7 +101,15 @@ public:
     vector<Pixel> &getPixels();
 
     /**
-     * @brief Set the Pixels object
+     * @brief Get the Pixel data, width * height pixels row by row, wherever they are
+     *   (the vector of getPixels() stays empty for an image viewing its pixels)
+     *
+     * @return const Pixel*
+     */
+    const Pixel *getPixelData() const;
+
+    /**
+     * @brief Set the Pixels object (the image stops viewing external pixels)
      *
      */
     void setPixels(const vector<Pixel> &pixels);
@@ -0,0 +1,69 @@
+#ifndef _IMAGEVIEW_HPP_
+#define _IMAGEVIEW_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include "Image.hpp"
+
+using namespace std;
+
+/**
+ * @brief Byte order of an interleaved 8-bit pixel (alpha is ignored)
+ */
+enum class PixelFormat
+{
+    RGB,
+    BGR,
+    RGBA,
+    BGRA
+};
+
+/**
+ * @brief Bytes per pixel of a format
+ */
+inline int bytesPerPixel(PixelFormat format)
+{
+    return format == PixelFormat::RGB || format == PixelFormat::BGR ? 3 : 4;
+}
+
+/**
+ * @brief Non-owning view of interleaved pixels
+ *   Rows are stride bytes apart (stride >= width * bytesPerPixel(format)), so
+ *   a sub-rectangle or a padded frame buffer can be read in place. The
+ *   memory belongs to the caller and must outlive every user of the view.
+ */
+struct ImageView
+{
+    const uint8_t *data = nullptr;
+    int width = 0;
+    int height = 0;
+    size_t stride = 0; // bytes from one row to the next
+    PixelFormat format = PixelFormat::RGB;
+
+    ImageView() = default;
+
+    ImageView(const uint8_t *data, int width, int height, size_t stride, PixelFormat format)
+        : data(data), width(width), height(height), stride(stride), format(format)
+    {
+    }
+
+    /**
+     * @brief Packed RGB view of an image's pixels (no copy)
+     */
+    explicit ImageView(const Image &image)
+        : data(reinterpret_cast<const uint8_t *>(image.getPixelData())),
+          width(image.getWidth()), height(image.getHeight()),
+          stride(static_cast<size_t>(image.getWidth()) * sizeof(Pixel)), format(PixelFormat::RGB)
+    {
+    }
+
+    /**
+     * @brief First byte of row y
+     */
+    const uint8_t *row(int y) const
+    {
+        return data + static_cast<size_t>(y) * stride;
+    }
+};
+
+#endif
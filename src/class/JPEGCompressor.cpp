@@ -1,89 +1,69 @@
 #include "JPEGCompressor.hpp"
+#include <algorithm>
+#include <cstring>
 
 
 
-// Build a map from symbol→(code,length)
-void buildHuffmanCodes(const uint8_t bits[16],
-                       const uint8_t huffval[],
-                       int valCount,
-                       HuffmanCode outCodes[256])
+static const int zigzagMap[64][2] = {
+    {0, 0}, {0, 1}, {1, 0}, {2, 0}, {1, 1}, {0, 2}, {0, 3}, {1, 2}, {2, 1}, {3, 0}, {4, 0}, {3, 1}, {2, 2}, {1, 3}, {0, 4}, {0, 5}, {1, 4}, {2, 3}, {3, 2}, {4, 1}, {5, 0}, {6, 0}, {5, 1}, {4, 2}, {3, 3}, {2, 4}, {1, 5}, {0, 6}, {0, 7}, {1, 6}, {2, 5}, {3, 4}, {4, 3}, {5, 2}, {6, 1}, {7, 0}, {7, 1}, {6, 2}, {5, 3}, {4, 4}, {3, 5}, {2, 6}, {1, 7}, {2, 7}, {3, 6}, {4, 5}, {5, 4}, {6, 3}, {7, 2}, {7, 3}, {6, 4}, {5, 5}, {4, 6}, {3, 7}, {4, 7}, {5, 6}, {6, 5}, {7, 4}, {7, 5}, {6, 6}, {5, 7}, {6, 7}, {7, 6}, {7, 7}};
+
+// Block memoization: blocks sharing one cache (and one chunk of the parallel
+// passes, so a block is always copied from an earlier one of its chunk), and
+// size of the direct-mapped cache of recent blocks
+static const size_t MEMO_BLOCKS = 512;
+static const size_t BLOCK_CACHE_SIZE = 256;
+
+struct BlockCacheEntry
 {
-    // JPEG canonical algorithm:
-    // 1) For each bit-length L = 1..16, there are bits[L-1] codes.
-    // 2) Starting with code = 0, assign codes in ascending order of symbol
-    uint16_t code = 0;
-    int idx = 0;
-    for (int L = 1; L <= 16; ++L)
+    uint64_t hash;
+    uint32_t index; // NO_BLOCK when empty
+    uint8_t samples[64];
+};
+
+static const uint32_t NO_BLOCK = UINT32_MAX;
+
+static inline uint64_t hashSamples(const uint8_t samples[64])
+{
+    uint64_t hash = 0;
+    for (int i = 0; i < 64; i += 8)
     {
-        for (int i = 0; i < bits[L - 1]; ++i)
-        {
-            uint8_t symbol = huffval[idx++];
-            outCodes[symbol] = {code, (uint8_t)L};
-            ++code;
-        }
-        code <<= 1;
+        uint64_t word;
+        std::memcpy(&word, samples + i, sizeof(word));
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 29;
     }
+    return hash;
 }
 
-void writeBits(uint16_t bits, uint8_t length, ofstream& file) {
-    static uint8_t currentByte = 0;
-    static int bitPosition = 0;
-    // flush + reset si length==0
-    if (length == 0) {
-        if (bitPosition > 0) {
-            file.put(currentByte);
-            // byte‑stuffing obligatoire en JPEG :
-            if (currentByte == 0xFF)
-                file.put((uint8_t)0x00);
-        }
-        // réinitialisation complète
-        currentByte = 0;
-        bitPosition  = 0;
-        return;
-    }
-
-
-    for (int i = length - 1; i >= 0; --i) {
-        currentByte |= ((bits >> i) & 1) << (7 - bitPosition);
-        bitPosition++;
-        if (bitPosition == 8) {
-            file.put(currentByte);
-            if (currentByte == 0xFF)
-                file.put((uint8_t)0x00);
-            currentByte = 0;
-            bitPosition = 0;
-        }
-    }
+JPEGCompressor::JPEGCompressor(Image &image)
+    : JPEGCompressor(ImageView(image))
+{
 }
 
-const uint8_t standardLuminanceQuantTable[8][8] = {
-    {16, 11, 10, 16, 24, 40, 51, 61},
-    {12, 12, 14, 19, 26, 58, 60, 55},
-    {14, 13, 16, 24, 40, 57, 69, 56},
-    {14, 17, 22, 29, 51, 87, 80, 62},
-    {18, 22, 37, 56, 68, 109, 103, 77},
-    {24, 35, 55, 64, 81, 104, 113, 92},
-    {49, 64, 78, 87, 103, 121, 120, 101},
-    {72, 92, 95, 98, 112, 100, 103, 99}};
+JPEGCompressor::JPEGCompressor(const ImageView &view)
+{
+    this->source = view;
+    this->height = view.height;
+    this->width = view.width;
+    this->quantTables = &quantizationTablesForQuality(quality);
+    chooseHuffmanTables(false);
+}
 
-const uint8_t standardChrominanceQuantTable[8][8] = {
-    {17, 18, 24, 47, 99, 99, 99, 99},
-    {18, 21, 26, 66, 99, 99, 99, 99},
-    {24, 26, 56, 99, 99, 99, 99, 99},
-    {47, 66, 99, 99, 99, 99, 99, 99},
-    {99, 99, 99, 99, 99, 99, 99, 99},
-    {99, 99, 99, 99, 99, 99, 99, 99},
-    {99, 99, 99, 99, 99, 99, 99, 99},
-    {99, 99, 99, 99, 99, 99, 99, 99}};
+JPEGCompressor::JPEGCompressor()
+    : JPEGCompressor(ImageView())
+{
+}
 
-static const int zigzagMap[64][2] = {
-    {0, 0}, {0, 1}, {1, 0}, {2, 0}, {1, 1}, {0, 2}, {0, 3}, {1, 2}, {2, 1}, {3, 0}, {4, 0}, {3, 1}, {2, 2}, {1, 3}, {0, 4}, {0, 5}, {1, 4}, {2, 3}, {3, 2}, {4, 1}, {5, 0}, {6, 0}, {5, 1}, {4, 2}, {3, 3}, {2, 4}, {1, 5}, {0, 6}, {0, 7}, {1, 6}, {2, 5}, {3, 4}, {4, 3}, {5, 2}, {6, 1}, {7, 0}, {7, 1}, {6, 2}, {5, 3}, {4, 4}, {3, 5}, {2, 6}, {1, 7}, {2, 7}, {3, 6}, {4, 5}, {5, 4}, {6, 3}, {7, 2}, {7, 3}, {6, 4}, {5, 5}, {4, 6}, {3, 7}, {4, 7}, {5, 6}, {6, 5}, {7, 4}, {7, 5}, {6, 6}, {5, 7}, {6, 7}, {7, 6}, {7, 7}};
+void JPEGCompressor::reset(Image &image)
+{
+    reset(ImageView(image));
+}
 
-JPEGCompressor::JPEGCompressor(Image &image)
+void JPEGCompressor::reset(const ImageView &view)
 {
-    this->height = image.getHeight();
-    this->width = image.getWidth();
-    this->pixels = image.getPixels();
+    this->source = view;
+    this->height = view.height;
+    this->width = view.width;
 }
 
 YCbCrPixel JPEGCompressor::RGBtoYCbCr(const Pixel &pixel)
@@ -100,318 +80,812 @@ YCbCrPixel JPEGCompressor::RGBtoYCbCr(const Pixel &pixel)
     return result;
 }
 
+/**
+ * @brief Colour conversion of the whole image into the 8-bit Y, Cb and Cr planes
+ *   (fixed-point SIMD kernel, see ColorConvert.hpp)
+ */
 void JPEGCompressor::convertToYCbCr()
 {
-    ycbcrPixels.reserve(pixels.size());
-    for (const Pixel &pixel : pixels)
+    size_t count = static_cast<size_t>(width) * height;
+    Y.resize(count);
+    Cb.resize(count);
+    Cr.resize(count);
+
+    // One MCU row (16 scanlines) per chunk, row by row (the source may be strided)
+    parallelFor(height, 16, [this](size_t firstRow, size_t lastRow)
+                {
+        for (size_t y = firstRow; y < lastRow; ++y)
+        {
+            size_t first = y * width;
+            rgbToYCbCr(source.row(static_cast<int>(y)), source.format, width, &Y[first], &Cb[first], &Cr[first]);
+        } });
+}
+
+void JPEGCompressor::setSubsampling(Subsampling mode)
+{
+    this->subsampling = mode;
+    this->lumaH = (mode == Subsampling::Mode422 || mode == Subsampling::Mode420) ? 2 : 1;
+    this->lumaV = (mode == Subsampling::Mode440 || mode == Subsampling::Mode420) ? 2 : 1;
+    this->componentCount = mode == Subsampling::Grayscale ? 1 : 3;
+}
+
+Subsampling JPEGCompressor::getSubsampling() const
+{
+    return this->subsampling;
+}
+
+/**
+ * @brief MCU grid: 8 * lumaH x 8 * lumaV pixels per MCU
+ */
+size_t JPEGCompressor::mcuColumnCount() const
+{
+    return (static_cast<size_t>(width) + 8 * lumaH - 1) / (8 * lumaH);
+}
+
+size_t JPEGCompressor::mcuRowCount() const
+{
+    return (static_cast<size_t>(height) + 8 * lumaV - 1) / (8 * lumaV);
+}
+
+int JPEGCompressor::chromaPlaneWidth() const
+{
+    return (width + lumaH - 1) / lumaH;
+}
+
+int JPEGCompressor::chromaPlaneHeight() const
+{
+    return (height + lumaV - 1) / lumaV;
+}
+
+/**
+ * @brief Colour conversion and chroma subsampling of scanlines [firstRow, lastRow)
+ *   4:2:0, 4:2:2 and 4:4:0 use the fused kernels (chroma averaged before
+ *   rounding), grayscale only computes Y.
+ *
+ * @param firstRow multiple of lumaV
+ * @param y receives the luma rows (width samples each)
+ * @param cb, cr receive the chroma rows from firstRow / lumaV on
+ *   (chromaPlaneWidth() samples each, unused in grayscale)
+ */
+void JPEGCompressor::convertRows(int firstRow, int lastRow, uint8_t *y, uint8_t *cb, uint8_t *cr) const
+{
+    size_t w = width;
+    size_t cw = chromaPlaneWidth();
+    size_t rows = lastRow - firstRow;
+    PixelFormat format = source.format;
+    // Source row r of the range
+    auto in = [this, firstRow](size_t r)
+    {
+        return source.row(firstRow + static_cast<int>(r));
+    };
+
+    switch (subsampling)
+    {
+    case Subsampling::Grayscale:
+        for (size_t r = 0; r < rows; ++r)
+        {
+            rgbToLuma(in(r), format, w, y + r * w);
+        }
+        break;
+
+    case Subsampling::Mode444:
+        for (size_t r = 0; r < rows; ++r)
+        {
+            rgbToYCbCr(in(r), format, w, y + r * w, cb + r * w, cr + r * w);
+        }
+        break;
+
+    case Subsampling::Mode422:
+        for (size_t r = 0; r < rows; ++r)
+        {
+            rgbToYCbCr420(in(r), nullptr, format, w, y + r * w, nullptr, cb + r * cw, cr + r * cw);
+        }
+        break;
+
+    case Subsampling::Mode420:
+        for (size_t r = 0; r < rows; r += 2)
+        {
+            bool pair = r + 1 < rows;
+            rgbToYCbCr420(in(r), pair ? in(r + 1) : nullptr, format, w,
+                          y + r * w, pair ? y + (r + 1) * w : nullptr, cb + r / 2 * cw, cr + r / 2 * cw);
+        }
+        break;
+
+    case Subsampling::Mode440:
+        for (size_t r = 0; r < rows; r += 2)
+        {
+            bool pair = r + 1 < rows;
+            rgbToYCbCr440(in(r), pair ? in(r + 1) : nullptr, format, w,
+                          y + r * w, pair ? y + (r + 1) * w : nullptr, cb + r / 2 * cw, cr + r / 2 * cw);
+        }
+        break;
+    }
+}
+
+/**
+ * @brief Colour conversion and subsampling of the whole image in a single pass
+ *   Writes Y, Cb_sub and Cr_sub directly (see convertRows()): the full
+ *   resolution Cb/Cr planes of convertToYCbCr() are never built.
+ */
+void JPEGCompressor::convertImage()
+{
+    Y.resize(static_cast<size_t>(width) * height);
+    if (componentCount == 3)
+    {
+        Cb_sub.resize(static_cast<size_t>(chromaPlaneWidth()) * chromaPlaneHeight());
+        Cr_sub.resize(static_cast<size_t>(chromaPlaneWidth()) * chromaPlaneHeight());
+    }
+    else
     {
-        ycbcrPixels.push_back(this->RGBtoYCbCr(pixel));
+        Cb_sub.clear();
+        Cr_sub.clear();
     }
+
+    // One MCU row per chunk
+    int mcuHeight = 8 * lumaV;
+    parallelFor(mcuRowCount(), 1, [this, mcuHeight](size_t firstRow, size_t lastRow)
+                {
+        int first = static_cast<int>(firstRow) * mcuHeight;
+        int last = std::min(height, static_cast<int>(lastRow) * mcuHeight);
+        size_t chromaRow = static_cast<size_t>(first / lumaV) * chromaPlaneWidth();
+        convertRows(first, last, &Y[static_cast<size_t>(first) * width],
+                    componentCount == 3 ? &Cb_sub[chromaRow] : nullptr,
+                    componentCount == 3 ? &Cr_sub[chromaRow] : nullptr); });
+}
+
+void JPEGCompressor::setThreadPool(ThreadPool *pool)
+{
+    this->threadPool = pool;
+}
+
+void JPEGCompressor::setMaxThreads(unsigned threads)
+{
+    this->maxThreads = threads;
 }
 
 void JPEGCompressor::compress(void)
 {
-    this->convertToYCbCr();
-    this->subsample420();
-    this->splitIntoBlocks();
-    this->applyDCTToAllBlocks();
-    this->quantizeAllBlocks();
-    if (!qBlocksCb.empty())
+    beginStats();
+    {
+        StageTimer timer(stats, EncodeStage::Convert);
+        this->convertImage();
+    }
+    {
+        StageTimer timer(stats, EncodeStage::Split);
+        this->splitIntoBlocks();
+    }
+    {
+        StageTimer timer(stats, EncodeStage::Transform);
+        this->applyDCTToAllBlocks();
+    }
+    {
+        StageTimer timer(stats, EncodeStage::Quantize);
+        this->quantizeAllBlocks();
+    }
+}
+
+void JPEGCompressor::setStats(EncodeStats *stats)
+{
+    this->stats = stats;
+}
+
+EncodeStats *JPEGCompressor::getStats() const
+{
+    return this->stats;
+}
+
+/**
+ * @brief Reset the stats (if any) and record the settings of the encode
+ */
+void JPEGCompressor::beginStats()
+{
+    if (stats == nullptr)
     {
-        std::cout << "Cb DC[0]: " << qBlocksCb[0][0][0]
-                  << "   Cr DC[0]: " << qBlocksCr[0][0][0] << "\n";
+        return;
     }
+
+    static const char *modes[5] = {"4:4:4", "4:2:2", "4:2:0", "4:4:0", "grayscale"};
+    stats->reset();
+    stats->width = width;
+    stats->height = height;
+    stats->componentCount = componentCount;
+    stats->quality = quality;
+    stats->progressive = progressive;
+    stats->subsampling = modes[static_cast<int>(subsampling)];
 }
 
 /**
- * @brief 4:2:0 subsampling:
- *   Y (luma): Full resolution (every pixel)
- *   Cb/Cr (chroma): Subsampled by 2 in width and 2 in height
- *   So for every 2×2 Y pixels, you have 1 Cb and 1 Cr
+ * @brief Block figures of one MCU (same traversal as encodeMCU()) and the
+ *   Huffman symbols its blocks produce, per component
  *
+ * @param prevDC DC predictors, updated as encodeMCU() does
  */
-void JPEGCompressor::subsample420()
+void JPEGCompressor::accountMCU(const BlockStore<int16_t> &y, const BlockStore<int16_t> &cb, const BlockStore<int16_t> &cr,
+                                size_t topLeft, size_t yStride, size_t chroma, int prevDC[3], StatsSymbols &symbols) const
 {
-    // Initialize full Y, Cb, Cr planes
-    Y.resize(height, std::vector<double>(width));
-    Cb.resize(height, std::vector<double>(width));
-    Cr.resize(height, std::vector<double>(width));
+    auto account = [this, prevDC, &symbols](const int16_t *block, int c)
+    {
+        ComponentStats &component = stats->components[c];
+        int nonzero = 0;
+        for (int i = 0; i < 64; ++i)
+        {
+            nonzero += block[i] != 0;
+        }
+        component.blocks++;
+        component.nonzeroCoefficients += nonzero;
+        component.zeroACBlocks += nonzero - (block[0] != 0) == 0;
+        countBlock(block, prevDC[c], symbols.dc[c], symbols.ac[c]);
+    };
+
+    for (int v = 0; v < lumaV; ++v)
+    {
+        for (int h = 0; h < lumaH; ++h)
+        {
+            account(y[topLeft + v * yStride + h], 0);
+        }
+    }
+
+    if (componentCount == 3)
+    {
+        account(cb[chroma], 1);
+        account(cr[chroma], 2);
+    }
+}
 
-    for (int y = 0; y < height; y++)
+/**
+ * @brief DC and AC bits of every component from its symbol counts and the
+ *   baseline codes (built by writeHeaders())
+ */
+void JPEGCompressor::finishStats(const StatsSymbols &symbols)
+{
+    for (int c = 0; c < componentCount; ++c)
     {
-        for (int x = 0; x < width; x++)
+        const HuffmanCode *dcCodes = c == 0 ? dcLumaCodes : dcChromaCodes;
+        const HuffmanCode *acCodes = c == 0 ? acLumaCodes : acChromaCodes;
+        ComponentStats &component = stats->components[c];
+        component.dcBits = component.acBits = 0;
+        for (int symbol = 0; symbol < 256; ++symbol)
         {
-            const YCbCrPixel &p = ycbcrPixels[y * width + x];
-            Y[y][x] = p.y;
-            Cb[y][x] = p.cb;
-            Cr[y][x] = p.cr;
+            // Category (DC) or low nibble (AC) = number of magnitude bits
+            if (symbol < 12)
+            {
+                component.dcBits += static_cast<uint64_t>(symbols.dc[c][symbol]) * (dcCodes[symbol].length + symbol);
+            }
+            component.acBits += static_cast<uint64_t>(symbols.ac[c][symbol]) * (acCodes[symbol].length + (symbol & 15));
         }
     }
+}
 
+/**
+ * @brief 4:2:0 subsampling:
+ *   Y (luma): Full resolution (every pixel)
+ *   Cb/Cr (chroma): Subsampled by 2 in width and 2 in height
+ *   So for every 2×2 Y pixels, you have 1 Cb and 1 Cr
+ *   Separate pass over the planes of convertToYCbCr(), 4:2:0 layout only
+ *
+ */
+void JPEGCompressor::subsample420()
+{
     // Allocate subsampled Cb and Cr
     int halfHeight = (height + 1) / 2;
     int halfWidth = (width + 1) / 2;
 
-    Cb_420.resize(halfHeight, std::vector<double>(halfWidth));
-    Cr_420.resize(halfHeight, std::vector<double>(halfWidth));
+    Cb_sub.resize(static_cast<size_t>(halfWidth) * halfHeight);
+    Cr_sub.resize(static_cast<size_t>(halfWidth) * halfHeight);
 
-    for (int y = 0; y < height; y += 2)
-    {
-        for (int x = 0; x < width; x += 2)
+    // One chroma block row (8 subsampled rows) per chunk
+    parallelFor(halfHeight, 8, [this, halfWidth](size_t firstRow, size_t lastRow)
+                {
+        for (int y = firstRow * 2; y < static_cast<int>(lastRow) * 2; y += 2)
         {
-            double cbSum = 0.0;
-            double crSum = 0.0;
-            int count = 0;
-
-            // Handle edges safely (even if width or height is odd)
-            for (int dy = 0; dy < 2; dy++)
+            for (int x = 0; x < width; x += 2)
             {
-                for (int dx = 0; dx < 2; dx++)
+                int cbSum = 0;
+                int crSum = 0;
+                int count = 0;
+
+                // Handle edges safely (even if width or height is odd)
+                for (int dy = 0; dy < 2; dy++)
                 {
-                    int yy = y + dy;
-                    int xx = x + dx;
-                    if (yy < height && xx < width)
+                    for (int dx = 0; dx < 2; dx++)
                     {
-                        cbSum += Cb[yy][xx];
-                        crSum += Cr[yy][xx];
-                        count++;
+                        int yy = y + dy;
+                        int xx = x + dx;
+                        if (yy < height && xx < width)
+                        {
+                            cbSum += Cb[static_cast<size_t>(yy) * width + xx];
+                            crSum += Cr[static_cast<size_t>(yy) * width + xx];
+                            count++;
+                        }
                     }
                 }
-            }
 
-            Cb_420[y / 2][x / 2] = cbSum / count;
-            Cr_420[y / 2][x / 2] = crSum / count;
-        }
-    }
+                // Rounded average
+                size_t out = static_cast<size_t>(y / 2) * halfWidth + x / 2;
+                Cb_sub[out] = static_cast<uint8_t>((cbSum + count / 2) / count);
+                Cr_sub[out] = static_cast<uint8_t>((crSum + count / 2) / count);
+            }
+        } });
 }
 
 void JPEGCompressor::splitIntoBlocks()
 {
     // Helper lambda to extract 8x8 blocks from a 2D matrix
-    auto splitChannel = [](const std::vector<std::vector<double>> &channel, int blockHeight, int blockWidth)
+    // The block grid covers whole MCUs, edges are padded by clamping
+    auto splitChannel = [this](const std::vector<uint8_t> &channel, int blockHeight, int blockWidth,
+                               int blocksPerRow, int blocksPerColumn, BlockStore<double> &blocks)
     {
-        std::vector<std::vector<std::vector<double>>> blocks;
+        blocks.resize(static_cast<size_t>(blocksPerRow) * blocksPerColumn);
 
-        for (int by = 0; by < blockHeight; by += 8)
-        {
-            for (int bx = 0; bx < blockWidth; bx += 8)
+        // One block row per chunk
+        parallelFor(blocksPerColumn, 1, [&](size_t firstRow, size_t lastRow)
+                    {
+            for (int by = firstRow; by < static_cast<int>(lastRow); by++)
             {
-                std::vector<std::vector<double>> block(8, std::vector<double>(8));
-
-                for (int dy = 0; dy < 8; dy++)
+                for (int bx = 0; bx < blocksPerRow; bx++)
                 {
-                    for (int dx = 0; dx < 8; dx++)
+                    double *block = blocks[static_cast<size_t>(by) * blocksPerRow + bx];
+
+                    for (int dy = 0; dy < 8; dy++)
                     {
-                        int yy = std::min(by + dy, blockHeight - 1); // Clamp to edge
-                        int xx = std::min(bx + dx, blockWidth - 1);  // Clamp to edge
-                        block[dy][dx] = channel[yy][xx];
+                        int yy = std::min(by * 8 + dy, blockHeight - 1); // Clamp to edge
+                        for (int dx = 0; dx < 8; dx++)
+                        {
+                            int xx = std::min(bx * 8 + dx, blockWidth - 1); // Clamp to edge
+                            block[dy * 8 + dx] = channel[static_cast<size_t>(yy) * blockWidth + xx];
+                        }
                     }
                 }
+            } });
+    };
 
-                blocks.push_back(block);
-            }
-        }
+    int mcuColumns = mcuColumnCount();
+    int mcuRows = mcuRowCount();
 
-        return blocks;
-    };
+    // Step 1: Split Y channel into 8x8 blocks (lumaH x lumaV per MCU)
+    splitChannel(Y, height, width, mcuColumns * lumaH, mcuRows * lumaV, blocksY);
 
-    // Step 1: Split Y channel into 8x8 blocks
-    blocksY = splitChannel(Y, height, width);
+    if (componentCount == 1)
+    {
+        blocksCb.clear();
+        blocksCr.clear();
+        return;
+    }
 
-    // Step 2: Split Cb_420 into 8x8 blocks
-    int cbHeight = (height + 1) / 2;
-    int cbWidth = (width + 1) / 2;
-    blocksCb = splitChannel(Cb_420, cbHeight, cbWidth);
+    // Step 2: Split Cb_sub into 8x8 blocks (1 per MCU)
+    int cbHeight = chromaPlaneHeight();
+    int cbWidth = chromaPlaneWidth();
+    splitChannel(Cb_sub, cbHeight, cbWidth, mcuColumns, mcuRows, blocksCb);
 
-    // Step 3: Split Cr_420 into 8x8 blocks
-    blocksCr = splitChannel(Cr_420, cbHeight, cbWidth);
+    // Step 3: Split Cr_sub into 8x8 blocks
+    splitChannel(Cr_sub, cbHeight, cbWidth, mcuColumns, mcuRows, blocksCr);
 }
 
 /**
  * @brief Apply DCT (Discrete Cosine Transform) on an 8x8 block
+ *   The transform itself is delegated to the engine selected with setDCTMode()
  *
- * @param block 8x8 input block
- * @return 8x8 transformed block
+ * @param inBlock 64 input samples (0..255)
+ * @param outBlock 64 transformed coefficients, may be inBlock itself
  */
-std::vector<std::vector<double>> JPEGCompressor::applyDCT(
-    const std::vector<std::vector<double>> &inBlock)
+void JPEGCompressor::applyDCT(const double *inBlock, double *outBlock)
 {
     // 1) Level-shift into signed range
-    std::vector<std::vector<double>> block(8, std::vector<double>(8));
-    for (int y = 0; y < 8; ++y)
-        for (int x = 0; x < 8; ++x)
-            block[y][x] = inBlock[y][x] - 128.0;
+    double samples[64];
+    for (int i = 0; i < 64; ++i)
+        samples[i] = inBlock[i] - 128.0;
 
-    // 2) Now do your normal DCT on ‘block’
-    const double PI = std::acos(-1);
-    std::vector<std::vector<double>> dctBlock(8, std::vector<double>(8));
-    for (int u = 0; u < 8; ++u)
+    // 2) Transform with the selected engine
+    if (dctMode == DCTMode::Reference)
     {
-        for (int v = 0; v < 8; ++v)
-        {
-            double sum = 0;
-            for (int y = 0; y < 8; ++y)
-                for (int x = 0; x < 8; ++x)
-                    sum += block[y][x] * std::cos((2 * y + 1) * u * PI / 16) * std::cos((2 * x + 1) * v * PI / 16);
-            double cu = (u == 0) ? (1.0 / std::sqrt(2)) : 1.0;
-            double cv = (v == 0) ? (1.0 / std::sqrt(2)) : 1.0;
-            dctBlock[u][v] = 0.25 * cu * cv * sum;
-        }
+        forwardDCTReference(samples, outBlock);
     }
+    else
+    {
+        forwardDCTFast(samples, outBlock);
+    }
+}
+
+void JPEGCompressor::setQuality(int quality)
+{
+    this->quality = std::max(1, std::min(quality, 100));
+    this->quantTables = &quantizationTablesForQuality(this->quality);
+}
+
+int JPEGCompressor::getQuality() const
+{
+    return this->quality;
+}
+
+void JPEGCompressor::setDCTMode(DCTMode mode)
+{
+    this->dctMode = mode;
+}
+
+DCTMode JPEGCompressor::getDCTMode() const
+{
+    return this->dctMode;
+}
+
+/**
+ * @brief Integer engine for one channel: DCT and quantization in a single pass
+ *
+ * @param blocks 8x8 sample blocks (0..255)
+ * @param qBlocks receives the quantized blocks
+ * @param table quantization table of the channel
+ */
+void JPEGCompressor::integerDCTQuantizeChannel(const BlockStore<double> &blocks,
+                                               BlockStore<int16_t> &qBlocks,
+                                               const QuantizationTable &table)
+{
+    // Chunks are a multiple of 8 blocks to keep the AVX2 kernel busy
+    const size_t CHUNK = 64;
+    qBlocks.resize(blocks.size());
 
-    return dctBlock;
+    parallelFor(blocks.size(), CHUNK, [&](size_t first, size_t last)
+                {
+        int16_t samples[CHUNK * 64];
+        const double *in = blocks[first];
+        for (size_t i = 0; i < (last - first) * 64; ++i)
+            samples[i] = static_cast<int16_t>(std::lround(in[i]) - 128);
+
+        forwardDCTQuantizeInteger(samples, qBlocks[first], last - first, table); });
 }
 
 /**
  * @brief Apply DCT to all 8x8 blocks of Y, Cb, Cr
+ *   With DCTMode::Integer the quantization is fused into this pass:
+ *   qBlocks* are filled here and blocks* keep their samples.
+ *   The trellis needs the coefficients: the fast engine runs instead.
  */
 void JPEGCompressor::applyDCTToAllBlocks()
 {
-    for (auto &block : blocksY)
-    {
-        block = applyDCT(block);
-    }
-
-    for (auto &block : blocksCb)
+    if (dctMode == DCTMode::Integer && !trellis && !blockMemoization)
     {
-        block = applyDCT(block);
+        integerDCTQuantizeChannel(blocksY, qBlocksY, quantTables->luminance);
+        integerDCTQuantizeChannel(blocksCb, qBlocksCb, quantTables->chrominance);
+        integerDCTQuantizeChannel(blocksCr, qBlocksCr, quantTables->chrominance);
+        return;
     }
 
-    for (auto &block : blocksCr)
+    BlockStore<double> *stores[3] = {&blocksY, &blocksCb, &blocksCr};
+    for (int c = 0; c < 3; ++c)
     {
-        block = applyDCT(block);
+        BlockStore<double> *blocks = stores[c];
+        blockSources[c].resize(blockMemoization ? blocks->size() : 0);
+        uint32_t *sources = blockMemoization ? blockSources[c].data() : nullptr;
+        parallelFor(blocks->size(), blockMemoization ? MEMO_BLOCKS : 64, [this, blocks, sources](size_t first, size_t last)
+                    { transformBlocks(*blocks, first, last, sources); });
+        countMemoizedBlocks(blockSources[c]);
     }
 }
 
-std::vector<std::vector<int>> JPEGCompressor::quantizeBlock(
-    const std::vector<std::vector<double>> &block,
-    const uint8_t table[8][8])
+/**
+ * @brief DCT of blocks [first, last) in place
+ *
+ * @param sources nullptr, or memoization: receives for every block its own
+ *   index, FLAT_BLOCK, or the index of the earlier block of the range with
+ *   the same samples, whose coefficients were copied
+ */
+void JPEGCompressor::transformBlocks(BlockStore<double> &blocks, size_t first, size_t last, uint32_t *sources)
 {
-    std::vector<std::vector<int>> quantized(8, std::vector<int>(8));
-    for (int y = 0; y < 8; y++)
+    if (sources == nullptr)
     {
-        for (int x = 0; x < 8; x++)
+        for (size_t i = first; i < last; ++i)
         {
-            quantized[y][x] = static_cast<int>(std::round(block[y][x] / table[y][x]));
+            applyDCT(blocks[i], blocks[i]);
         }
+        return;
     }
-    return quantized;
-}
-
-void JPEGCompressor::quantizeAllBlocks()
-{
-    qBlocksY.clear();
-    qBlocksCb.clear();
-    qBlocksCr.clear();
 
-    // Quantize all Y blocks
-    for (const auto &block : blocksY)
+    BlockCacheEntry cache[BLOCK_CACHE_SIZE];
+    for (BlockCacheEntry &entry : cache)
     {
-        qBlocksY.push_back(quantizeBlock(block, standardLuminanceQuantTable));
+        entry.index = NO_BLOCK;
     }
+    // The AAN transform of a uniform block is exactly DC = 8 (v - 128), no AC;
+    // the reference one is only close, its uniform blocks go through the cache
+    bool directFlat = dctMode != DCTMode::Reference;
 
-    // Quantize all Cb blocks
-    for (const auto &block : blocksCb)
+    for (size_t i = first; i < last; ++i)
     {
-        qBlocksCb.push_back(quantizeBlock(block, standardChrominanceQuantTable));
-    }
+        double *block = blocks[i];
+        if (directFlat && std::all_of(block + 1, block + 64, [block](double sample)
+                                      { return sample == block[0]; }))
+        {
+            double dc = 8 * (block[0] - 128.0);
+            std::fill(block, block + 64, 0.0);
+            block[0] = dc;
+            sources[i] = FLAT_BLOCK;
+            continue;
+        }
 
-    // Quantize all Cr blocks
-    for (const auto &block : blocksCr)
-    {
-        qBlocksCr.push_back(quantizeBlock(block, standardChrominanceQuantTable));
+        uint8_t samples[64];
+        for (int k = 0; k < 64; ++k)
+        {
+            samples[k] = static_cast<uint8_t>(block[k]);
+        }
+        uint64_t hash = hashSamples(samples);
+        BlockCacheEntry &entry = cache[hash % BLOCK_CACHE_SIZE];
+        if (entry.index != NO_BLOCK && entry.hash == hash && std::memcmp(entry.samples, samples, 64) == 0)
+        {
+            std::memcpy(block, blocks[entry.index], 64 * sizeof(double));
+            sources[i] = entry.index;
+            continue;
+        }
+
+        entry.hash = hash;
+        entry.index = static_cast<uint32_t>(i);
+        std::memcpy(entry.samples, samples, 64);
+        applyDCT(block, block);
+        sources[i] = static_cast<uint32_t>(i);
     }
 }
 
-const std::vector<std::vector<int>> &JPEGCompressor::getQuantizedYBlock(int index) const
+/**
+ * @brief Quantization of blocks [first, last), after transformBlocks() with
+ *   the same sources: uniform blocks only quantize their DC (the trellis
+ *   keeps it rounded too), repeated ones copy the earlier result
+ */
+void JPEGCompressor::quantizeBlocks(const BlockStore<double> &blocks, BlockStore<int16_t> &qBlocks, size_t first, size_t last,
+                                    const QuantizationTable &table, const TrellisCosts &costs, const uint32_t *sources) const
 {
-    if (index < 0 || static_cast<size_t>(index) >= qBlocksY.size())
+    for (size_t i = first; i < last; ++i)
     {
-        std::cerr << "Invalid Y block index!\n";
-        static std::vector<std::vector<int>> dummy(8, std::vector<int>(8, 0));
-        return dummy; // return safe dummy block
+        uint32_t source = sources != nullptr ? sources[i] : static_cast<uint32_t>(i);
+        if (source == i)
+        {
+            quantizeBlock(blocks[i], table, costs, qBlocks[i]);
+        }
+        else if (source == FLAT_BLOCK)
+        {
+            std::memset(qBlocks[i], 0, 64 * sizeof(int16_t));
+            qBlocks[i][0] = quantizeCoefficient(blocks[i][0], table.values[0][0], table.reciprocals[0]);
+        }
+        else
+        {
+            std::memcpy(qBlocks[i], qBlocks[source], 64 * sizeof(int16_t));
+        }
     }
-    return qBlocksY[index];
 }
 
-std::vector<int> JPEGCompressor::zigzagScan(const std::vector<std::vector<int>> &block)
+void JPEGCompressor::countMemoizedBlocks(const std::vector<uint32_t> &sources)
 {
-    std::vector<int> result;
-    result.reserve(64);
-
-    for (int i = 0; i < 64; ++i)
+    if (stats == nullptr)
     {
-        int y = zigzagMap[i][0];
-        int x = zigzagMap[i][1];
-        result.push_back(block[y][x]);
+        return;
     }
-
-    return result;
-}
-
-std::vector<std::pair<int, int>> JPEGCompressor::runLengthEncode(const std::vector<int> &zigzaggedBlock)
-{
-    std::vector<std::pair<int, int>> rle;
-    int zeroCount = 0;
-
-    // Start at index 1: DC is treated differently (first value)
-    rle.push_back({0, zigzaggedBlock[0]}); // DC coefficient
-
-    for (size_t i = 1; i < zigzaggedBlock.size(); i++)
+    for (size_t i = 0; i < sources.size(); ++i)
     {
-        if (zigzaggedBlock[i] == 0)
+        if (sources[i] == FLAT_BLOCK)
         {
-            ++zeroCount;
+            stats->flatBlocks++;
         }
-        else
+        else if (sources[i] != i)
         {
-            rle.push_back({zeroCount, zigzaggedBlock[i]});
-            zeroCount = 0;
+            stats->repeatedBlocks++;
         }
     }
+}
 
-    if (zeroCount > 0)
-    {
-        rle.push_back({0, 0}); // EOB (End Of Block)
-    }
-
-    return rle;
+void JPEGCompressor::setBlockMemoization(bool enable)
+{
+    this->blockMemoization = enable;
 }
 
-// Simplified DC encoding
-void JPEGCompressor::huffmanEncodeDC(int dcDiff, ofstream& file, HuffmanCode dcLumaCodes[12])
+bool JPEGCompressor::getBlockMemoization() const
 {
-    int category = 0;
-    int temp = std::abs(dcDiff);
+    return this->blockMemoization;
+}
 
-    while (temp > 0)
+/**
+ * @brief Quantize one block of DCT coefficients
+ *
+ * @param block 64 DCT coefficients
+ * @param table quantization table (steps and their reciprocals)
+ * @param out 64 quantized coefficients
+ */
+void JPEGCompressor::quantizeBlock(const double *block, const QuantizationTable &table, int16_t *out) const
+{
+    for (int i = 0; i < 64; i++)
     {
-        temp >>= 1;
-        category++;
+        out[i] = quantizeCoefficient(block[i], table.values[i / 8][i % 8], table.reciprocals[i]);
     }
+}
+
+void JPEGCompressor::quantizeAllBlocks()
+{
+    // Already quantized by the fused integer pass
+    if (dctMode == DCTMode::Integer && !trellis && !blockMemoization)
+    {
+        return;
+    }
+    quantizeAllBlocks(blocksY, blocksCb, blocksCr);
+}
+
+/**
+ * @brief Quantize DCT coefficients held elsewhere (another encoder's) into
+ *   the qBlocks of this one, with its quality and trellis settings
+ */
+void JPEGCompressor::quantizeAllBlocks(const BlockStore<double> &coefficientsY, const BlockStore<double> &coefficientsCb,
+                                       const BlockStore<double> &coefficientsCr)
+{
+    TrellisCosts lumaCosts, chromaCosts;
+    if (trellis)
+    {
+        trellisCosts(lumaCosts, chromaCosts);
+    }
+
+    // Blocks of the last memoized transform: its sources say which to copy
+    bool memoized = &coefficientsY == &blocksY && blockSources[0].size() == blocksY.size() && !blocksY.empty();
+
+    auto quantizeChannel = [this, memoized](const BlockStore<double> &blocks, BlockStore<int16_t> &qBlocks,
+                                            const QuantizationTable &table, const TrellisCosts &costs,
+                                            const std::vector<uint32_t> &sourceList)
+    {
+        qBlocks.resize(blocks.size());
+        const uint32_t *sources = memoized ? sourceList.data() : nullptr;
+        // Blocks are independent: the trellis parallelizes like the rounding
+        // (memoized: the chunks of the transform, copies come from their chunk)
+        size_t grain = memoized ? MEMO_BLOCKS : (trellis ? 16 : 64);
+        parallelFor(blocks.size(), grain, [&](size_t first, size_t last)
+                    { quantizeBlocks(blocks, qBlocks, first, last, table, costs, sources); });
+    };
+
+    // Quantize all Y, Cb and Cr blocks
+    quantizeChannel(coefficientsY, qBlocksY, quantTables->luminance, lumaCosts, blockSources[0]);
+    quantizeChannel(coefficientsCb, qBlocksCb, quantTables->chrominance, chromaCosts, blockSources[1]);
+    quantizeChannel(coefficientsCr, qBlocksCr, quantTables->chrominance, chromaCosts, blockSources[2]);
+}
+
+/**
+ * @brief Quantize one block by rounding, or with the trellis when enabled
+ *
+ * @param costs bit costs of the block's AC table (trellis only)
+ */
+void JPEGCompressor::quantizeBlock(const double *block, const QuantizationTable &table, const TrellisCosts &costs, int16_t *out) const
+{
+    if (trellis)
+    {
+        trellisQuantizeBlock(block, table, costs, trellisLambda, out);
+        return;
+    }
+    quantizeBlock(block, table, out);
+}
+
+/**
+ * @brief Bit costs for the trellis, from the Annex K AC tables
+ *   Those are the tables of every encode that does not optimize them; an
+ *   optimized table is built from the quantized blocks, so it cannot be
+ *   known before them and the Annex K lengths stand in for it.
+ */
+void JPEGCompressor::trellisCosts(TrellisCosts &luma, TrellisCosts &chroma) const
+{
+    HuffmanCode codes[256] = {};
+    buildHuffmanCodes(standardACLuminanceTable(), codes);
+    buildTrellisCosts(codes, luma);
+    buildHuffmanCodes(standardACChrominanceTable(), codes);
+    buildTrellisCosts(codes, chroma);
+}
+
+void JPEGCompressor::setTrellisQuantization(bool enable)
+{
+    this->trellis = enable;
+}
+
+bool JPEGCompressor::getTrellisQuantization() const
+{
+    return this->trellis;
+}
+
+void JPEGCompressor::setTrellisLambda(double lambda)
+{
+    this->trellisLambda = std::max(0.0, lambda);
+}
+
+double JPEGCompressor::getTrellisLambda() const
+{
+    return this->trellisLambda;
+}
+
+const int16_t *JPEGCompressor::getQuantizedYBlock(int index) const
+{
+    if (index < 0 || static_cast<size_t>(index) >= qBlocksY.size())
+    {
+        std::cerr << "Invalid Y block index!\n";
+        static const int16_t dummy[64] = {};
+        return dummy; // return safe dummy block
+    }
+    return qBlocksY[index];
+}
+
+/**
+ * @brief Reorder a block in zigzag order
+ *
+ * @param block 64 quantized coefficients (row major)
+ * @param out 64 coefficients in zigzag order
+ */
+void JPEGCompressor::zigzagScan(const int16_t *block, int out[64]) const
+{
+    for (int i = 0; i < 64; ++i)
+    {
+        int y = zigzagMap[i][0];
+        int x = zigzagMap[i][1];
+        out[i] = block[y * 8 + x];
+    }
+}
+
+/**
+ * @brief Run-length encode a zigzagged block
+ *   rle[0] is the DC coefficient, then (zeros, value) pairs and a (0,0) EOB
+ *   if the block ends with zeros. 64 entries are always enough.
+ *
+ * @return number of pairs written in rle
+ */
+int JPEGCompressor::runLengthEncode(const int zigzaggedBlock[64], std::pair<int, int> rle[64]) const
+{
+    int count = 0;
+    int zeroCount = 0;
+
+    // Start at index 1: DC is treated differently (first value)
+    rle[count++] = {0, zigzaggedBlock[0]}; // DC coefficient
+
+    for (int i = 1; i < 64; i++)
+    {
+        if (zigzaggedBlock[i] == 0)
+        {
+            ++zeroCount;
+        }
+        else
+        {
+            rle[count++] = {zeroCount, zigzaggedBlock[i]};
+            zeroCount = 0;
+        }
+    }
+
+    if (zeroCount > 0)
+    {
+        rle[count++] = {0, 0}; // EOB (End Of Block)
+    }
+
+    return count;
+}
+
+/**
+ * @brief Number of bits needed to write value (the JPEG "category")
+ */
+static inline int bitLength(unsigned value)
+{
+    return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
 
-    HuffmanCode huff = dcLumaCodes[category];
+// Simplified DC encoding
+void JPEGCompressor::huffmanEncodeDC(int dcDiff, BitWriter &writer, const HuffmanCode dcCodes[12]) const
+{
+    int category = bitLength(std::abs(dcDiff));
 
-    writeBits(huff.code, huff.length, file);
+    HuffmanCode huff = dcCodes[category];
 
     // Encode value bits
+    uint32_t bits = 0;
     if (category > 0) {
-        uint16_t bits;
         if (dcDiff >= 0) {
             bits = dcDiff;
         } else {
             bits = (1 << category) - 1 + dcDiff; // JPEG negative value encoding
         }
-        writeBits(bits, category, file);
     }
+
+    // Code and value bits in one write
+    writer.writeBits((static_cast<uint32_t>(huff.code) << category) | bits, huff.length + category);
 }
 
 // Simplified AC encoding
-void JPEGCompressor::huffmanEncodeAC(const std::vector<std::pair<int, int>> &rle,
+void JPEGCompressor::huffmanEncodeAC(const std::pair<int, int> *rle, int count,
                                      const HuffmanCode huffAC[256],
-                                     ofstream& file)
+                                     BitWriter &writer) const
 {
-    for (size_t i = 1; i < rle.size(); ++i)
+    for (int i = 1; i < count; ++i)
     {
         int zeros = rle[i].first;
         int val = rle[i].second;
@@ -420,7 +894,7 @@ void JPEGCompressor::huffmanEncodeAC(const std::vector<std::pair<int, int>> &rle
         {
             // End-of-block (EOB)
             HuffmanCode eob = huffAC[0x00];
-            writeBits(eob.code, eob.length, file);
+            writer.writeBits(eob.code, eob.length);
             break;
         }
 
@@ -428,26 +902,18 @@ void JPEGCompressor::huffmanEncodeAC(const std::vector<std::pair<int, int>> &rle
         {
             // Write ZRL (16 zeros → code 0xF0)
             HuffmanCode zrl = huffAC[0xF0];
-            writeBits(zrl.code, zrl.length, file);
+            writer.writeBits(zrl.code, zrl.length);
             zeros -= 16;
         }
 
-        int category = 0;
-        int magnitude = std::abs(val);
-        while (magnitude != 0) {
-            magnitude >>= 1;
-            category++;
-        }
+        int category = bitLength(std::abs(val));
 
         int symbol = (zeros << 4) | category;
         HuffmanCode huff = huffAC[symbol];
-        writeBits(huff.code, huff.length, file);
 
-        if (category > 0)
-        {
-            uint16_t bits = (val >= 0) ? val : (1 << category) - 1 + val;
-            writeBits(bits, category, file);
-        }
+        // Code and value bits in one write (category > 0 here)
+        uint32_t bits = (val >= 0) ? val : (1 << category) - 1 + val;
+        writer.writeBits((static_cast<uint32_t>(huff.code) << category) | bits, huff.length + category);
     }
 }
 
@@ -462,14 +928,20 @@ PPMImage JPEGCompressor::reconstructRGBImage() const
         return static_cast<uint8_t>(std::round(std::min(255.0, std::max(0.0, val))));
     };
 
+    int chromaWidth = chromaPlaneWidth();
     for (int y = 0; y < height; ++y)
     {
         for (int x = 0; x < width; ++x)
         {
 
-            double yVal = Y[y][x];
-            double cbVal = Cb_420[y / 2][x / 2];
-            double crVal = Cr_420[y / 2][x / 2];
+            double yVal = Y[static_cast<size_t>(y) * width + x];
+            double cbVal = 128.0;
+            double crVal = 128.0;
+            if (componentCount == 3)
+            {
+                cbVal = Cb_sub[static_cast<size_t>(y / lumaV) * chromaWidth + x / lumaH];
+                crVal = Cr_sub[static_cast<size_t>(y / lumaV) * chromaWidth + x / lumaH];
+            }
 
             // Inverse conversion: YCbCr to RGB
             double r = yVal + 1.402 * (crVal - 128);
@@ -494,20 +966,20 @@ PPMImage JPEGCompressor::reconstructRGBImage() const
 
 void JPEGCompressor::printQuantizedBlockY(int blockIndex) const
 {
-    if (blockIndex >= qBlocksY.size())
+    if (blockIndex < 0 || static_cast<size_t>(blockIndex) >= qBlocksY.size())
     {
         std::cerr << "Invalid block index!\n";
         return;
     }
 
-    const auto &block = qBlocksY[blockIndex];
+    const int16_t *block = qBlocksY[blockIndex];
     std::cout << "Quantized DCT coefficients for Y block " << blockIndex << ":\n";
 
-    for (const auto &row : block)
+    for (int y = 0; y < 8; y++)
     {
-        for (int val : row)
+        for (int x = 0; x < 8; x++)
         {
-            std::cout << val << "\t";
+            std::cout << block[y * 8 + x] << "\t";
         }
         std::cout << "\n";
     }
@@ -525,360 +997,1181 @@ int JPEGCompressor::getWidth() const
 
 #include <fstream>
 
-void writeQuantizationTable(std::ofstream &file, const uint8_t table[8][8], uint8_t tableID)
+void writeQuantizationTable(OutputSink &out, const uint8_t table[8][8], uint8_t tableID)
 {
     // DQT marker
-    file.put(0xFF);
-    file.put(0xDB);
-    file.put(0x00);
-    file.put(0x43);    // Length = 67 bytes
-    file.put(tableID); // Pq = 0 (8-bit), Tq = tableID
-
-    // Zigzag reorder
-    const int zigzagOrder[64] = {
-        0, 1, 5, 6, 14, 15, 27, 28,
-        2, 4, 7, 13, 16, 26, 29, 42,
-        3, 8, 12, 17, 25, 30, 41, 43,
-        9, 11, 18, 24, 31, 40, 44, 53,
-        10, 19, 23, 32, 39, 45, 52, 54,
-        20, 22, 33, 38, 46, 51, 55, 60,
-        21, 34, 37, 47, 50, 56, 59, 61,
-        35, 36, 48, 49, 57, 58, 62, 63};
+    out.put(0xFF);
+    out.put(0xDB);
+    out.put(0x00);
+    out.put(0x43);    // Length = 67 bytes
+    out.put(tableID); // Pq = 0 (8-bit), Tq = tableID
 
+    // Zigzag reorder: the i-th value written is the i-th coefficient of the zigzag scan
     for (int i = 0; i < 64; ++i)
     {
-        int row = zigzagOrder[i] / 8;
-        int col = zigzagOrder[i] % 8;
-        file.put(table[row][col]);
-    }
-}
-
-void writeHuffmanTables(std::ofstream &file)
-{
-    // DC Luminance
-    uint8_t bits_dc_luminance[16] = {
-        0x00, // 1-bit codes:   0
-        0x01, // 2-bit codes:   1
-        0x05, // 3-bit codes:   5
-        0x01, // 4-bit codes:   1
-        0x01, // 5-bit codes:   1
-        0x01, // 6-bit codes:   1
-        0x01, // 7-bit codes:   1
-        0x01, // 8-bit codes:   1
-        0x01, // 9-bit codes:   1
-        0x00, // 10-bit codes:  0
-        0x00, // 11-bit codes:  0
-        0x00, // 12-bit codes:  0
-        0x00, // 13-bit codes:  0
-        0x00, // 14-bit codes:  0
-        0x00, // 15-bit codes:  0
-        0x00  // 16-bit codes:  0
-    };
-    uint8_t val_dc_luminance[12] = {
-        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
-
-    file.put(0xFF);
-    file.put(0xC4);
-    file.put(0x00);
-    file.put(0x1F);
-    file.put(0x00); // DC, Table 0
-    file.write(reinterpret_cast<char *>(bits_dc_luminance), 16);
-    file.write(reinterpret_cast<char *>(val_dc_luminance), 12);
-
-    // AC Luminance
-    uint8_t bits_ac_luminance[16] = {
-        0x00, 0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03,
-        0x05, 0x05, 0x04, 0x04, 0x00, 0x00, 0x01, 0x7D};
-    uint8_t val_ac_luminance[162] = {
-        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
-        0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
-        0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08,
-        0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
-        0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16,
-        0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
-        0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
-        0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
-        0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
-        0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
-        0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
-        0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
-        0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
-        0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
-        0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6,
-        0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
-        0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4,
-        0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
-        0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA,
-        0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
-        0xF9, 0xFA};
-
-    file.put(0xFF);
-    file.put(0xC4);
-    file.put(0x00);
-    file.put(0xB5); // Length = 418 (2 + 1 + 16 + 162)
-    file.put(0x10); // AC, Table 0huffman
-    file.write(reinterpret_cast<char *>(bits_ac_luminance), 16);
-    file.write(reinterpret_cast<char *>(val_ac_luminance), 162);
-
-    // DC Chrominance
-    uint8_t bits_dc_chrominance[16] = {
-        0x00, 0x03, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
-        0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00};
-    uint8_t val_dc_chrominance[12] = {
-        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
-
-    file.put(0xFF);
-    file.put(0xC4);
-    file.put(0x00);
-    file.put(0x1F);
-    file.put(0x01); // DC, Table 1
-    file.write(reinterpret_cast<char *>(bits_dc_chrominance), 16);
-    file.write(reinterpret_cast<char *>(val_dc_chrominance), 12);
-
-    // AC Chrominance
-    uint8_t bits_ac_chrominance[16] = {
-        0x00, 0x02, 0x01, 0x02, 0x04, 0x04, 0x03, 0x04,
-        0x07, 0x05, 0x04, 0x04, 0x00, 0x01, 0x02, 0x77};
-    uint8_t val_ac_chrominance[162] = {
-        0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
-        0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
-        0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
-        0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
-        0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34,
-        0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
-        0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38,
-        0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
-        0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
-        0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
-        0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
-        0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
-        0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96,
-        0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
-        0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4,
-        0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
-        0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2,
-        0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
-        0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9,
-        0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
-        0xF9, 0xFA};
-
-    file.put(0xFF);
-    file.put(0xC4);
-    file.put(0x00);
-    file.put(0xB5);
-    file.put(0x11); // AC, Table 1
-    file.write(reinterpret_cast<char *>(bits_ac_chrominance), 16);
-    file.write(reinterpret_cast<char *>(val_ac_chrominance), 162);
+        int row = zigzagMap[i][0];
+        int col = zigzagMap[i][1];
+        out.put(table[row][col]);
+    }
 }
 
-void JPEGCompressor::writeJPEGFile(const std::string &filename)
+/**
+ * @brief Write one DHT segment
+ *
+ * @param tableClass 0 = DC, 1 = AC
+ * @param tableID destination (0 = luminance, 1 = chrominance)
+ */
+void writeHuffmanTable(OutputSink &out, const HuffmanTable &table, uint8_t tableClass, uint8_t tableID)
 {
-    // DC Luminance
-    uint8_t bits_dc_luminance[16] = {
-        0x00, // 1-bit codes:   0
-        0x01, // 2-bit codes:   1
-        0x05, // 3-bit codes:   5
-        0x01, // 4-bit codes:   1
-        0x01, // 5-bit codes:   1
-        0x01, // 6-bit codes:   1
-        0x01, // 7-bit codes:   1
-        0x01, // 8-bit codes:   1
-        0x01, // 9-bit codes:   1
-        0x00, // 10-bit codes:  0
-        0x00, // 11-bit codes:  0
-        0x00, // 12-bit codes:  0
-        0x00, // 13-bit codes:  0
-        0x00, // 14-bit codes:  0
-        0x00, // 15-bit codes:  0
-        0x00  // 16-bit codes:  0
-    };
-    uint8_t val_dc_luminance[12] = {
-        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
-
-
-    // DC Chrominance
-    uint8_t bits_dc_chrominance[16] = {
-        0x00, 0x03, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
-        0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00};
-    uint8_t val_dc_chrominance[12] = {
-        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
-
-    // AC chrominance
-    uint8_t bits_ac_luminance[16] = {
-        0x00, 0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03,
-        0x05, 0x05, 0x04, 0x04, 0x00, 0x00, 0x01, 0x7D};
-    uint8_t val_ac_luminance[162] = {
-        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
-        0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
-        0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08,
-        0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
-        0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16,
-        0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
-        0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
-        0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
-        0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
-        0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
-        0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
-        0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
-        0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
-        0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
-        0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6,
-        0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
-        0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4,
-        0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
-        0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA,
-        0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
-        0xF9, 0xFA};
-
-    // AC Chrominance
-    uint8_t bits_ac_chrominance[16] = {
-        0x00, 0x02, 0x01, 0x02, 0x04, 0x04, 0x03, 0x04,
-        0x07, 0x05, 0x04, 0x04, 0x00, 0x01, 0x02, 0x77};
-    uint8_t val_ac_chrominance[162] = {
-        0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
-        0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
-        0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
-        0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
-        0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34,
-        0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
-        0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38,
-        0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
-        0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
-        0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
-        0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
-        0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
-        0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96,
-        0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
-        0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4,
-        0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
-        0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2,
-        0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
-        0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9,
-        0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
-        0xF9, 0xFA};
-
-    std::ofstream file(filename, std::ios::binary);
-    if (!file.is_open())
-    {
-        std::cerr << "Cannot open file for writing: " << filename << std::endl;
-        return;
-    }
+    int length = 2 + 1 + 16 + table.count;
+
+    out.put(0xFF);
+    out.put(0xC4);
+    out.put((length >> 8) & 0xFF);
+    out.put(length & 0xFF);
+    out.put((tableClass << 4) | tableID);
+    out.write(table.bits, 16);
+    out.write(table.huffval, table.count);
+}
 
+void writeHuffmanTables(OutputSink &out, const HuffmanTable &dcLuma, const HuffmanTable &acLuma,
+                        const HuffmanTable &dcChroma, const HuffmanTable &acChroma)
+{
+    writeHuffmanTable(out, dcLuma, 0, 0);
+    writeHuffmanTable(out, acLuma, 1, 0);
+    writeHuffmanTable(out, dcChroma, 0, 1);
+    writeHuffmanTable(out, acChroma, 1, 1);
+}
+
+/**
+ * @brief Write everything up to the entropy coded data:
+ *   SOI, DQT, SOF0, DHT and SOS, and build the Huffman codes used by encodeBlock()
+ *   from the tables picked by chooseHuffmanTables().
+ *   progressiveFrame: SOI, DQT, SOF2 (and DRI) only.
+ */
+void JPEGCompressor::writeHeaders(OutputSink &out, bool progressiveFrame)
+{
     // 1. SOI marker
-    file.put(0xFF);
-    file.put(0xD8);
+    out.put(0xFF);
+    out.put(0xD8);
 
     // 2. DQT (Define Quantization Table)
-    writeQuantizationTable(file, standardLuminanceQuantTable, 0x00);
-    writeQuantizationTable(file, standardChrominanceQuantTable, 0x01);
+    writeQuantizationTable(out, quantTables->luminance.values, 0x00);
+    if (componentCount == 3)
+    {
+        writeQuantizationTable(out, quantTables->chrominance.values, 0x01);
+    }
 
-    // 3. SOF0 (Start of Frame - Baseline DCT)
-    file.put(0xFF);
-    file.put(0xC0);
+    // 3. SOF0 (Start of Frame - Baseline DCT) or SOF2 (Progressive DCT)
+    int frameLength = 8 + 3 * componentCount; // 17 bytes for 3 components, 11 for 1
+    out.put(0xFF);
+    out.put(progressiveFrame ? 0xC2 : 0xC0);
 
-    file.put(0x00);
-    file.put(0x11); // 17 bytes total for 3 components
+    out.put(0x00);
+    out.put(frameLength);
 
-    file.put(0x08);
-    file.put((height >> 8) & 0xFF);
-    file.put(height & 0xFF);
-    file.put((width >> 8) & 0xFF);
-    file.put(width & 0xFF);
-    file.put(0x03); // Nf = 3
+    out.put(0x08);
+    out.put((height >> 8) & 0xFF);
+    out.put(height & 0xFF);
+    out.put((width >> 8) & 0xFF);
+    out.put(width & 0xFF);
+    out.put(componentCount); // Nf
 
     // Y component
-    file.put(0x01); // ID = 1
-    file.put(0x22); // H=2, V=2 (for 4:2:0) or 0x11 for 1×1
-    file.put(0x00); // QTable = 0
+    out.put(0x01);                    // ID = 1
+    out.put((lumaH << 4) | lumaV);    // H, V: 0x22 for 4:2:0, 0x21 4:2:2, 0x12 4:4:0, 0x11 4:4:4 / grayscale
+    out.put(0x00);                    // QTable = 0
 
-    // Cb component
-    file.put(0x02); // ID = 2
-    file.put(0x11); // H=1, V=1
-    file.put(0x01); // QTable = 1
+    if (componentCount == 3)
+    {
+        // Cb component
+        out.put(0x02); // ID = 2
+        out.put(0x11); // H=1, V=1
+        out.put(0x01); // QTable = 1
+
+        // Cr component
+        out.put(0x03); // ID = 3
+        out.put(0x11); // H=1, V=1
+        out.put(0x01); // QTable = 1
+    }
+
+    // DRI (Define Restart Interval), in MCUs
+    if (restartInterval > 0)
+    {
+        out.put(0xFF);
+        out.put(0xDD);
+        out.put(0x00);
+        out.put(0x04);
+        out.put((restartInterval >> 8) & 0xFF);
+        out.put(restartInterval & 0xFF);
+    }
 
-    // Cr component
-    file.put(0x03); // ID = 3
-    file.put(0x11); // H=1, V=1
-    file.put(0x01); // QTable = 1
+    // Progressive: tables and SOS come with every scan (writeProgressiveScans())
+    if (progressiveFrame)
+    {
+        return;
+    }
 
     // 4. DHT (Define Huffman Table)
-    writeHuffmanTables(file);
-    HuffmanCode dcLumaCodes[12], acLumaCodes[256];
-    HuffmanCode dcChromaCodes[12], acChromaCodes[256];
+    if (componentCount == 3)
+    {
+        writeHuffmanTables(out, dcLumaTable, acLumaTable, dcChromaTable, acChromaTable);
+    }
+    else
+    {
+        writeHuffmanTable(out, dcLumaTable, 0, 0);
+        writeHuffmanTable(out, acLumaTable, 1, 0);
+    }
 
-    // e.g. at init:
-    buildHuffmanCodes(bits_dc_luminance, val_dc_luminance, 12, dcLumaCodes);
-    buildHuffmanCodes(bits_ac_luminance, val_ac_luminance, 162, acLumaCodes);
-    buildHuffmanCodes(bits_dc_chrominance, val_dc_chrominance, 12, dcChromaCodes);
-    buildHuffmanCodes(bits_ac_chrominance, val_ac_chrominance, 162, acChromaCodes);
+    // 5. Matching symbol -> code maps
+    buildHuffmanCodes(dcLumaTable, dcLumaCodes);
+    buildHuffmanCodes(acLumaTable, acLumaCodes);
+    buildHuffmanCodes(dcChromaTable, dcChromaCodes);
+    buildHuffmanCodes(acChromaTable, acChromaCodes);
 
     // 6. SOS (Start of Scan)
-    file.put(0xFF);
-    file.put(0xDA);
+    int scanLength = 6 + 2 * componentCount; // 12 bytes for 3 components
+    out.put(0xFF);
+    out.put(0xDA);
 
-    // We have 3 components, so length = 6 + 2*3 = 12
-    file.put(0x00);
-    file.put(0x0C);
+    out.put(0x00);
+    out.put(scanLength);
 
-    file.put(0x03); // 3 components in scan
+    out.put(componentCount); // components in scan
 
     // Y  : component ID = 1, DC-table=0, AC-table=0 → selector = 0x00
-    file.put(0x01);
-    file.put(0x00);
+    out.put(0x01);
+    out.put(0x00);
 
-    // Cb : component ID = 2, DC-table=1, AC-table=1 → selector = 0x11
-    file.put(0x02);
-    file.put(0x11);
+    if (componentCount == 3)
+    {
+        // Cb : component ID = 2, DC-table=1, AC-table=1 → selector = 0x11
+        out.put(0x02);
+        out.put(0x11);
 
-    // Cr : component ID = 3, DC-table=1, AC-table=1 → selector = 0x11
-    file.put(0x03);
-    file.put(0x11);
+        // Cr : component ID = 3, DC-table=1, AC-table=1 → selector = 0x11
+        out.put(0x03);
+        out.put(0x11);
+    }
 
     // spectral selection (baseline JPEG)
-    file.put(0x00); // Ss
-    file.put(0x3F); // Se
-    file.put(0x00); // Ah/Al
+    out.put(0x00); // Ss
+    out.put(0x3F); // Se
+    out.put(0x00); // Ah/Al
+}
 
-    // 7. Compressed Entropy Data
+/**
+ * @brief Write EOI
+ */
+void JPEGCompressor::writeTrailer(OutputSink &out)
+{
+    out.put(0xFF);
+    out.put(0xD9);
+}
+
+/**
+ * @brief Entropy code one quantized block: DC difference then run-length coded AC
+ *
+ * @param block 64 quantized coefficients (row major)
+ * @param prevDC DC predictor of the component, updated
+ */
+void JPEGCompressor::encodeBlock(const int16_t *block, int &prevDC,
+                                 const HuffmanCode dcCodes[12], const HuffmanCode acCodes[256],
+                                 BitWriter &writer) const
+{
+    int zz[64];
+    std::pair<int, int> rle[64];
+
+    huffmanEncodeDC(block[0] - prevDC, writer, dcCodes);
+    prevDC = block[0];
+
+    zigzagScan(block, zz);
+    int count = runLengthEncode(zz, rle);
+    huffmanEncodeAC(rle, count, acCodes, writer);
+}
+
+/**
+ * @brief Entropy code one MCU: the lumaH x lumaV Y blocks row by row, then Cb and Cr
+ *   4:2:0 => Y00 Y01 Y10 Y11 Cb Cr, grayscale => a single Y block
+ *
+ * @param topLeft index of the top left Y block of the MCU, yStride Y blocks per row
+ * @param chroma index of the Cb and Cr blocks
+ * @param prevDC DC predictors of Y, Cb and Cr, updated
+ */
+void JPEGCompressor::encodeMCU(const BlockStore<int16_t> &y, const BlockStore<int16_t> &cb, const BlockStore<int16_t> &cr,
+                               size_t topLeft, size_t yStride, size_t chroma, int prevDC[3], BitWriter &writer) const
+{
+    for (int v = 0; v < lumaV; ++v)
+    {
+        for (int h = 0; h < lumaH; ++h)
+        {
+            encodeBlock(y[topLeft + v * yStride + h], prevDC[0], dcLumaCodes, acLumaCodes, writer);
+        }
+    }
+
+    if (componentCount == 3)
+    {
+        encodeBlock(cb[chroma], prevDC[1], dcChromaCodes, acChromaCodes, writer);
+        encodeBlock(cr[chroma], prevDC[2], dcChromaCodes, acChromaCodes, writer);
+    }
+}
+
+/**
+ * @brief Entropy code MCUs [first, last) of the block stores, DC predictors starting at 0
+ */
+void JPEGCompressor::encodeMCUs(size_t first, size_t last, BitWriter &writer) const
+{
+    size_t mcuColumns = mcuColumnCount();
+    size_t yBlocksPerRow = mcuColumns * lumaH;
+
+    int prevDC[3] = {0, 0, 0};
+    for (size_t m = first; m < last; ++m)
+    {
+        size_t my = m / mcuColumns;
+        size_t mx = m % mcuColumns;
+
+        size_t topLeft = my * lumaV * yBlocksPerRow + mx * lumaH;
+        encodeMCU(qBlocksY, qBlocksCb, qBlocksCr, topLeft, yBlocksPerRow, m, prevDC, writer);
+    }
+}
+
+/**
+ * @brief Count the symbols encodeBlock() would write for one block
+ *
+ * @param block 64 quantized coefficients (row major)
+ * @param prevDC DC predictor of the component, updated
+ * @param dcFreq DC category counts
+ * @param acFreq AC run/size counts (EOB = 0x00, ZRL = 0xF0)
+ */
+void JPEGCompressor::countBlock(const int16_t *block, int &prevDC, uint32_t dcFreq[256], uint32_t acFreq[256]) const
+{
+    int zz[64];
+
+    dcFreq[bitLength(std::abs(block[0] - prevDC))]++;
+    prevDC = block[0];
+
+    zigzagScan(block, zz);
+    int zeros = 0;
+    for (int i = 1; i < 64; ++i)
+    {
+        if (zz[i] == 0)
+        {
+            ++zeros;
+            continue;
+        }
+        while (zeros > 15)
+        {
+            acFreq[0xF0]++;
+            zeros -= 16;
+        }
+        acFreq[(zeros << 4) | bitLength(std::abs(zz[i]))]++;
+        zeros = 0;
+    }
+    if (zeros > 0)
+    {
+        acFreq[0x00]++;
+    }
+}
+
+/**
+ * @brief Symbol counts of MCUs [first, last), same traversal as encodeMCUs()
+ *   The DC predictors are taken from MCU first - 1 unless first starts a
+ *   restart segment, so any split of the MCUs gives the same total counts.
+ */
+void JPEGCompressor::countMCUs(size_t first, size_t last, HuffmanStatistics &stats) const
+{
+    size_t mcuColumns = mcuColumnCount();
+    size_t yBlocksPerRow = mcuColumns * lumaH;
+    size_t interval = restartInterval;
+    int h = lumaH, v = lumaV;
+
+    auto yTopLeft = [mcuColumns, yBlocksPerRow, h, v](size_t m)
+    {
+        return (m / mcuColumns) * v * yBlocksPerRow + (m % mcuColumns) * h;
+    };
 
     int prevY = 0, prevCb = 0, prevCr = 0;
-    size_t nMCUs = qBlocksY.size() / 4;
-    for (size_t m = 0; m < nMCUs; ++m)
+    if (first > 0 && (interval == 0 || first % interval != 0))
+    {
+        prevY = qBlocksY[yTopLeft(first - 1) + (v - 1) * yBlocksPerRow + h - 1][0];
+        if (componentCount == 3)
+        {
+            prevCb = qBlocksCb[first - 1][0];
+            prevCr = qBlocksCr[first - 1][0];
+        }
+    }
+
+    for (size_t m = first; m < last; ++m)
     {
-        // — Y 4:2:0 => 4 Y blocks per MCU
-        for (int i = 0; i < 4; ++i)
+        if (interval > 0 && m % interval == 0)
         {
-            auto &B = qBlocksY[m * 4 + i];
-            int diff = B[0][0] - prevY;
-            huffmanEncodeDC(diff, file, dcLumaCodes);
-            prevY = B[0][0];
-            huffmanEncodeAC(runLengthEncode(zigzagScan(B)), acLumaCodes, file);
+            prevY = prevCb = prevCr = 0;
         }
-        // — Cb
+
+        size_t topLeft = yTopLeft(m);
+        for (int dy = 0; dy < v; ++dy)
         {
-            auto &B = qBlocksCb[m];
-            int diff = B[0][0] - prevCb;
-            huffmanEncodeDC(diff, file, dcChromaCodes);
-            prevCb = B[0][0];
-            huffmanEncodeAC(runLengthEncode(zigzagScan(B)), acChromaCodes, file);
+            for (int dx = 0; dx < h; ++dx)
+            {
+                countBlock(qBlocksY[topLeft + dy * yBlocksPerRow + dx], prevY, stats.dcLuma, stats.acLuma);
+            }
         }
-        // — Cr
+
+        if (componentCount == 3)
         {
-            auto &B = qBlocksCr[m];
-            int diff = B[0][0] - prevCr;
-            huffmanEncodeDC(diff, file, dcChromaCodes);
-            prevCr = B[0][0];
-            huffmanEncodeAC(runLengthEncode(zigzagScan(B)), acChromaCodes, file);
+            countBlock(qBlocksCb[m], prevCb, stats.dcChroma, stats.acChroma);
+            countBlock(qBlocksCr[m], prevCr, stats.dcChroma, stats.acChroma);
         }
     }
+}
+
+/**
+ * @brief First pass of the optimized encode: symbol counts of the whole image
+ *   Chunks of MCUs are counted in parallel into their own histograms, then summed
+ */
+void JPEGCompressor::gatherStatistics(HuffmanStatistics &stats)
+{
+    const size_t CHUNK_MCUS = 512;
 
-    //Flush the buffer if needed
-    writeBits(0,0,file);
+    size_t totalMCUs = mcuColumnCount() * mcuRowCount();
+    size_t chunkCount = (totalMCUs + CHUNK_MCUS - 1) / CHUNK_MCUS;
+    std::vector<HuffmanStatistics> &partial = partialStatistics;
+    if (partial.size() < chunkCount)
+    {
+        partial.resize(chunkCount);
+    }
 
-    // 8. EOI
-    file.put(0xFF);
-    file.put(0xD9);
-    file.close();
+    parallelFor(chunkCount, 1, [this, totalMCUs, CHUNK_MCUS, &partial](size_t first, size_t last)
+                {
+        for (size_t c = first; c < last; ++c)
+        {
+            partial[c].clear();
+            countMCUs(c * CHUNK_MCUS, std::min(totalMCUs, (c + 1) * CHUNK_MCUS), partial[c]);
+        } });
+
+    stats.clear();
+    for (size_t c = 0; c < chunkCount; ++c)
+    {
+        stats.add(partial[c]);
+    }
+}
+
+void JPEGCompressor::setOptimizeHuffman(bool optimize)
+{
+    this->optimizeHuffman = optimize;
+}
+
+bool JPEGCompressor::getOptimizeHuffman() const
+{
+    return this->optimizeHuffman;
+}
+
+/**
+ * @brief Pick the tables written by writeHeaders()
+ *
+ * @param optimize true: tables built from the statistics of the quantized
+ *   blocks (needs compress()), false: Annex K example tables
+ */
+void JPEGCompressor::chooseHuffmanTables(bool optimize)
+{
+    if (!optimize)
+    {
+        dcLumaTable = standardDCLuminanceTable();
+        acLumaTable = standardACLuminanceTable();
+        dcChromaTable = standardDCChrominanceTable();
+        acChromaTable = standardACChrominanceTable();
+        return;
+    }
+
+    HuffmanStatistics stats;
+    gatherStatistics(stats);
+    buildOptimalHuffmanTable(stats.dcLuma, dcLumaTable);
+    buildOptimalHuffmanTable(stats.acLuma, acLumaTable);
+    buildOptimalHuffmanTable(stats.dcChroma, dcChromaTable);
+    buildOptimalHuffmanTable(stats.acChroma, acChromaTable);
+}
+
+void JPEGCompressor::setRestartInterval(int mcus)
+{
+    this->restartInterval = std::max(0, std::min(mcus, 0xFFFF));
+}
+
+int JPEGCompressor::getRestartInterval() const
+{
+    return this->restartInterval;
+}
+
+void JPEGCompressor::setProgressive(bool enable)
+{
+    this->progressive = enable;
+}
+
+bool JPEGCompressor::getProgressive() const
+{
+    return this->progressive;
+}
+
+bool JPEGCompressor::setScanScript(const std::vector<ScanInfo> &script)
+{
+    if (script.empty())
+    {
+        this->scanScript.clear();
+        return true;
+    }
 
-    std::cout << "JPEG successfully written to: " << filename << std::endl;
-}
\ No newline at end of file
+    std::string error;
+    if (!validateScanScript(script, componentCount, error))
+    {
+        std::cerr << "Invalid scan script, " << error << std::endl;
+        return false;
+    }
+    this->scanScript = script;
+    return true;
+}
+
+/**
+ * @brief Script writeProgressiveScans() codes: the one set by setScanScript(),
+ *   or the default one if none is set or it does not fit the current
+ *   subsampling (a script set for another component count)
+ *
+ * @param error receives why the stored script was rejected (empty otherwise)
+ */
+const std::vector<ScanInfo> &JPEGCompressor::progressiveScript(std::string &error) const
+{
+    // Built once for every encoder
+    static const std::vector<ScanInfo> defaultGrayscale = defaultScanScript(1);
+    static const std::vector<ScanInfo> defaultColor = defaultScanScript(3);
+
+    error.clear();
+    if (!scanScript.empty() && validateScanScript(scanScript, componentCount, error))
+    {
+        return scanScript;
+    }
+    return componentCount == 1 ? defaultGrayscale : defaultColor;
+}
+
+/**
+ * @brief Write the scans of a progressive file (DHT, SOS and data of each)
+ *   Scans only read the quantized blocks: they are coded in parallel, then
+ *   written in script order.
+ */
+void JPEGCompressor::writeProgressiveScans(OutputSink &out)
+{
+    size_t mcuColumns = mcuColumnCount();
+    size_t mcuRows = mcuRowCount();
+    size_t chromaWidth = chromaPlaneWidth();
+    size_t chromaHeight = chromaPlaneHeight();
+
+    const ComponentBlocks components[3] = {
+        {&qBlocksY, mcuColumns * lumaH, (static_cast<size_t>(width) + 7) / 8, (static_cast<size_t>(height) + 7) / 8, lumaH, lumaV, 0},
+        {&qBlocksCb, mcuColumns, (chromaWidth + 7) / 8, (chromaHeight + 7) / 8, 1, 1, 1},
+        {&qBlocksCr, mcuColumns, (chromaWidth + 7) / 8, (chromaHeight + 7) / 8, 1, 1, 1}};
+    ProgressiveEncoder encoder(components, componentCount, mcuColumns, mcuRows, restartInterval);
+
+    std::string error;
+    const std::vector<ScanInfo> &script = progressiveScript(error);
+    if (!error.empty())
+    {
+        std::cerr << "Scan script ignored, " << error << std::endl;
+    }
+    std::vector<EncodedScan> &scans = progressiveScans;
+    if (scans.size() < script.size())
+    {
+        scans.resize(script.size());
+    }
+
+    parallelFor(script.size(), 1, [&encoder, &script, &scans](size_t first, size_t last)
+                {
+        for (size_t s = first; s < last; ++s)
+        {
+            encoder.encodeScan(script[s], scans[s]);
+        } });
+
+    for (size_t s = 0; s < script.size(); ++s)
+    {
+        const ScanInfo &scan = script[s];
+        for (int t = 0; t < 2; ++t)
+        {
+            if (scans[s].usesDC[t])
+            {
+                writeHuffmanTable(out, scans[s].dcTables[t], 0, t);
+            }
+            if (scans[s].usesAC[t])
+            {
+                writeHuffmanTable(out, scans[s].acTables[t], 1, t);
+            }
+        }
+
+        // SOS: table selectors are only meaningful for the tables the scan uses
+        int length = 6 + 2 * scan.componentCount;
+        out.put(0xFF);
+        out.put(0xDA);
+        out.put((length >> 8) & 0xFF);
+        out.put(length & 0xFF);
+        out.put(scan.componentCount);
+        for (int i = 0; i < scan.componentCount; ++i)
+        {
+            int table = components[scan.components[i]].tableID;
+            out.put(scan.components[i] + 1);
+            out.put(scan.Ss == 0 ? (table << 4) : table);
+        }
+        out.put(scan.Ss);
+        out.put(scan.Se);
+        out.put((scan.Ah << 4) | scan.Al);
+
+        out.write(scans[s].data.data(), scans[s].data.size());
+
+        // Stats: an AC scan has one component, a DC scan is shared by blocks per MCU
+        if (stats != nullptr)
+        {
+            uint64_t bits = 8 * static_cast<uint64_t>(scans[s].data.size());
+            stats->entropyBytes += scans[s].data.size();
+            if (scan.Ss > 0)
+            {
+                stats->components[scan.components[0]].acBits += bits;
+                continue;
+            }
+            int weight = 0;
+            for (int i = 0; i < scan.componentCount; ++i)
+            {
+                weight += components[scan.components[i]].h * components[scan.components[i]].v;
+            }
+            for (int i = 0; i < scan.componentCount; ++i)
+            {
+                const ComponentBlocks &component = components[scan.components[i]];
+                stats->components[scan.components[i]].dcBits += bits * component.h * component.v / weight;
+            }
+        }
+    }
+}
+
+void JPEGCompressor::writeJPEGFile(const std::string &filename)
+{
+    FileSink file(filename);
+    if (!file.isOpen())
+    {
+        return;
+    }
+
+    if (encode(file))
+    {
+        std::cout << "JPEG successfully written to: " << filename << std::endl;
+    }
+    else
+    {
+        std::cerr << "Error while writing: " << filename << std::endl;
+    }
+}
+
+/**
+ * @brief Write the file of the compressed image (after compress()) to out
+ *
+ * @return false if the sink failed (e.g. fixed buffer too small)
+ */
+bool JPEGCompressor::encode(OutputSink &out)
+{
+    if (stats != nullptr)
+    {
+        // A second encode of the same compress() replaces the figures of the first
+        for (ComponentStats &component : stats->components)
+        {
+            component = ComponentStats();
+        }
+        stats->stageSeconds[static_cast<int>(EncodeStage::HuffmanTables)] = 0;
+        stats->stageSeconds[static_cast<int>(EncodeStage::Entropy)] = 0;
+        stats->entropyBytes = 0;
+    }
+
+    // Two passes when optimizing: count symbols, then encode with the tuned tables
+    {
+        StageTimer timer(stats, EncodeStage::HuffmanTables);
+        chooseHuffmanTables(optimizeHuffman && !progressive);
+    }
+
+    StageTimer timer(stats, EncodeStage::Entropy);
+    size_t start = out.bytesWritten();
+    writeHeaders(out, progressive);
+    size_t entropyStart = out.bytesWritten();
+
+    // 7. Compressed Entropy Data
+    size_t totalMCUs = mcuColumnCount() * mcuRowCount();
+
+    if (progressive)
+    {
+        writeProgressiveScans(out);
+    }
+    else if (restartInterval == 0)
+    {
+        entropyWriter.clear();
+        encodeMCUs(0, totalMCUs, entropyWriter);
+        entropyWriter.flush();
+        out.write(entropyWriter.data(), entropyWriter.size());
+    }
+    else
+    {
+        // Restart segments are independent (predictors reset, byte aligned):
+        // each one is coded on a pool thread into its own buffer
+        size_t interval = restartInterval;
+        size_t segmentCount = (totalMCUs + interval - 1) / interval;
+        std::vector<BitWriter> &segments = restartSegments;
+        if (segments.size() < segmentCount)
+        {
+            segments.resize(segmentCount);
+        }
+
+        parallelFor(segmentCount, 1, [this, interval, totalMCUs, &segments](size_t first, size_t last)
+                    {
+            for (size_t seg = first; seg < last; ++seg)
+            {
+                segments[seg].clear();
+                encodeMCUs(seg * interval, std::min(totalMCUs, (seg + 1) * interval), segments[seg]);
+                segments[seg].flush();
+            } });
+
+        // Concatenate in order, RST0..RST7 between segments
+        for (size_t seg = 0; seg < segmentCount; ++seg)
+        {
+            out.write(segments[seg].data(), segments[seg].size());
+            if (seg + 1 < segmentCount)
+            {
+                out.put(0xFF);
+                out.put(0xD0 + (seg & 7));
+            }
+        }
+    }
+
+    size_t entropyEnd = out.bytesWritten();
+
+    // 8. EOI
+    writeTrailer(out);
+    bool written = out.flush();
+    timer.stop();
+
+    if (stats != nullptr)
+    {
+        // Progressive: entropy bytes and bits counted per scan by writeProgressiveScans()
+        if (!progressive)
+        {
+            stats->entropyBytes = entropyEnd - entropyStart;
+        }
+        stats->headerBytes = out.bytesWritten() - start - stats->entropyBytes;
+
+        StatsSymbols symbols;
+        size_t mcuColumns = mcuColumnCount();
+        size_t yBlocksPerRow = mcuColumns * lumaH;
+        int prevDC[3] = {0, 0, 0};
+        for (size_t m = 0; m < totalMCUs; ++m)
+        {
+            if (restartInterval > 0 && m % restartInterval == 0)
+            {
+                prevDC[0] = prevDC[1] = prevDC[2] = 0;
+            }
+            size_t topLeft = (m / mcuColumns) * lumaV * yBlocksPerRow + (m % mcuColumns) * lumaH;
+            accountMCU(qBlocksY, qBlocksCb, qBlocksCr, topLeft, yBlocksPerRow, m, prevDC, symbols);
+        }
+        if (!progressive)
+        {
+            finishStats(symbols);
+        }
+    }
+    return written;
+}
+
+/**
+ * @brief Upper bound of the size of the file encode() or encodeStreaming()
+ *   writes with the current dimensions and settings (subsampling, restart
+ *   interval, progressive script), whatever the pixels and the quality
+ *
+ *   Per block and per scan, each coefficient of the band costs at most a
+ *   16-bit code and 11 - Al magnitude bits in a first pass, a 16-bit code, a
+ *   sign bit and a correction bit in an AC refinement (1 bit for DC), plus 30
+ *   bits for an EOB run; every byte may be followed by a stuffed 0x00. On
+ *   top of that come the markers: headers, 4 Huffman tables and a SOS per
+ *   scan, RSTn markers and their padding.
+ */
+size_t JPEGCompressor::maxEncodedSize() const
+{
+    size_t mcus = mcuColumnCount() * mcuRowCount();
+    size_t blocks[3] = {mcus * lumaH * lumaV, mcus, mcus};
+
+    // SOI, DQT, SOF (3 components), DRI, EOI
+    size_t size = 2 + 2 * 69 + 19 + 6 + 2;
+
+    std::vector<ScanInfo> script;
+    if (progressive)
+    {
+        std::string error;
+        script = progressiveScript(error);
+    }
+    else
+    {
+        ScanInfo baseline = {componentCount, {0, 1, 2, 0}, 0, 63, 0, 0};
+        script.push_back(baseline);
+    }
+
+    for (const ScanInfo &scan : script)
+    {
+        size_t band = scan.Se - scan.Ss + 1;
+        size_t coefficientBits = scan.Ah == 0 ? 16 + 11 - scan.Al : (scan.Ss == 0 ? 1 : 18);
+        size_t blockBytes = 2 * ((coefficientBits * band + 30 + 7) / 8);
+        size_t scanBlocks = 0;
+        for (int i = 0; i < scan.componentCount; ++i)
+        {
+            scanBlocks += blocks[scan.components[i]];
+        }
+
+        // Restart intervals count MCUs, single component scans count blocks
+        size_t units = scan.componentCount > 1 ? mcus : scanBlocks;
+        size_t segments = restartInterval > 0 ? (units + restartInterval - 1) / restartInterval : 1;
+
+        size_t tables = 4 * (5 + 16 + 256);
+        size_t sos = 6 + 2 * 4 + 2;
+        size_t data = scanBlocks * blockBytes + segments * (2 + 1);
+        size += tables + sos + data;
+    }
+    return size;
+}
+
+/**
+ * @brief Size of the file encode() would write from the current quantized
+ *   blocks, without writing it
+ *   Baseline: symbol counts times code lengths (the tables encode() would
+ *   pick), restart markers and their padding, headers. Stuffed 0x00 bytes
+ *   cannot be known without the bits, so the file may be a little larger.
+ *   Progressive: the scans are coded and only counted (exact size).
+ */
+size_t JPEGCompressor::estimateEncodedSize()
+{
+    if (progressive)
+    {
+        CallbackSink counter([](const uint8_t *, size_t)
+                             { return true; });
+        EncodeStats *saved = stats;
+        stats = nullptr;
+        encode(counter);
+        stats = saved;
+        return counter.bytesWritten();
+    }
+
+    HuffmanStatistics symbols;
+    gatherStatistics(symbols);
+    if (optimizeHuffman)
+    {
+        buildOptimalHuffmanTable(symbols.dcLuma, dcLumaTable);
+        buildOptimalHuffmanTable(symbols.acLuma, acLumaTable);
+        buildOptimalHuffmanTable(symbols.dcChroma, dcChromaTable);
+        buildOptimalHuffmanTable(symbols.acChroma, acChromaTable);
+    }
+    else
+    {
+        chooseHuffmanTables(false);
+    }
+
+    // Headers (they also build the code maps)
+    CallbackSink counter([](const uint8_t *, size_t)
+                         { return true; });
+    writeHeaders(counter, progressive);
+    writeTrailer(counter);
+    counter.flush();
+
+    // Code + magnitude bits: the low nibble of a symbol is its magnitude size
+    auto bitsOf = [](const uint32_t freq[256], const HuffmanCode codes[], int count)
+    {
+        uint64_t bits = 0;
+        for (int s = 0; s < count; ++s)
+        {
+            bits += static_cast<uint64_t>(freq[s]) * (codes[s].length + (s & 0x0F));
+        }
+        return bits;
+    };
+    uint64_t bits = bitsOf(symbols.dcLuma, dcLumaCodes, 12) + bitsOf(symbols.acLuma, acLumaCodes, 256);
+    if (componentCount == 3)
+    {
+        bits += bitsOf(symbols.dcChroma, dcChromaCodes, 12) + bitsOf(symbols.acChroma, acChromaCodes, 256);
+    }
+
+    // Each restart segment is padded to a byte, then RSTn
+    size_t totalMCUs = mcuColumnCount() * mcuRowCount();
+    size_t segments = restartInterval > 0 ? (totalMCUs + restartInterval - 1) / restartInterval : 1;
+    return counter.bytesWritten() + (bits + 7) / 8 + (segments - 1) * 3;
+}
+
+/**
+ * @brief Encode at the highest quality whose file fits in maxBytes
+ *   Conversion and DCT run once; each step of the binary search over the
+ *   quality only requantizes the kept coefficients and counts the symbols
+ *   (estimateEncodedSize()). The chosen quality is then encoded in memory,
+ *   one step lower while stuffing makes it overflow, and handed to out.
+ *   The integer engine quantizes inside its DCT: the fast one runs instead.
+ *   getQuality() gives the quality used.
+ *
+ * @return false if quality 1 does not fit (nothing written) or the sink failed
+ */
+bool JPEGCompressor::encodeToSize(OutputSink &out, size_t maxBytes)
+{
+    int callerQuality = quality;
+    beginStats();
+    computeCoefficients();
+
+    auto quantizeAt = [this](int q)
+    {
+        StageTimer timer(stats, EncodeStage::Quantize);
+        setQuality(q);
+        // Float coefficients whatever the DCT mode (the integer engine was not run)
+        quantizeAllBlocks(blocksY, blocksCb, blocksCr);
+    };
+
+    int low = 1, high = 100, best = 0;
+    while (low <= high)
+    {
+        int mid = (low + high) / 2;
+        quantizeAt(mid);
+        StageTimer timer(stats, EncodeStage::HuffmanTables);
+        if (estimateEncodedSize() <= maxBytes)
+        {
+            best = mid;
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+
+    // encode() times its own table choice: keep the search on top of it
+    double searchSeconds = stats != nullptr ? stats->stageSeconds[static_cast<int>(EncodeStage::HuffmanTables)] : 0;
+    for (int q = best; q >= 1; --q)
+    {
+        if (q != quality)
+        {
+            quantizeAt(q);
+        }
+        // No file is larger than maxEncodedSize(), whatever the budget
+        MemorySink fitted(std::min(maxBytes, maxEncodedSize()));
+        if (encode(fitted) && fitted.buffer().size() <= maxBytes)
+        {
+            if (stats != nullptr)
+            {
+                stats->quality = quality;
+                stats->stageSeconds[static_cast<int>(EncodeStage::HuffmanTables)] += searchSeconds;
+            }
+            out.write(fitted.buffer().data(), fitted.buffer().size());
+            return out.flush();
+        }
+    }
+
+    // Nothing fits: the encoder keeps the caller's quality
+    setQuality(callerQuality);
+    return false;
+}
+
+/**
+ * @brief Conversion, blocks and DCT, leaving the coefficients in blocks*
+ *   for several quantizations (the integer engine, which quantizes inside
+ *   its DCT, is replaced by the fast one)
+ */
+void JPEGCompressor::computeCoefficients()
+{
+    DCTMode mode = dctMode;
+    if (dctMode == DCTMode::Integer)
+    {
+        dctMode = DCTMode::Fast;
+    }
+    {
+        StageTimer timer(stats, EncodeStage::Convert);
+        convertImage();
+    }
+    {
+        StageTimer timer(stats, EncodeStage::Split);
+        splitIntoBlocks();
+    }
+    {
+        StageTimer timer(stats, EncodeStage::Transform);
+        applyDCTToAllBlocks();
+    }
+    dctMode = mode;
+}
+
+/**
+ * @brief Several files of the image from one conversion and one DCT
+ *   Every rendition gets its own back end (an encoder with the settings of
+ *   this one, its quality, Huffman mode and output) that quantizes the
+ *   shared coefficients and codes them; back ends run in parallel on the
+ *   pool, their inner stages inline on the same worker. The back ends are
+ *   kept and reset by the next call, so their buffers are reused too.
+ */
+bool JPEGCompressor::encodeRenditions(std::vector<Rendition> &renditions)
+{
+    beginStats();
+    computeCoefficients();
+
+    while (renditionBackEnds.size() < renditions.size())
+    {
+        renditionBackEnds.push_back(std::make_unique<JPEGCompressor>());
+    }
+
+    parallelFor(renditions.size(), 1, [this, &renditions](size_t first, size_t last)
+                {
+        for (size_t r = first; r < last; ++r)
+        {
+            Rendition &rendition = renditions[r];
+            JPEGCompressor &backEnd = *renditionBackEnds[r];
+            backEnd.reset(source);
+            backEnd.setSubsampling(subsampling);
+            backEnd.setRestartInterval(restartInterval);
+            backEnd.setTrellisQuantization(trellis);
+            backEnd.setTrellisLambda(trellisLambda);
+            backEnd.setThreadPool(threadPool);
+            backEnd.setMaxThreads(maxThreads);
+            backEnd.scanScript = scanScript;
+            backEnd.setQuality(rendition.quality);
+            backEnd.setOptimizeHuffman(rendition.optimizeHuffman);
+            backEnd.setProgressive(rendition.progressive);
+            backEnd.setStats(rendition.stats);
+
+            backEnd.beginStats();
+            {
+                StageTimer timer(rendition.stats, EncodeStage::Quantize);
+                backEnd.quantizeAllBlocks(blocksY, blocksCb, blocksCr);
+            }
+            rendition.written = rendition.out != nullptr && backEnd.encode(*rendition.out);
+        } });
+
+    bool written = true;
+    for (const Rendition &rendition : renditions)
+    {
+        written = written && rendition.written;
+    }
+    return written;
+}
+
+/**
+ * @brief Streaming encoder: the whole pipeline, one MCU row (16 scanlines) at a time
+ *   Only strips of the current MCU row are kept: its converted scanlines (16
+ *   for 4:2:0), their 8 subsampled chroma scanlines and the blocks of the row. Working memory
+ *   grows with the width of the image, not its area. Output is the same as
+ *   compress() followed by writeJPEGFile().
+ *
+ *   Single pass, so the Annex K tables are always used (optimizeHuffman is ignored).
+ *
+ * @param filename output path
+ */
+void JPEGCompressor::writeJPEGFileStreaming(const std::string &filename)
+{
+    FileSink file(filename);
+    if (!file.isOpen())
+    {
+        return;
+    }
+
+    if (encodeStreaming(file))
+    {
+        std::cout << "JPEG successfully written to: " << filename << std::endl;
+    }
+    else
+    {
+        std::cerr << "Error while writing: " << filename << std::endl;
+    }
+}
+
+/**
+ * @brief Streaming encode to any sink, see writeJPEGFileStreaming()
+ *   The bytes of every MCU row are handed over as soon as they are coded, and
+ *   the encode stops early if the sink fails. The file is always baseline.
+ *
+ * @return false if the sink failed
+ */
+bool JPEGCompressor::encodeStreaming(OutputSink &out)
+{
+    beginStats();
+    if (stats != nullptr)
+    {
+        stats->progressive = false;
+    }
+    StatsSymbols symbols;
+    int statsDC[3] = {0, 0, 0};
+    uint64_t entropyBytes = 0;
+
+    {
+        StageTimer timer(stats, EncodeStage::HuffmanTables);
+        chooseHuffmanTables(false);
+    }
+    size_t start = out.bytesWritten();
+    {
+        StageTimer timer(stats, EncodeStage::Entropy);
+        // Sequential by nature: SOF0 whatever setProgressive() says
+        writeHeaders(out, false);
+    }
+
+    int mcuColumns = mcuColumnCount();
+    int mcuRows = mcuRowCount();
+    int mcuHeight = 8 * lumaV;
+    int chromaWidth = chromaPlaneWidth();
+    size_t yBlocksPerRow = static_cast<size_t>(mcuColumns) * lumaH;
+    bool color = componentCount == 3;
+
+    // Strip buffers, reused for every MCU row: the planes and block stores
+    // of the encoder, so a reused encoder keeps them from one image to the next
+    std::vector<uint8_t> &stripY = Y;
+    std::vector<uint8_t> &stripCb = Cb_sub;
+    std::vector<uint8_t> &stripCr = Cr_sub;
+    stripY.resize(mcuHeight * static_cast<size_t>(width));
+    stripCb.resize(color ? 8 * static_cast<size_t>(chromaWidth) : 0);
+    stripCr.resize(color ? 8 * static_cast<size_t>(chromaWidth) : 0);
+
+    BlockStore<double> &rowBlocksY = blocksY, &rowBlocksCb = blocksCb, &rowBlocksCr = blocksCr;
+    BlockStore<int16_t> &rowQBlocksY = qBlocksY, &rowQBlocksCb = qBlocksCb, &rowQBlocksCr = qBlocksCr;
+    rowBlocksY.resize(yBlocksPerRow * lumaV);
+    rowBlocksCb.resize(color ? mcuColumns : 0);
+    rowBlocksCr.resize(color ? mcuColumns : 0);
+
+    TrellisCosts lumaCosts, chromaCosts;
+    if (trellis)
+    {
+        trellisCosts(lumaCosts, chromaCosts);
+    }
+
+    BitWriter &writer = entropyWriter;
+    writer.clear();
+    size_t totalMCUs = static_cast<size_t>(mcuColumns) * mcuRows;
+    size_t mcuCount = 0;
+    int restartIndex = 0;
+
+    int prevDC[3] = {0, 0, 0};
+    for (int my = 0; my < mcuRows; ++my)
+    {
+        // 1. Colour conversion and subsampling of the scanlines of this MCU row
+        //    (same code as convertImage())
+        int rows = std::min(mcuHeight, height - my * mcuHeight);
+        int chromaRows = (rows + lumaV - 1) / lumaV;
+        StageTimer convertTimer(stats, EncodeStage::Convert);
+        convertRows(my * mcuHeight, my * mcuHeight + rows, stripY.data(), stripCb.data(), stripCr.data());
+        convertTimer.stop();
+
+        // 2. 8x8 blocks of the row, clamped to the image edge
+        auto splitStrip = [](const std::vector<uint8_t> &strip, int stripWidth, int stripRows,
+                             BlockStore<double> &blocks, size_t blocksPerRow, int blockRows)
+        {
+            for (int by = 0; by < blockRows; by++)
+            {
+                for (size_t bx = 0; bx < blocksPerRow; bx++)
+                {
+                    double *block = blocks[by * blocksPerRow + bx];
+                    for (int dy = 0; dy < 8; dy++)
+                    {
+                        int yy = std::min(by * 8 + dy, stripRows - 1);
+                        for (int dx = 0; dx < 8; dx++)
+                        {
+                            int xx = std::min(static_cast<int>(bx) * 8 + dx, stripWidth - 1);
+                            block[dy * 8 + dx] = strip[yy * stripWidth + xx];
+                        }
+                    }
+                }
+            }
+        };
+
+        StageTimer splitTimer(stats, EncodeStage::Split);
+        splitStrip(stripY, width, rows, rowBlocksY, yBlocksPerRow, lumaV);
+        if (color)
+        {
+            splitStrip(stripCb, chromaWidth, chromaRows, rowBlocksCb, mcuColumns, 1);
+            splitStrip(stripCr, chromaWidth, chromaRows, rowBlocksCr, mcuColumns, 1);
+        }
+        splitTimer.stop();
+
+        // 3. DCT + quantization of the row (one stage for the stats)
+        StageTimer transformTimer(stats, EncodeStage::Transform);
+        if (dctMode == DCTMode::Integer && !trellis && !blockMemoization)
+        {
+            integerDCTQuantizeChannel(rowBlocksY, rowQBlocksY, quantTables->luminance);
+            integerDCTQuantizeChannel(rowBlocksCb, rowQBlocksCb, quantTables->chrominance);
+            integerDCTQuantizeChannel(rowBlocksCr, rowQBlocksCr, quantTables->chrominance);
+        }
+        else
+        {
+            auto transformStrip = [this](BlockStore<double> &blocks, BlockStore<int16_t> &qBlocks,
+                                         const QuantizationTable &table, const TrellisCosts &costs,
+                                         std::vector<uint32_t> &sources)
+            {
+                qBlocks.resize(blocks.size());
+                if (!blockMemoization)
+                {
+                    for (size_t i = 0; i < blocks.size(); ++i)
+                    {
+                        applyDCT(blocks[i], blocks[i]);
+                        quantizeBlock(blocks[i], table, costs, qBlocks[i]);
+                    }
+                    return;
+                }
+
+                // Memoized within the row, MEMO_BLOCKS blocks at a time
+                sources.resize(blocks.size());
+                for (size_t first = 0; first < blocks.size(); first += MEMO_BLOCKS)
+                {
+                    size_t last = std::min(blocks.size(), first + MEMO_BLOCKS);
+                    transformBlocks(blocks, first, last, sources.data());
+                    quantizeBlocks(blocks, qBlocks, first, last, table, costs, sources.data());
+                }
+                countMemoizedBlocks(sources);
+            };
+            transformStrip(rowBlocksY, rowQBlocksY, quantTables->luminance, lumaCosts, blockSources[0]);
+            transformStrip(rowBlocksCb, rowQBlocksCb, quantTables->chrominance, chromaCosts, blockSources[1]);
+            transformStrip(rowBlocksCr, rowQBlocksCr, quantTables->chrominance, chromaCosts, blockSources[2]);
+        }
+        transformTimer.stop();
+
+        // 4. Entropy coding in MCU order, restart markers every restartInterval MCUs
+        StageTimer entropyTimer(stats, EncodeStage::Entropy);
+        for (int mx = 0; mx < mcuColumns; ++mx)
+        {
+            encodeMCU(rowQBlocksY, rowQBlocksCb, rowQBlocksCr, static_cast<size_t>(mx) * lumaH, yBlocksPerRow, mx, prevDC, writer);
+
+            ++mcuCount;
+            if (restartInterval > 0 && mcuCount % restartInterval == 0 && mcuCount < totalMCUs)
+            {
+                writer.writeMarker(0xD0 + (restartIndex++ & 7));
+                prevDC[0] = prevDC[1] = prevDC[2] = 0;
+            }
+        }
+
+        // Hand the finished bytes of the row to the sink
+        out.write(writer.data(), writer.size());
+        entropyBytes += writer.size();
+        writer.clearBytes();
+        entropyTimer.stop();
+        if (out.failed())
+        {
+            return false;
+        }
+
+        if (stats != nullptr)
+        {
+            for (int mx = 0; mx < mcuColumns; ++mx)
+            {
+                size_t m = static_cast<size_t>(my) * mcuColumns + mx;
+                if (restartInterval > 0 && m % restartInterval == 0)
+                {
+                    statsDC[0] = statsDC[1] = statsDC[2] = 0;
+                }
+                accountMCU(rowQBlocksY, rowQBlocksCb, rowQBlocksCr, static_cast<size_t>(mx) * lumaH, yBlocksPerRow, mx, statsDC, symbols);
+            }
+        }
+    }
+
+    StageTimer entropyTimer(stats, EncodeStage::Entropy);
+    writer.flush();
+    out.write(writer.data(), writer.size());
+    entropyBytes += writer.size();
+
+    writeTrailer(out);
+    bool written = out.flush();
+    entropyTimer.stop();
+
+    if (stats != nullptr)
+    {
+        stats->entropyBytes = entropyBytes;
+        stats->headerBytes = out.bytesWritten() - start - entropyBytes;
+        finishStats(symbols);
+    }
+    return written;
+}
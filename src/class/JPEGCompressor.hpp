@@ -8,6 +8,19 @@
 #include <string>
 #include <iostream>
 #include "imageExtension/PPMImage.hpp"
+#include "DCT.hpp"
+#include "ColorConvert.hpp"
+#include "ImageView.hpp"
+#include "OutputSink.hpp"
+#include "BlockStore.hpp"
+#include "BitWriter.hpp"
+#include "Huffman.hpp"
+#include "ProgressiveEncoder.hpp"
+#include "ThreadPool.hpp"
+#include "EncodeStats.hpp"
+#include "Trellis.hpp"
+#include <functional>
+#include <memory>
 #include <cmath>
 #include <iomanip>
 #include <bitset> // for binary simulation
@@ -21,39 +34,152 @@ struct YCbCrPixel
     double cr;
 };
 
-// A helper struct:
-struct HuffmanCode
+/**
+ * @brief Sampling layout of the output
+ *   Luma has H x V blocks per MCU, Cb and Cr one block each (their planes are
+ *   divided by H and V). Grayscale writes the Y component alone.
+ */
+enum class Subsampling
 {
-    uint16_t code; // left-aligned bits
-    uint8_t length;
+    Mode444,  // H=1 V=1, full resolution chroma
+    Mode422,  // H=2 V=1, chroma halved horizontally
+    Mode420,  // H=2 V=2, chroma halved both ways
+    Mode440,  // H=1 V=2, chroma halved vertically
+    Grayscale // Y only, one block per MCU
+};
+
+/**
+ * @brief One output of JPEGCompressor::encodeRenditions()
+ */
+struct Rendition
+{
+    int quality = 50;
+    bool optimizeHuffman = false;
+    bool progressive = false;
+    OutputSink *out = nullptr;
+    EncodeStats *stats = nullptr; // quantization and coding of this rendition (optional)
+    bool written = false;         // set by encodeRenditions()
 };
 
 class JPEGCompressor
 {
 public:
-    uint8_t bitBuffer = 0;
-    int bitCount = 0;
-    std::ofstream out; // your open file stream
+    /**
+     * @brief Encoder reading the image's pixels in place (no copy): the image
+     *   must outlive the compressor
+     */
     JPEGCompressor(Image &image);
+
+    /**
+     * @brief Encoder reading a caller's buffer in place (any PixelFormat and
+     *   row stride): the buffer must outlive the compressor
+     */
+    JPEGCompressor(const ImageView &view);
+
+    /**
+     * @brief Encoder without an image yet, see reset()
+     */
+    JPEGCompressor();
+
+    /**
+     * @brief Encode another image with the same encoder, settings kept
+     *   Every buffer (planes, block stores, entropy output, Huffman
+     *   statistics, progressive scans) keeps its capacity and only grows when
+     *   a larger image arrives: an encoder reset image after image makes no
+     *   heap allocation once its buffers fit. Stages spread over several pool
+     *   threads still allocate the pool's job bookkeeping, setMaxThreads(1)
+     *   (one encoder per worker thread) avoids it. The pixels must outlive
+     *   the encodes, as with the constructors.
+     */
+    void reset(Image &image);
+    void reset(const ImageView &view);
     void compress(void);
-    const std::vector<std::vector<int>> &getQuantizedYBlock(int index) const;
+    const int16_t *getQuantizedYBlock(int index) const;
 
     void convertToYCbCr();
     void subsample420();
+    void convertImage();
+    void convertRows(int firstRow, int lastRow, uint8_t *y, uint8_t *cb, uint8_t *cr) const;
     void splitIntoBlocks();
 
+    /**
+     * @brief Chroma sampling (4:2:0 by default) or grayscale, used by every encode path
+     *   Call before compress()
+     */
+    void setSubsampling(Subsampling mode);
+    Subsampling getSubsampling() const;
+
+    Subsampling subsampling = Subsampling::Mode420;
+    int lumaH = 2;          // Y blocks per MCU, horizontally
+    int lumaV = 2;          // and vertically
+    int componentCount = 3; // 1 for grayscale
+
+    size_t mcuColumnCount() const;
+    size_t mcuRowCount() const;
+    int chromaPlaneWidth() const;
+    int chromaPlaneHeight() const;
+
     void applyDCTToAllBlocks();
-    std::vector<std::vector<int>> quantizeBlock(const std::vector<std::vector<double>> &block, const uint8_t table[8][8]);
+    void quantizeBlock(const double *block, const QuantizationTable &table, int16_t *out) const;
+    void quantizeBlock(const double *block, const QuantizationTable &table, const TrellisCosts &costs, int16_t *out) const;
     void quantizeAllBlocks();
+    void quantizeAllBlocks(const BlockStore<double> &coefficientsY, const BlockStore<double> &coefficientsCb,
+                           const BlockStore<double> &coefficientsCr);
+
+    /**
+     * @brief Rate-distortion optimized quantization (off by default)
+     *   Each block's AC coefficients are chosen by trellisQuantizeBlock(),
+     *   bits priced with the Annex K tables. Slower quantization, smaller
+     *   files at the same PSNR. The integer DCT engine is replaced by the
+     *   fast one, which gives the trellis the unquantized coefficients.
+     */
+    void setTrellisQuantization(bool enable);
+    bool getTrellisQuantization() const;
+
+    /**
+     * @brief Weight of a bit, in mean squared quantization steps (0.02 by
+     *   default; higher = smaller files, lower PSNR)
+     */
+    void setTrellisLambda(double lambda);
+    double getTrellisLambda() const;
+
+    void trellisCosts(TrellisCosts &luma, TrellisCosts &chroma) const;
 
-    std::vector<int> zigzagScan(const std::vector<std::vector<int>> &block);
+    bool trellis = false;
+    double trellisLambda = 0.02;
 
-    std::vector<std::pair<int, int>> runLengthEncode(const std::vector<int> &zigzaggedBlock);
+    /**
+     * @brief Skip the work of uniform and repeated blocks (off by default),
+     *   for screenshots, UI captures and scanned documents
+     *   A uniform block gets its DC-only coefficients directly; a block whose
+     *   8x8 samples match a recent one of its component (small cache of the
+     *   raw samples, MEMO_BLOCKS blocks per cache) copies that block's
+     *   coefficients and quantized values instead of being transformed and
+     *   quantized. The file is the same as without memoization. The integer
+     *   DCT engine is replaced by the fast one.
+     */
+    void setBlockMemoization(bool enable);
+    bool getBlockMemoization() const;
 
-    void huffmanEncodeDC(int dcDiff, ofstream& file, HuffmanCode dcLumaCodes[12]);
-    void huffmanEncodeAC(const std::vector<std::pair<int, int>> &rle,
+    void transformBlocks(BlockStore<double> &blocks, size_t first, size_t last, uint32_t *sources);
+    void quantizeBlocks(const BlockStore<double> &blocks, BlockStore<int16_t> &qBlocks, size_t first, size_t last,
+                        const QuantizationTable &table, const TrellisCosts &costs, const uint32_t *sources) const;
+    void countMemoizedBlocks(const std::vector<uint32_t> &sources);
+
+    bool blockMemoization = false;
+    // Per component (Y, Cb, Cr), filled by a memoized transform: each block's
+    // own index, FLAT_BLOCK, or the index of the block it repeats
+    std::vector<uint32_t> blockSources[3];
+    static const uint32_t FLAT_BLOCK = UINT32_MAX;
+
+    void zigzagScan(const int16_t *block, int out[64]) const;
+
+    int runLengthEncode(const int zigzaggedBlock[64], std::pair<int, int> rle[64]) const;
+
+    void huffmanEncodeDC(int dcDiff, BitWriter &writer, const HuffmanCode dcCodes[12]) const;
+    void huffmanEncodeAC(const std::pair<int, int> *rle, int count,
                                      const HuffmanCode huffAC[256],
-                                     ofstream& file);
+                                     BitWriter &writer) const;
 
     // test
     PPMImage reconstructRGBImage() const;
@@ -64,30 +190,220 @@ public:
 
     void writeJPEGFile(const std::string &filename);
 
+    /**
+     * @brief Write the compressed image to a sink (memory, fixed buffer, callback, file)
+     *
+     * @return false if the sink failed
+     */
+    bool encode(OutputSink &out);
+
+    /**
+     * @brief Encode straight to a file, one MCU row at a time (no compress() needed)
+     *   Working memory is bounded by the image width (the strips reuse the
+     *   planes and block stores, whose contents are replaced)
+     *
+     * @param filename output path
+     */
+    void writeJPEGFileStreaming(const std::string &filename);
+    bool encodeStreaming(OutputSink &out);
+
+    /**
+     * @brief Worst-case size of the output of encode() / encodeStreaming()
+     *   with the current settings, to allocate a buffer once
+     */
+    size_t maxEncodedSize() const;
+
+    /**
+     * @brief Rate control: compress and encode at the highest quality (1..100)
+     *   whose file fits in maxBytes, see getQuality() afterwards
+     *   Colour conversion and DCT run once, each quality tried only costs a
+     *   quantization and a counting pass (no compress() needed)
+     *
+     * @return false if even quality 1 is too large (nothing written, quality
+     *   unchanged) or the sink failed
+     */
+    bool encodeToSize(OutputSink &out, size_t maxBytes);
+    size_t estimateEncodedSize();
+
+    /**
+     * @brief Encode every rendition (quality, Huffman mode, output) of the
+     *   image from a single colour conversion and DCT; subsampling, restart
+     *   interval, trellis and scan script are those of this encoder
+     *   Renditions are encoded in parallel (no compress() needed)
+     *
+     * @return false if a rendition could not be written (see Rendition::written)
+     */
+    bool encodeRenditions(std::vector<Rendition> &renditions);
+    void computeCoefficients();
+
+    // Back ends of encodeRenditions(), one per rendition, kept (and reset) between calls
+    std::vector<std::unique_ptr<JPEGCompressor>> renditionBackEnds;
+
+    void writeHeaders(OutputSink &out, bool progressiveFrame);
+    void writeTrailer(OutputSink &out);
+    void encodeBlock(const int16_t *block, int &prevDC,
+                     const HuffmanCode dcCodes[12], const HuffmanCode acCodes[256],
+                     BitWriter &writer) const;
+    void encodeMCU(const BlockStore<int16_t> &y, const BlockStore<int16_t> &cb, const BlockStore<int16_t> &cr,
+                   size_t topLeft, size_t yStride, size_t chroma, int prevDC[3], BitWriter &writer) const;
+    void encodeMCUs(size_t first, size_t last, BitWriter &writer) const;
+
+    /**
+     * @brief Insert a restart marker (RST0..RST7) every mcus MCUs, 0 disables them
+     *   Segments between markers are entropy coded in parallel by writeJPEGFile()
+     *
+     * @param mcus restart interval in MCUs (0..65535)
+     */
+    void setRestartInterval(int mcus);
+    int getRestartInterval() const;
+
+    int restartInterval = 0;
+
+    // Entropy coder output, kept (with its capacity) from one encode to the next
+    BitWriter entropyWriter;
+    std::vector<BitWriter> restartSegments;
+
+    /**
+     * @brief Pool running the parallel stages (nullptr = ThreadPool::shared())
+     *   The pool must outlive the encodes that use it
+     */
+    void setThreadPool(ThreadPool *pool);
+
+    /**
+     * @brief Cap the number of threads working on this encoder (0 = whole pool)
+     */
+    void setMaxThreads(unsigned threads);
+
+    /**
+     * @brief Run fn over [0, count) on the encoder's pool, within its thread cap
+     *   The pool's std::function wraps a reference to fn: however much the
+     *   lambda captures, nothing is copied to the heap
+     */
+    template <typename Function>
+    void parallelFor(size_t count, size_t grain, const Function &fn) const
+    {
+        ThreadPool &pool = threadPool != nullptr ? *threadPool : ThreadPool::shared();
+        pool.parallelFor(count, grain, std::cref(fn), maxThreads);
+    }
+
+    ThreadPool *threadPool = nullptr;
+    unsigned maxThreads = 0;
+
+    /**
+     * @brief Build Huffman tables from the statistics of the image (two passes)
+     *   Only writeJPEGFile() optimizes, writeJPEGFileStreaming() keeps the Annex K tables
+     */
+    void setOptimizeHuffman(bool optimize);
+    bool getOptimizeHuffman() const;
+
+    void chooseHuffmanTables(bool optimize);
+    void gatherStatistics(HuffmanStatistics &stats);
+    void countMCUs(size_t first, size_t last, HuffmanStatistics &stats) const;
+    void countBlock(const int16_t *block, int &prevDC, uint32_t dcFreq[256], uint32_t acFreq[256]) const;
+
+    bool optimizeHuffman = false;
+    std::vector<HuffmanStatistics> partialStatistics; // per chunk of MCUs, kept between encodes
+
+    /**
+     * @brief Collect timings and statistics of the next encodes into stats
+     *   (nullptr, the default, disables them: no clock read, no extra pass)
+     *   stats must outlive the encodes
+     */
+    void setStats(EncodeStats *stats);
+    EncodeStats *getStats() const;
+
+    // Huffman symbols per component (Y, Cb, Cr) gathered for the stats
+    struct StatsSymbols
+    {
+        uint32_t dc[3][256] = {};
+        uint32_t ac[3][256] = {};
+    };
+
+    void beginStats();
+    void accountMCU(const BlockStore<int16_t> &y, const BlockStore<int16_t> &cb, const BlockStore<int16_t> &cr,
+                    size_t topLeft, size_t yStride, size_t chroma, int prevDC[3], StatsSymbols &symbols) const;
+    void finishStats(const StatsSymbols &symbols);
+
+    EncodeStats *stats = nullptr;
+
+    /**
+     * @brief Write a progressive (SOF2) file instead of a baseline one
+     *   Only encode() / writeJPEGFile() are progressive, every scan gets
+     *   optimized tables; the streaming encoder always writes baseline files
+     */
+    void setProgressive(bool enable);
+    bool getProgressive() const;
+
+    /**
+     * @brief Scans of the progressive file (empty = defaultScanScript())
+     *
+     * @param script scans in file order, components 0 = Y, 1 = Cb, 2 = Cr
+     * @return false (script unchanged) if the script is not a valid progression
+     */
+    bool setScanScript(const std::vector<ScanInfo> &script);
+    const std::vector<ScanInfo> &progressiveScript(std::string &error) const;
+
+    void writeProgressiveScans(OutputSink &out);
+
+    bool progressive = false;
+    std::vector<ScanInfo> scanScript;
+    std::vector<EncodedScan> progressiveScans;
+
+    // Tables written by writeHeaders() and their symbol -> code maps
+    HuffmanTable dcLumaTable, acLumaTable;
+    HuffmanTable dcChromaTable, acChromaTable;
+    HuffmanCode dcLumaCodes[12], acLumaCodes[256];
+    HuffmanCode dcChromaCodes[12], acChromaCodes[256];
+
     int width;
     int height;
-    vector<Pixel> pixels;
-    vector<YCbCrPixel> ycbcrPixels; // Converted YCbCr pixels
+    ImageView source; // input pixels, owned by the caller
+
+    // Converted planes, 8-bit samples, row major (width * height)
+    vector<uint8_t> Y;
+    vector<uint8_t> Cb;
+    vector<uint8_t> Cr;
+
+    // Subsampled chroma planes (chromaPlaneWidth() * chromaPlaneHeight()), empty in grayscale
+    vector<uint8_t> Cb_sub;
+    vector<uint8_t> Cr_sub;
+
+    // DCT (samples, then coefficients in place)
+    BlockStore<double> blocksY;
+    BlockStore<double> blocksCb;
+    BlockStore<double> blocksCr;
+
+    void applyDCT(const double *inBlock, double *outBlock);
+    void integerDCTQuantizeChannel(const BlockStore<double> &blocks, BlockStore<int16_t> &qBlocks, const QuantizationTable &table);
+
+    /**
+     * @brief Select the forward DCT engine (Fast by default)
+     *
+     * @param mode DCTMode::Reference, DCTMode::Fast or DCTMode::Integer
+     */
+    void setDCTMode(DCTMode mode);
+    DCTMode getDCTMode() const;
 
-    // subsampling
-    vector<vector<double>> Y;
-    vector<vector<double>> Cb;
-    vector<vector<double>> Cr;
-    vector<vector<double>> Cb_420;
-    vector<vector<double>> Cr_420;
+    DCTMode dctMode = DCTMode::Fast;
 
-    // DCT
-    std::vector<std::vector<std::vector<double>>> blocksY;
-    std::vector<std::vector<std::vector<double>>> blocksCb;
-    std::vector<std::vector<std::vector<double>>> blocksCr;
+    /**
+     * @brief IJG quality: scales the example tables (50 = unscaled, 100 = all ones)
+     *   Tables and their reciprocals are built once per quality level and shared
+     *
+     * @param quality 1..100 (clamped)
+     */
+    void setQuality(int quality);
+    int getQuality() const;
 
-    std::vector<std::vector<double>> applyDCT(const std::vector<std::vector<double>> &block);
+    int quality = 50;
+    const QuantizationTables *quantTables = nullptr;
 
     // Quantization
-    std::vector<std::vector<std::vector<int>>> qBlocksY;
-    std::vector<std::vector<std::vector<int>>> qBlocksCb;
-    std::vector<std::vector<std::vector<int>>> qBlocksCr;
+    BlockStore<int16_t> qBlocksY;
+    BlockStore<int16_t> qBlocksCb;
+    BlockStore<int16_t> qBlocksCr;
 
+    // Floating point reference of the conversion done by convertToYCbCr()
     YCbCrPixel RGBtoYCbCr(const Pixel &pixel);
 };
 
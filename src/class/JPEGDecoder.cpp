@@ -0,0 +1,859 @@
+#include "JPEGDecoder.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Natural (row major) index of the k-th coefficient of the zigzag scan
+static const uint8_t zigzagToNatural[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+/**
+ * @brief Input scale of the AAN inverse transform
+ *   Coefficient (u,v) has to be multiplied by s[u] * s[v] / 8, with s[0] = 1
+ *   and s[k] = cos(k*PI/16) * sqrt(2); done once per table in the DQT.
+ */
+struct AANInverseScale
+{
+    float factor[64];
+
+    AANInverseScale()
+    {
+        const double PI = std::acos(-1);
+        double s[8];
+        s[0] = 1.0;
+        for (int k = 1; k < 8; ++k)
+        {
+            s[k] = std::cos(k * PI / 16) * std::sqrt(2.0);
+        }
+
+        for (int u = 0; u < 8; ++u)
+        {
+            for (int v = 0; v < 8; ++v)
+            {
+                factor[u * 8 + v] = static_cast<float>(s[u] * s[v] / 8.0);
+            }
+        }
+    }
+};
+
+static const AANInverseScale aanInverseScale;
+
+/**
+ * @brief YCbCr -> RGB in 16-bit fixed point (JFIF equations)
+ */
+struct YCbCrToRGBTables
+{
+    int crR[256];
+    int cbB[256];
+    int32_t crG[256];
+    int32_t cbG[256];
+
+    YCbCrToRGBTables()
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            int c = i - 128;
+            crR[i] = static_cast<int>(std::lround(1.402 * c));
+            cbB[i] = static_cast<int>(std::lround(1.772 * c));
+            crG[i] = static_cast<int32_t>(std::lround(-0.71414 * 65536 * c));
+            cbG[i] = static_cast<int32_t>(std::lround(-0.34414 * 65536 * c)) + 32768;
+        }
+    }
+};
+
+static const YCbCrToRGBTables ycbcrTables;
+
+static inline uint8_t clampSample(int value)
+{
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+/**
+ * @brief Separable AAN 8x8 inverse DCT (float), dequantization included
+ *   Columns first, then rows straight into the plane, level shift and
+ *   clamping on the way out.
+ *
+ * @param in 64 quantized coefficients (row major)
+ * @param q steps * AAN input scale / 8 (row major)
+ * @param out top left sample of the block
+ * @param stride bytes between two rows of out
+ */
+static void inverseDCTFast(const int32_t in[64], const float q[64], uint8_t *out, size_t stride)
+{
+    float ws[64];
+
+    // 1. Columns; a column without AC coefficients is constant
+    for (int col = 0; col < 8; ++col)
+    {
+        const int32_t *c = in + col;
+        const float *qc = q + col;
+        float *w = ws + col;
+        if ((c[8] | c[16] | c[24] | c[32] | c[40] | c[48] | c[56]) == 0)
+        {
+            float dc = c[0] * qc[0];
+            for (int row = 0; row < 8; ++row)
+            {
+                w[row * 8] = dc;
+            }
+            continue;
+        }
+
+        // Even part
+        float tmp0 = c[0] * qc[0];
+        float tmp1 = c[16] * qc[16];
+        float tmp2 = c[32] * qc[32];
+        float tmp3 = c[48] * qc[48];
+
+        float tmp10 = tmp0 + tmp2;
+        float tmp11 = tmp0 - tmp2;
+        float tmp13 = tmp1 + tmp3;
+        float tmp12 = (tmp1 - tmp3) * 1.414213562f - tmp13;
+
+        tmp0 = tmp10 + tmp13;
+        tmp3 = tmp10 - tmp13;
+        tmp1 = tmp11 + tmp12;
+        tmp2 = tmp11 - tmp12;
+
+        // Odd part
+        float tmp4 = c[8] * qc[8];
+        float tmp5 = c[24] * qc[24];
+        float tmp6 = c[40] * qc[40];
+        float tmp7 = c[56] * qc[56];
+
+        float z13 = tmp6 + tmp5;
+        float z10 = tmp6 - tmp5;
+        float z11 = tmp4 + tmp7;
+        float z12 = tmp4 - tmp7;
+
+        tmp7 = z11 + z13;
+        tmp11 = (z11 - z13) * 1.414213562f;
+        float z5 = (z10 + z12) * 1.847759065f;
+        tmp10 = 1.082392200f * z12 - z5;
+        tmp12 = -2.613125930f * z10 + z5;
+
+        tmp6 = tmp12 - tmp7;
+        tmp5 = tmp11 - tmp6;
+        tmp4 = tmp10 + tmp5;
+
+        w[0] = tmp0 + tmp7;
+        w[56] = tmp0 - tmp7;
+        w[8] = tmp1 + tmp6;
+        w[48] = tmp1 - tmp6;
+        w[16] = tmp2 + tmp5;
+        w[40] = tmp2 - tmp5;
+        w[32] = tmp3 + tmp4;
+        w[24] = tmp3 - tmp4;
+    }
+
+    // 2. Rows, + 128 and rounding
+    for (int row = 0; row < 8; ++row)
+    {
+        const float *w = ws + row * 8;
+        uint8_t *o = out + row * stride;
+
+        float tmp10 = w[0] + w[4];
+        float tmp11 = w[0] - w[4];
+        float tmp13 = w[2] + w[6];
+        float tmp12 = (w[2] - w[6]) * 1.414213562f - tmp13;
+
+        float tmp0 = tmp10 + tmp13;
+        float tmp3 = tmp10 - tmp13;
+        float tmp1 = tmp11 + tmp12;
+        float tmp2 = tmp11 - tmp12;
+
+        float z13 = w[5] + w[3];
+        float z10 = w[5] - w[3];
+        float z11 = w[1] + w[7];
+        float z12 = w[1] - w[7];
+
+        float tmp7 = z11 + z13;
+        tmp11 = (z11 - z13) * 1.414213562f;
+        float z5 = (z10 + z12) * 1.847759065f;
+        tmp10 = 1.082392200f * z12 - z5;
+        tmp12 = -2.613125930f * z10 + z5;
+
+        float tmp6 = tmp12 - tmp7;
+        float tmp5 = tmp11 - tmp6;
+        float tmp4 = tmp10 + tmp5;
+
+        // Truncation of x + 128.5 rounds every value that is not clamped to 0
+        o[0] = clampSample(static_cast<int>(tmp0 + tmp7 + 128.5f));
+        o[7] = clampSample(static_cast<int>(tmp0 - tmp7 + 128.5f));
+        o[1] = clampSample(static_cast<int>(tmp1 + tmp6 + 128.5f));
+        o[6] = clampSample(static_cast<int>(tmp1 - tmp6 + 128.5f));
+        o[2] = clampSample(static_cast<int>(tmp2 + tmp5 + 128.5f));
+        o[5] = clampSample(static_cast<int>(tmp2 - tmp5 + 128.5f));
+        o[4] = clampSample(static_cast<int>(tmp3 + tmp4 + 128.5f));
+        o[3] = clampSample(static_cast<int>(tmp3 - tmp4 + 128.5f));
+    }
+}
+
+/**
+ * @brief Entropy coded segment reader
+ *   Bits are kept MSB first in a 64-bit buffer refilled a byte at a time;
+ *   stuffed 0x00 bytes are dropped. At a marker the reader stops and feeds
+ *   zeros, so a damaged stream can never read past its scan.
+ */
+class JPEGDecoder::BitReader
+{
+public:
+    BitReader(const uint8_t *data, size_t size, size_t offset)
+        : data(data), size(size), position(offset)
+    {
+    }
+
+    inline void fill()
+    {
+        while (bits <= 56)
+        {
+            uint64_t byte = 0;
+            if (!marker && position < size)
+            {
+                byte = data[position];
+                if (byte != 0xFF)
+                {
+                    position++;
+                }
+                else if (position + 1 < size && data[position + 1] == 0x00)
+                {
+                    position += 2;
+                }
+                else
+                {
+                    marker = true;
+                    byte = 0;
+                }
+            }
+            buffer |= byte << (56 - bits);
+            bits += 8;
+        }
+    }
+
+    inline void skip(int count)
+    {
+        buffer <<= count;
+        bits -= count;
+    }
+
+    /**
+     * @brief Next Huffman symbol of table, -1 if the bits are no code of it
+     */
+    inline int decodeSymbol(const DecodeTable &table)
+    {
+        if (bits < 16)
+        {
+            fill();
+        }
+
+        uint16_t entry = table.lookup[buffer >> (64 - LOOKAHEAD)];
+        if (entry != 0)
+        {
+            skip(entry >> 8);
+            return entry & 0xFF;
+        }
+
+        for (int length = LOOKAHEAD + 1; length <= 16; ++length)
+        {
+            int32_t code = static_cast<int32_t>(buffer >> (64 - length));
+            if (code <= table.maxCode[length])
+            {
+                skip(length);
+                return table.huffval[(table.valueOffset[length] + code) & 0xFF];
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * @brief Read count bits and sign extend them (JPEG Annex F.2.2.1)
+     */
+    inline int receiveExtend(int count)
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+        if (bits < count)
+        {
+            fill();
+        }
+        int value = static_cast<int>(buffer >> (64 - count));
+        skip(count);
+        return value < (1 << (count - 1)) ? value - (1 << count) + 1 : value;
+    }
+
+    /**
+     * @brief Drop the pending bits and step over the RSTn marker that must follow
+     *
+     * @return false if the next marker is not a restart marker
+     */
+    bool restart()
+    {
+        buffer = 0;
+        bits = 0;
+        marker = false;
+        while (position + 1 < size && !(data[position] == 0xFF && data[position + 1] != 0x00 && data[position + 1] != 0xFF))
+        {
+            position++;
+        }
+        if (position + 1 >= size || data[position + 1] < 0xD0 || data[position + 1] > 0xD7)
+        {
+            return false;
+        }
+        position += 2;
+        return true;
+    }
+
+    /**
+     * @brief Offset of the first byte not consumed (at most the marker ending the scan)
+     */
+    size_t offset() const
+    {
+        return position;
+    }
+
+private:
+    const uint8_t *data;
+    size_t size;
+    size_t position;
+    uint64_t buffer = 0;
+    int bits = 0;
+    bool marker = false;
+};
+
+bool JPEGDecoder::fail(const string &message)
+{
+    error = message;
+    return false;
+}
+
+const string &JPEGDecoder::getError() const
+{
+    return error;
+}
+
+int JPEGDecoder::getWidth() const
+{
+    return width;
+}
+
+int JPEGDecoder::getHeight() const
+{
+    return height;
+}
+
+int JPEGDecoder::getComponentCount() const
+{
+    return static_cast<int>(components.size());
+}
+
+int JPEGDecoder::getRestartInterval() const
+{
+    return restartInterval;
+}
+
+/**
+ * @brief Canonical codes of a DHT table (JPEG Annex C), then the lookup table
+ *   of the codes of at most LOOKAHEAD bits and the limits of the longer ones
+ */
+void JPEGDecoder::buildDecodeTable(const uint8_t bits[16], const uint8_t *huffval, int count, DecodeTable &table)
+{
+    std::memset(table.lookup, 0, sizeof(table.lookup));
+    std::memcpy(table.huffval, huffval, count);
+
+    int32_t code = 0;
+    int k = 0;
+    for (int length = 1; length <= 16; ++length)
+    {
+        table.valueOffset[length] = k - code;
+        for (int i = 0; i < bits[length - 1]; ++i, ++k, ++code)
+        {
+            if (length <= LOOKAHEAD)
+            {
+                int shift = LOOKAHEAD - length;
+                uint16_t entry = static_cast<uint16_t>((length << 8) | huffval[k]);
+                for (int fill = code << shift; fill < ((code + 1) << shift); ++fill)
+                {
+                    table.lookup[fill] = entry;
+                }
+            }
+        }
+        table.maxCode[length] = bits[length - 1] != 0 ? code - 1 : -1;
+        code <<= 1;
+    }
+    table.maxCode[0] = -1;
+    table.maxCode[17] = INT32_MAX;
+    table.defined = true;
+}
+
+bool JPEGDecoder::parseFrame(const uint8_t *segment, size_t length)
+{
+    if (frameSeen)
+    {
+        return fail("more than one frame");
+    }
+    if (length < 6)
+    {
+        return fail("truncated SOF segment");
+    }
+    if (segment[0] != 8)
+    {
+        return fail("only 8-bit samples are supported");
+    }
+
+    height = (segment[1] << 8) | segment[2];
+    width = (segment[3] << 8) | segment[4];
+    int count = segment[5];
+    if (width == 0 || height == 0)
+    {
+        return fail("image size missing (DNL is not supported)");
+    }
+    if (count != 1 && count != 3)
+    {
+        return fail("only 1 or 3 components are supported");
+    }
+    if (length < 6 + 3 * static_cast<size_t>(count))
+    {
+        return fail("truncated SOF segment");
+    }
+
+    components.assign(count, Component());
+    maxH = maxV = 1;
+    for (int c = 0; c < count; ++c)
+    {
+        Component &component = components[c];
+        const uint8_t *p = segment + 6 + 3 * c;
+        component.id = p[0];
+        component.h = p[1] >> 4;
+        component.v = p[1] & 0x0F;
+        component.quantTable = p[2];
+        if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4 || component.quantTable > 3)
+        {
+            return fail("bad component in SOF segment");
+        }
+        maxH = std::max(maxH, component.h);
+        maxV = std::max(maxV, component.v);
+    }
+
+    mcuColumns = (width + 8 * maxH - 1) / (8 * maxH);
+    mcuRows = (height + 8 * maxV - 1) / (8 * maxV);
+    for (Component &component : components)
+    {
+        component.blocksPerLine = mcuColumns * component.h;
+        component.blocksPerColumn = mcuRows * component.v;
+        component.plane.assign(static_cast<size_t>(component.blocksPerLine) * component.blocksPerColumn * 64, 0);
+    }
+    frameSeen = true;
+    return true;
+}
+
+bool JPEGDecoder::parseQuantizationTables(const uint8_t *segment, size_t length)
+{
+    size_t i = 0;
+    while (i < length)
+    {
+        int precision = segment[i] >> 4;
+        int id = segment[i] & 0x0F;
+        size_t tableBytes = precision == 0 ? 64 : 128;
+        if (precision > 1 || id > 3 || i + 1 + tableBytes > length)
+        {
+            return fail("bad DQT segment");
+        }
+
+        const uint8_t *values = segment + i + 1;
+        for (int k = 0; k < 64; ++k)
+        {
+            int step = precision == 0 ? values[k] : (values[2 * k] << 8) | values[2 * k + 1];
+            int natural = zigzagToNatural[k];
+            quantTables[id][natural] = step * aanInverseScale.factor[natural];
+        }
+        quantDefined[id] = true;
+        i += 1 + tableBytes;
+    }
+    return true;
+}
+
+bool JPEGDecoder::parseHuffmanTables(const uint8_t *segment, size_t length)
+{
+    size_t i = 0;
+    while (i < length)
+    {
+        if (i + 17 > length)
+        {
+            return fail("bad DHT segment");
+        }
+        int tableClass = segment[i] >> 4;
+        int id = segment[i] & 0x0F;
+        const uint8_t *bits = segment + i + 1;
+        int count = 0;
+        for (int l = 0; l < 16; ++l)
+        {
+            count += bits[l];
+        }
+        if (tableClass > 1 || id > 3 || count > 256 || i + 17 + count > length)
+        {
+            return fail("bad DHT segment");
+        }
+
+        buildDecodeTable(bits, segment + i + 17, count, tableClass == 0 ? dcTables[id] : acTables[id]);
+        i += 17 + count;
+    }
+    return true;
+}
+
+/**
+ * @brief Huffman decoding and IDCT of one block into its component plane
+ */
+bool JPEGDecoder::decodeBlock(BitReader &reader, Component &component, int blockX, int blockY)
+{
+    int32_t block[64] = {};
+
+    int size = reader.decodeSymbol(dcTables[component.dcTable]);
+    if (size < 0 || size > 11)
+    {
+        return fail("bad DC Huffman code");
+    }
+    component.prevDC += reader.receiveExtend(size);
+    block[0] = component.prevDC;
+
+    bool acPresent = false;
+    for (int k = 1; k < 64;)
+    {
+        int symbol = reader.decodeSymbol(acTables[component.acTable]);
+        if (symbol < 0)
+        {
+            return fail("bad AC Huffman code");
+        }
+        int run = symbol >> 4;
+        size = symbol & 0x0F;
+        if (size == 0)
+        {
+            if (run != 15)
+            {
+                break; // EOB
+            }
+            k += 16; // ZRL
+            continue;
+        }
+        k += run;
+        if (k > 63)
+        {
+            return fail("AC coefficient index beyond 63");
+        }
+        block[zigzagToNatural[k]] = reader.receiveExtend(size);
+        acPresent = true;
+        k++;
+    }
+
+    size_t stride = static_cast<size_t>(component.blocksPerLine) * 8;
+    uint8_t *out = component.plane.data() + static_cast<size_t>(blockY) * 8 * stride + static_cast<size_t>(blockX) * 8;
+    const float *q = quantTables[component.quantTable];
+    if (!acPresent)
+    {
+        // Flat block: the IDCT is the DC value everywhere
+        uint8_t value = clampSample(static_cast<int>(std::floor(block[0] * q[0] + 128.5f)));
+        for (int row = 0; row < 8; ++row)
+        {
+            std::memset(out + row * stride, value, 8);
+        }
+        return true;
+    }
+    inverseDCTFast(block, q, out, stride);
+    return true;
+}
+
+bool JPEGDecoder::decodeScan(const uint8_t *segment, size_t length, const uint8_t *data, size_t size, size_t &offset)
+{
+    if (!frameSeen)
+    {
+        return fail("scan before the frame header");
+    }
+    if (length < 1 || length < 4 + 2 * static_cast<size_t>(segment[0]))
+    {
+        return fail("truncated SOS segment");
+    }
+
+    int count = segment[0];
+    if (count < 1 || count > static_cast<int>(components.size()))
+    {
+        return fail("bad component count in SOS segment");
+    }
+
+    vector<Component *> scan;
+    for (int i = 0; i < count; ++i)
+    {
+        int id = segment[1 + 2 * i];
+        auto found = std::find_if(components.begin(), components.end(), [id](const Component &c)
+                                  { return c.id == id; });
+        if (found == components.end())
+        {
+            return fail("scan of an unknown component");
+        }
+        found->dcTable = segment[2 + 2 * i] >> 4;
+        found->acTable = segment[2 + 2 * i] & 0x0F;
+        if (found->dcTable > 3 || found->acTable > 3 || !dcTables[found->dcTable].defined ||
+            !acTables[found->acTable].defined || !quantDefined[found->quantTable])
+        {
+            return fail("scan uses an undefined table");
+        }
+        found->prevDC = 0;
+        scan.push_back(&*found);
+    }
+
+    const uint8_t *spectral = segment + 1 + 2 * count;
+    if (spectral[0] != 0 || spectral[1] != 63 || spectral[2] != 0)
+    {
+        return fail("not a baseline scan");
+    }
+
+    // A single component scan covers the blocks of the component only,
+    // the others whole MCUs (JPEG Annex A.2)
+    int columns = mcuColumns;
+    size_t total = static_cast<size_t>(mcuColumns) * mcuRows;
+    if (count == 1)
+    {
+        const Component &component = *scan[0];
+        int componentWidth = (width * component.h + maxH - 1) / maxH;
+        int componentHeight = (height * component.v + maxV - 1) / maxV;
+        columns = (componentWidth + 7) / 8;
+        total = static_cast<size_t>(columns) * ((componentHeight + 7) / 8);
+    }
+
+    BitReader reader(data, size, offset);
+    for (size_t mcu = 0; mcu < total; ++mcu)
+    {
+        if (restartInterval > 0 && mcu > 0 && mcu % restartInterval == 0)
+        {
+            if (!reader.restart())
+            {
+                return fail("restart marker missing");
+            }
+            for (Component *component : scan)
+            {
+                component->prevDC = 0;
+            }
+        }
+
+        int mx = static_cast<int>(mcu % columns);
+        int my = static_cast<int>(mcu / columns);
+        if (count == 1)
+        {
+            if (!decodeBlock(reader, *scan[0], mx, my))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        for (Component *component : scan)
+        {
+            for (int by = 0; by < component->v; ++by)
+            {
+                for (int bx = 0; bx < component->h; ++bx)
+                {
+                    if (!decodeBlock(reader, *component, mx * component->h + bx, my * component->v + by))
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    offset = reader.offset();
+    return true;
+}
+
+/**
+ * @brief Upsampling (replication) and colour conversion into image
+ */
+void JPEGDecoder::writePixels(PPMImage &image) const
+{
+    image.setSize(width, height);
+    image.setFileType("P6");
+    image.setMaxVal(255);
+    image.setPixels(vector<Pixel>());
+    vector<Pixel> &pixels = image.getPixels();
+    pixels.resize(static_cast<size_t>(width) * height);
+
+    if (components.size() == 1)
+    {
+        const Component &gray = components[0];
+        size_t stride = static_cast<size_t>(gray.blocksPerLine) * 8;
+        for (int y = 0; y < height; ++y)
+        {
+            const uint8_t *row = gray.plane.data() + static_cast<size_t>(y) * stride;
+            Pixel *out = &pixels[static_cast<size_t>(y) * width];
+            for (int x = 0; x < width; ++x)
+            {
+                out[x] = {row[x], row[x], row[x]};
+            }
+        }
+        return;
+    }
+
+    // Column of every component sample under each output pixel
+    vector<int> columns[3];
+    for (int c = 0; c < 3; ++c)
+    {
+        columns[c].resize(width);
+        for (int x = 0; x < width; ++x)
+        {
+            columns[c][x] = x * components[c].h / maxH;
+        }
+    }
+
+    for (int y = 0; y < height; ++y)
+    {
+        const uint8_t *rows[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            size_t stride = static_cast<size_t>(components[c].blocksPerLine) * 8;
+            rows[c] = components[c].plane.data() + static_cast<size_t>(y * components[c].v / maxV) * stride;
+        }
+
+        Pixel *out = &pixels[static_cast<size_t>(y) * width];
+        for (int x = 0; x < width; ++x)
+        {
+            int luma = rows[0][columns[0][x]];
+            int cb = rows[1][columns[1][x]];
+            int cr = rows[2][columns[2][x]];
+            out[x] = {clampSample(luma + ycbcrTables.crR[cr]),
+                      clampSample(luma + ((ycbcrTables.cbG[cb] + ycbcrTables.crG[cr]) >> 16)),
+                      clampSample(luma + ycbcrTables.cbB[cb])};
+        }
+    }
+}
+
+bool JPEGDecoder::decode(const uint8_t *data, size_t size, PPMImage &image)
+{
+    error.clear();
+    width = height = 0;
+    restartInterval = 0;
+    frameSeen = false;
+    components.clear();
+    std::fill(std::begin(quantDefined), std::end(quantDefined), false);
+    for (int i = 0; i < 4; ++i)
+    {
+        dcTables[i].defined = false;
+        acTables[i].defined = false;
+    }
+
+    if (size < 2 || data[0] != 0xFF || data[1] != 0xD8)
+    {
+        return fail("not a JPEG file (no SOI marker)");
+    }
+
+    bool scanned = false;
+    size_t offset = 2;
+    for (;;)
+    {
+        // Next marker, fill bytes skipped
+        while (offset < size && data[offset] != 0xFF)
+        {
+            offset++;
+        }
+        while (offset < size && data[offset] == 0xFF)
+        {
+            offset++;
+        }
+        if (offset >= size)
+        {
+            return fail("no EOI marker (truncated file?)");
+        }
+        uint8_t marker = data[offset++];
+
+        if (marker == 0xD9)
+        {
+            break;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+        {
+            continue; // no length
+        }
+
+        if (offset + 2 > size)
+        {
+            return fail("truncated segment");
+        }
+        size_t length = (data[offset] << 8) | data[offset + 1];
+        if (length < 2 || offset + length > size)
+        {
+            return fail("truncated segment");
+        }
+        const uint8_t *segment = data + offset + 2;
+        length -= 2;
+        offset += length + 2;
+
+        bool ok = true;
+        switch (marker)
+        {
+        case 0xC0:
+        case 0xC1:
+            ok = parseFrame(segment, length);
+            break;
+        case 0xC2:
+        case 0xC3:
+        case 0xC5:
+        case 0xC6:
+        case 0xC7:
+        case 0xC9:
+        case 0xCA:
+        case 0xCB:
+        case 0xCD:
+        case 0xCE:
+        case 0xCF:
+            ok = fail("only baseline files are supported (progressive, lossless or arithmetic coded frame)");
+            break;
+        case 0xC4:
+            ok = parseHuffmanTables(segment, length);
+            break;
+        case 0xDB:
+            ok = parseQuantizationTables(segment, length);
+            break;
+        case 0xDD:
+            if (length < 2)
+            {
+                ok = fail("bad DRI segment");
+                break;
+            }
+            restartInterval = (segment[0] << 8) | segment[1];
+            break;
+        case 0xDA:
+            ok = decodeScan(segment, length, data, size, offset);
+            scanned = true;
+            break;
+        default:
+            break; // APPn, COM, ...
+        }
+        if (!ok)
+        {
+            return false;
+        }
+    }
+
+    if (!frameSeen || !scanned)
+    {
+        return fail("no image data");
+    }
+    writePixels(image);
+    return true;
+}
+
+bool JPEGDecoder::decode(const vector<uint8_t> &data, PPMImage &image)
+{
+    return decode(data.data(), data.size(), image);
+}
+
+bool JPEGDecoder::decodeFile(const string &path, PPMImage &image)
+{
+    MappedFile file;
+    if (!file.open(path))
+    {
+        return fail("cannot open " + path);
+    }
+    return decode(file.data(), file.size(), image);
+}
@@ -0,0 +1,109 @@
+#ifndef _JPEGDECODER_HPP_
+#define _JPEGDECODER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "imageExtension/PPMImage.hpp"
+
+using namespace std;
+
+/**
+ * @brief Baseline JPEG decoder (SOF0 / SOF1, 8-bit samples, Huffman coding)
+ *   Enough to read back everything the encoder writes in baseline mode, and
+ *   most baseline files from other encoders:
+ *   - 1 (grayscale) or 3 (YCbCr) components, any sampling factors 1..4
+ *   - interleaved or one scan per component, restart intervals
+ *   Huffman codes up to LOOKAHEAD bits are decoded with one table lookup,
+ *   blocks go through a separable AAN IDCT with the dequantization folded in
+ *   (DC-only blocks are just filled), chroma is upsampled by replication and
+ *   converted with fixed-point tables.
+ *   Progressive, lossless, arithmetic coded and 12-bit files are refused.
+ */
+class JPEGDecoder
+{
+public:
+    /**
+     * @brief Decode a whole JPEG file held in memory into image (P6, maxval 255)
+     *
+     * @return false if the data cannot be decoded, see getError()
+     */
+    bool decode(const uint8_t *data, size_t size, PPMImage &image);
+    bool decode(const vector<uint8_t> &data, PPMImage &image);
+
+    /**
+     * @brief Decode a file (memory mapped, path used as given)
+     */
+    bool decodeFile(const string &path, PPMImage &image);
+
+    /**
+     * @brief Why the last decode failed ("" after a success)
+     */
+    const string &getError() const;
+
+    /**
+     * @brief Frame of the last decoded file
+     */
+    int getWidth() const;
+    int getHeight() const;
+    int getComponentCount() const;
+    int getRestartInterval() const;
+
+    // Huffman codes of at most LOOKAHEAD bits are decoded with a single lookup
+    static const int LOOKAHEAD = 9;
+
+private:
+    /**
+     * @brief Huffman table prepared for decoding (JPEG Annex F.2.2.3)
+     *   lookup[next LOOKAHEAD bits] = code length << 8 | symbol, 0 for longer codes
+     */
+    struct DecodeTable
+    {
+        bool defined = false;
+        uint16_t lookup[1 << LOOKAHEAD];
+        int32_t maxCode[18]; // largest code of each length, -1 if none
+        int32_t valueOffset[17];
+        uint8_t huffval[256];
+    };
+
+    struct Component
+    {
+        int id = 0;
+        int h = 1, v = 1;
+        int quantTable = 0;
+        int dcTable = 0, acTable = 0;
+        int blocksPerLine = 0, blocksPerColumn = 0; // whole MCUs
+        vector<uint8_t> plane;                      // blocksPerLine * 8 samples per row
+        int prevDC = 0;
+    };
+
+    class BitReader;
+
+    bool parseFrame(const uint8_t *segment, size_t length);
+    bool parseQuantizationTables(const uint8_t *segment, size_t length);
+    bool parseHuffmanTables(const uint8_t *segment, size_t length);
+    bool decodeScan(const uint8_t *segment, size_t length, const uint8_t *data, size_t size, size_t &offset);
+    bool decodeBlock(BitReader &reader, Component &component, int blockX, int blockY);
+    void writePixels(PPMImage &image) const;
+    bool fail(const string &message);
+
+    static void buildDecodeTable(const uint8_t bits[16], const uint8_t *huffval, int count, DecodeTable &table);
+
+    int width = 0;
+    int height = 0;
+    int restartInterval = 0;
+    int maxH = 1, maxV = 1;
+    int mcuColumns = 0, mcuRows = 0;
+    bool frameSeen = false;
+
+    vector<Component> components;
+    float quantTables[4][64]; // steps * AAN scale / 8, natural order
+    bool quantDefined[4] = {};
+    DecodeTable dcTables[4];
+    DecodeTable acTables[4];
+
+    string error;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "MappedFile.hpp"
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const string &path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        cerr << "Error: cannot open " << path << endl;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        cerr << "Error: empty or unreadable file " << path << endl;
+        ::close(fd);
+        return false;
+    }
+
+    size_t fileSize = static_cast<size_t>(info.st_size);
+    void *address = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+
+    if (address == MAP_FAILED)
+    {
+        cerr << "Error: cannot map " << path << endl;
+        return false;
+    }
+
+    // Read front to back once: let the kernel read ahead
+    madvise(address, fileSize, MADV_SEQUENTIAL);
+
+    this->bytes = static_cast<const uint8_t *>(address);
+    this->length = fileSize;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (bytes != nullptr)
+    {
+        munmap(const_cast<uint8_t *>(bytes), length);
+    }
+    bytes = nullptr;
+    length = 0;
+}
+
+bool MappedFile::isOpen() const
+{
+    return bytes != nullptr;
+}
+
+const uint8_t *MappedFile::data() const
+{
+    return bytes;
+}
+
+size_t MappedFile::size() const
+{
+    return length;
+}
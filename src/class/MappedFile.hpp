@@ -0,0 +1,41 @@
+#ifndef _MAPPEDFILE_HPP_
+#define _MAPPEDFILE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+/**
+ * @brief Read-only memory mapping of a whole file (POSIX mmap)
+ *   The bytes are paged in by the kernel on first access, nothing is copied.
+ *   The mapping lives as long as the object.
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /**
+     * @brief Map path, replacing the current mapping
+     *
+     * @return false (with a message on cerr) if the file cannot be opened or is empty
+     */
+    bool open(const string &path);
+    void close();
+
+    bool isOpen() const;
+    const uint8_t *data() const;
+    size_t size() const;
+
+private:
+    const uint8_t *bytes = nullptr;
+    size_t length = 0;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "OutputSink.hpp"
+#include <cstring>
+#include <iostream>
+
+void OutputSink::write(const uint8_t *data, size_t size)
+{
+    if (size <= sizeof(staging) - used)
+    {
+        std::memcpy(staging + used, data, size);
+        used += size;
+        return;
+    }
+
+    // Too big to stage: keep the order, then pass the data through without a copy
+    flushStaging();
+    if (!failure)
+    {
+        failure = !consume(data, size);
+    }
+    total += size;
+}
+
+bool OutputSink::flush()
+{
+    flushStaging();
+    return !failure;
+}
+
+void OutputSink::flushStaging()
+{
+    if (used > 0 && !failure)
+    {
+        failure = !consume(staging, used);
+    }
+    total += used;
+    used = 0;
+}
+
+bool OutputSink::failed() const
+{
+    return failure;
+}
+
+size_t OutputSink::bytesWritten() const
+{
+    return total + used;
+}
+
+MemorySink::MemorySink(size_t reserve)
+{
+    bytes.reserve(reserve);
+}
+
+const vector<uint8_t> &MemorySink::buffer() const
+{
+    return bytes;
+}
+
+vector<uint8_t> MemorySink::release()
+{
+    vector<uint8_t> out;
+    out.swap(bytes);
+    return out;
+}
+
+bool MemorySink::consume(const uint8_t *data, size_t size)
+{
+    bytes.insert(bytes.end(), data, data + size);
+    return true;
+}
+
+FixedBufferSink::FixedBufferSink(uint8_t *buffer, size_t capacity)
+    : buffer(buffer), capacity(capacity)
+{
+}
+
+size_t FixedBufferSink::size() const
+{
+    return length;
+}
+
+bool FixedBufferSink::consume(const uint8_t *data, size_t size)
+{
+    if (size > capacity - length)
+    {
+        return false;
+    }
+    std::memcpy(buffer + length, data, size);
+    length += size;
+    return true;
+}
+
+CallbackSink::CallbackSink(function<bool(const uint8_t *, size_t)> callback)
+    : callback(std::move(callback))
+{
+}
+
+bool CallbackSink::consume(const uint8_t *data, size_t size)
+{
+    return callback(data, size);
+}
+
+FileSink::FileSink(const string &path)
+    : file(path, ios::binary)
+{
+    if (!file.is_open())
+    {
+        cerr << "Cannot open file for writing: " << path << endl;
+    }
+}
+
+FileSink::~FileSink()
+{
+    flush();
+}
+
+bool FileSink::isOpen() const
+{
+    return file.is_open();
+}
+
+bool FileSink::consume(const uint8_t *data, size_t size)
+{
+    file.write(reinterpret_cast<const char *>(data), size);
+    return file.good();
+}
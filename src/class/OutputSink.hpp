@@ -0,0 +1,158 @@
+#ifndef _OUTPUTSINK_HPP_
+#define _OUTPUTSINK_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Destination of an encoded file
+ *   Marker bytes written one at a time are gathered in a small staging
+ *   buffer; entropy coded data larger than what is left of it goes straight
+ *   to consume(). Once a write fails the sink stays failed and ignores the
+ *   rest. Call flush() at the end (the encoders do).
+ */
+class OutputSink
+{
+public:
+    virtual ~OutputSink() = default;
+
+    inline void put(uint8_t byte)
+    {
+        if (used == sizeof(staging))
+        {
+            flushStaging();
+        }
+        staging[used++] = byte;
+    }
+
+    void write(const uint8_t *data, size_t size);
+
+    /**
+     * @brief Hand the staged bytes over
+     *
+     * @return false if any write failed
+     */
+    bool flush();
+
+    bool failed() const;
+
+    /**
+     * @brief Bytes accepted so far (staged ones included)
+     */
+    size_t bytesWritten() const;
+
+protected:
+    /**
+     * @brief Take size bytes
+     *
+     * @return false to fail the sink (full buffer, I/O error, abort)
+     */
+    virtual bool consume(const uint8_t *data, size_t size) = 0;
+
+private:
+    void flushStaging();
+
+    uint8_t staging[4096];
+    size_t used = 0;
+    size_t total = 0;
+    bool failure = false;
+};
+
+/**
+ * @brief Growable in-memory buffer
+ */
+class MemorySink : public OutputSink
+{
+public:
+    /**
+     * @param reserve initial capacity (e.g. JPEGCompressor::maxEncodedSize())
+     */
+    explicit MemorySink(size_t reserve = 0);
+
+    /**
+     * @brief Encoded bytes (complete after flush())
+     */
+    const vector<uint8_t> &buffer() const;
+
+    /**
+     * @brief Move the bytes out, the sink is empty (and usable) again
+     */
+    vector<uint8_t> release();
+
+protected:
+    bool consume(const uint8_t *data, size_t size) override;
+
+private:
+    vector<uint8_t> bytes;
+};
+
+/**
+ * @brief Caller-provided buffer of fixed capacity
+ *   A write that does not fit fails the sink (nothing past capacity is touched).
+ */
+class FixedBufferSink : public OutputSink
+{
+public:
+    FixedBufferSink(uint8_t *buffer, size_t capacity);
+
+    /**
+     * @brief Bytes stored in the buffer (complete after flush())
+     */
+    size_t size() const;
+
+protected:
+    bool consume(const uint8_t *data, size_t size) override;
+
+private:
+    uint8_t *buffer;
+    size_t capacity;
+    size_t length = 0;
+};
+
+/**
+ * @brief Chunks handed to a user function, in order
+ *   The function returns false to abort the encode.
+ */
+class CallbackSink : public OutputSink
+{
+public:
+    explicit CallbackSink(function<bool(const uint8_t *, size_t)> callback);
+
+protected:
+    bool consume(const uint8_t *data, size_t size) override;
+
+private:
+    function<bool(const uint8_t *, size_t)> callback;
+};
+
+/**
+ * @brief File on disk
+ */
+class FileSink : public OutputSink
+{
+public:
+    /**
+     * @brief Open (truncate) path, see isOpen()
+     */
+    explicit FileSink(const string &path);
+    ~FileSink() override;
+
+    /**
+     * @return false (with a message on cerr) if the file could not be opened
+     */
+    bool isOpen() const;
+
+protected:
+    bool consume(const uint8_t *data, size_t size) override;
+
+private:
+    ofstream file;
+};
+
+#endif
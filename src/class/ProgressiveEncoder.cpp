@@ -0,0 +1,492 @@
+#include "ProgressiveEncoder.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+
+// Zigzag index -> row major index
+static const int naturalOrder[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10,
+    17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63};
+
+// Largest Ah/Al accepted for 8-bit samples (same limit as libjpeg)
+static const int MAX_AH_AL = 10;
+
+// Longest EOB run and most correction bits kept waiting for it
+static const unsigned MAX_EOB_RUN = 0x7FFF;
+static const size_t MAX_CORRECTION_BITS = 1000;
+
+/**
+ * @brief Number of bits needed to write value (the JPEG "category")
+ */
+static inline int bitLength(unsigned value)
+{
+    return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
+
+vector<ScanInfo> defaultScanScript(int componentCount)
+{
+    if (componentCount == 1)
+    {
+        return {
+            {1, {0}, 0, 0, 0, 1},
+            {1, {0}, 1, 5, 0, 2},
+            {1, {0}, 6, 63, 0, 2},
+            {1, {0}, 1, 63, 2, 1},
+            {1, {0}, 0, 0, 1, 0},
+            {1, {0}, 1, 63, 1, 0}};
+    }
+
+    return {
+        {3, {0, 1, 2}, 0, 0, 0, 1}, // DC of every component: first paint
+        {1, {0}, 1, 5, 0, 2},
+        {1, {2}, 1, 63, 0, 1},
+        {1, {1}, 1, 63, 0, 1},
+        {1, {0}, 6, 63, 0, 2},
+        {1, {0}, 1, 63, 2, 1},
+        {3, {0, 1, 2}, 0, 0, 1, 0},
+        {1, {2}, 1, 63, 1, 0},
+        {1, {1}, 1, 63, 1, 0},
+        {1, {0}, 1, 63, 1, 0}};
+}
+
+bool validateScanScript(const vector<ScanInfo> &script, int componentCount, string &error)
+{
+    if (script.empty())
+    {
+        error = "empty scan script";
+        return false;
+    }
+
+    if (componentCount < 1 || componentCount > 4)
+    {
+        error = "bad component count";
+        return false;
+    }
+
+    // Last bit position sent for every coefficient, -1 = not sent yet
+    array<int, 64> lastBit[4];
+    for (array<int, 64> &bits : lastBit)
+    {
+        bits.fill(-1);
+    }
+
+    for (size_t s = 0; s < script.size(); ++s)
+    {
+        const ScanInfo &scan = script[s];
+        string where = "scan " + to_string(s) + ": ";
+
+        if (scan.componentCount < 1 || scan.componentCount > 4 || scan.componentCount > componentCount)
+        {
+            error = where + "bad component count";
+            return false;
+        }
+        for (int i = 0; i < scan.componentCount; ++i)
+        {
+            int c = scan.components[i];
+            if (c < 0 || c >= componentCount || (i > 0 && c <= scan.components[i - 1]))
+            {
+                error = where + "components must be valid and in increasing order";
+                return false;
+            }
+        }
+        if (scan.Ss < 0 || scan.Ss > scan.Se || scan.Se > 63 ||
+            scan.Ah < 0 || scan.Ah > MAX_AH_AL || scan.Al < 0 || scan.Al > MAX_AH_AL)
+        {
+            error = where + "bad progression parameters";
+            return false;
+        }
+        if (scan.Ss == 0 && scan.Se != 0)
+        {
+            error = where + "DC and AC coefficients must be in separate scans";
+            return false;
+        }
+        if (scan.Ss > 0 && scan.componentCount != 1)
+        {
+            error = where + "AC scans must have a single component";
+            return false;
+        }
+
+        for (int i = 0; i < scan.componentCount; ++i)
+        {
+            array<int, 64> &bits = lastBit[scan.components[i]];
+            if (scan.Ss > 0 && bits[0] < 0)
+            {
+                error = where + "AC scan before the first DC scan of the component";
+                return false;
+            }
+            for (int k = scan.Ss; k <= scan.Se; ++k)
+            {
+                bool valid = scan.Ah == 0 ? bits[k] < 0 : (bits[k] == scan.Ah && scan.Al == scan.Ah - 1);
+                if (!valid)
+                {
+                    error = where + "coefficient " + to_string(k) + " sent out of sequence";
+                    return false;
+                }
+                bits[k] = scan.Al;
+            }
+        }
+    }
+
+    for (int c = 0; c < componentCount; ++c)
+    {
+        if (lastBit[c][0] < 0)
+        {
+            error = "no DC scan for component " + to_string(c);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Entropy coder state of one pass over a scan
+ *   In the gathering pass symbols are only counted and no bit is written.
+ */
+struct ProgressiveEncoder::ScanState
+{
+    bool gather = true;
+    BitWriter *writer = nullptr;
+
+    uint32_t dcFreq[2][256];
+    uint32_t acFreq[2][256];
+    HuffmanCode dcCodes[2][256];
+    HuffmanCode acCodes[2][256];
+
+    int acTable = 0;     // table of the component of an AC scan
+    int lastDC[4] = {};  // DC predictors of the scan components
+    unsigned eobRun = 0; // blocks ending with an EOB not written yet
+    size_t eobBits = 0;  // correction bits waiting for the EOB run (refinement)
+    // Pending correction bits, at most MAX_CORRECTION_BITS (see encodeACRefine())
+    uint8_t correctionBits[MAX_CORRECTION_BITS];
+    size_t correctionCount = 0;
+    int restartIndex = 0;
+
+    void start(bool gathering, BitWriter *out)
+    {
+        gather = gathering;
+        writer = out;
+        std::memset(lastDC, 0, sizeof(lastDC));
+        eobRun = 0;
+        eobBits = 0;
+        correctionCount = 0;
+        restartIndex = 0;
+    }
+
+    inline void emitBits(uint32_t bits, int length)
+    {
+        if (!gather && length > 0)
+        {
+            writer->writeBits(bits, length);
+        }
+    }
+
+    inline void emitSymbol(uint32_t freq[256], const HuffmanCode codes[256], int symbol)
+    {
+        if (gather)
+        {
+            freq[symbol]++;
+            return;
+        }
+        writer->writeBits(codes[symbol].code, codes[symbol].length);
+    }
+
+    void emitCorrectionBits(size_t count)
+    {
+        if (!gather)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                writer->writeBits(correctionBits[i], 1);
+            }
+        }
+        correctionCount -= count;
+        std::memmove(correctionBits, correctionBits + count, correctionCount);
+    }
+
+    /**
+     * @brief Write the pending EOB run and the correction bits of its blocks
+     */
+    void emitEOBRun()
+    {
+        if (eobRun == 0)
+        {
+            return;
+        }
+
+        int length = bitLength(eobRun) - 1;
+        emitSymbol(acFreq[acTable], acCodes[acTable], length << 4);
+        emitBits(eobRun, length);
+        eobRun = 0;
+
+        emitCorrectionBits(eobBits);
+        eobBits = 0;
+    }
+
+    /**
+     * @brief Close the restart interval: RSTn, predictors and EOB run reset
+     */
+    void restart()
+    {
+        emitEOBRun();
+        if (!gather)
+        {
+            writer->writeMarker(0xD0 + (restartIndex & 7));
+        }
+        restartIndex++;
+        std::memset(lastDC, 0, sizeof(lastDC));
+    }
+
+    void encodeDCFirst(const int16_t *block, int slot, int table, int Al)
+    {
+        // Arithmetic shift: the decoder rebuilds the value as (DC >> Al) << Al
+        int value = block[0] >> Al;
+        int diff = value - lastDC[slot];
+        lastDC[slot] = value;
+
+        int category = bitLength(std::abs(diff));
+        emitSymbol(dcFreq[table], dcCodes[table], category);
+        emitBits(diff >= 0 ? diff : diff + (1 << category) - 1, category);
+    }
+
+    void encodeDCRefine(const int16_t *block, int Al)
+    {
+        emitBits((block[0] >> Al) & 1, 1);
+    }
+
+    void encodeACFirst(const int16_t *block, int Ss, int Se, int Al)
+    {
+        int run = 0;
+        for (int k = Ss; k <= Se; ++k)
+        {
+            int coef = block[naturalOrder[k]];
+            int magnitude = (coef < 0 ? -coef : coef) >> Al;
+            if (magnitude == 0)
+            {
+                run++;
+                continue;
+            }
+
+            emitEOBRun();
+            while (run > 15)
+            {
+                emitSymbol(acFreq[acTable], acCodes[acTable], 0xF0);
+                run -= 16;
+            }
+
+            int category = bitLength(magnitude);
+            emitSymbol(acFreq[acTable], acCodes[acTable], (run << 4) | category);
+            emitBits(coef < 0 ? ~magnitude : magnitude, category);
+            run = 0;
+        }
+
+        if (run > 0)
+        {
+            if (++eobRun == MAX_EOB_RUN)
+            {
+                emitEOBRun();
+            }
+        }
+    }
+
+    void encodeACRefine(const int16_t *block, int Ss, int Se, int Al)
+    {
+        // Magnitudes at this bit position, and the last newly nonzero coefficient
+        int magnitudes[64];
+        int eob = 0;
+        for (int k = Ss; k <= Se; ++k)
+        {
+            int coef = block[naturalOrder[k]];
+            magnitudes[k] = (coef < 0 ? -coef : coef) >> Al;
+            if (magnitudes[k] == 1)
+            {
+                eob = k;
+            }
+        }
+
+        // correctionBits = [bits of the EOB run | bits of this block]
+        int run = 0;
+        for (int k = Ss; k <= Se; ++k)
+        {
+            int magnitude = magnitudes[k];
+            if (magnitude == 0)
+            {
+                run++;
+                continue;
+            }
+
+            while (run > 15 && k <= eob)
+            {
+                emitEOBRun();
+                emitSymbol(acFreq[acTable], acCodes[acTable], 0xF0);
+                run -= 16;
+                emitCorrectionBits(correctionCount);
+            }
+
+            // Already nonzero: one correction bit, sent with the next symbol
+            if (magnitude > 1)
+            {
+                correctionBits[correctionCount++] = magnitude & 1;
+                continue;
+            }
+
+            // Newly nonzero: run/1 symbol, sign, then the buffered correction bits
+            emitEOBRun();
+            emitSymbol(acFreq[acTable], acCodes[acTable], (run << 4) | 1);
+            emitBits(block[naturalOrder[k]] < 0 ? 0 : 1, 1);
+            emitCorrectionBits(correctionCount);
+            run = 0;
+        }
+
+        if (run > 0 || correctionCount > eobBits)
+        {
+            eobRun++;
+            eobBits = correctionCount;
+            if (eobRun == MAX_EOB_RUN || eobBits > MAX_CORRECTION_BITS - 63)
+            {
+                emitEOBRun();
+            }
+        }
+    }
+};
+
+ProgressiveEncoder::ProgressiveEncoder(const ComponentBlocks *components, int componentCount, size_t mcuColumns, size_t mcuRows, int restartInterval)
+    : mcuColumns(mcuColumns), mcuRows(mcuRows), restartInterval(restartInterval)
+{
+    std::copy(components, components + componentCount, this->components);
+}
+
+/**
+ * @brief One pass over the blocks of a scan
+ *   Single component scans go over the blocks covering the component in
+ *   raster order (one block = one MCU), interleaved DC scans over the MCUs.
+ */
+void ProgressiveEncoder::runScan(const ScanInfo &scan, ScanState &state) const
+{
+    auto codeBlock = [&scan, &state](const int16_t *block, int slot, int table)
+    {
+        if (scan.Ss == 0)
+        {
+            if (scan.Ah == 0)
+            {
+                state.encodeDCFirst(block, slot, table, scan.Al);
+            }
+            else
+            {
+                state.encodeDCRefine(block, scan.Al);
+            }
+        }
+        else if (scan.Ah == 0)
+        {
+            state.encodeACFirst(block, scan.Ss, scan.Se, scan.Al);
+        }
+        else
+        {
+            state.encodeACRefine(block, scan.Ss, scan.Se, scan.Al);
+        }
+    };
+
+    size_t interval = restartInterval;
+    size_t mcu = 0;
+    auto nextMCU = [interval, &mcu, &state]()
+    {
+        if (interval > 0 && mcu > 0 && mcu % interval == 0)
+        {
+            state.restart();
+        }
+        mcu++;
+    };
+
+    if (scan.componentCount == 1)
+    {
+        const ComponentBlocks &component = components[scan.components[0]];
+        state.acTable = component.tableID;
+        for (size_t by = 0; by < component.blocksHigh; ++by)
+        {
+            for (size_t bx = 0; bx < component.blocksWide; ++bx)
+            {
+                nextMCU();
+                codeBlock((*component.blocks)[by * component.stride + bx], 0, component.tableID);
+            }
+        }
+    }
+    else
+    {
+        for (size_t my = 0; my < mcuRows; ++my)
+        {
+            for (size_t mx = 0; mx < mcuColumns; ++mx)
+            {
+                nextMCU();
+                for (int i = 0; i < scan.componentCount; ++i)
+                {
+                    const ComponentBlocks &component = components[scan.components[i]];
+                    for (int y = 0; y < component.v; ++y)
+                    {
+                        for (int x = 0; x < component.h; ++x)
+                        {
+                            size_t index = (my * component.v + y) * component.stride + mx * component.h + x;
+                            codeBlock((*component.blocks)[index], i, component.tableID);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    state.emitEOBRun();
+}
+
+void ProgressiveEncoder::encodeScan(const ScanInfo &scan, EncodedScan &out) const
+{
+    ScanState state;
+
+    // 1. Symbol statistics
+    std::memset(state.dcFreq, 0, sizeof(state.dcFreq));
+    std::memset(state.acFreq, 0, sizeof(state.acFreq));
+    state.start(true, nullptr);
+    runScan(scan, state);
+
+    // 2. Tables of the scan: DC tables for a first DC scan, the AC table of its component for an AC scan
+    for (int t = 0; t < 2; ++t)
+    {
+        out.usesDC[t] = false;
+        out.usesAC[t] = false;
+    }
+    for (int i = 0; i < scan.componentCount; ++i)
+    {
+        int table = components[scan.components[i]].tableID;
+        if (scan.Ss == 0 && scan.Ah == 0)
+        {
+            out.usesDC[table] = true;
+        }
+        else if (scan.Ss > 0)
+        {
+            out.usesAC[table] = true;
+        }
+    }
+    for (int t = 0; t < 2; ++t)
+    {
+        if (out.usesDC[t])
+        {
+            buildOptimalHuffmanTable(state.dcFreq[t], out.dcTables[t]);
+            buildHuffmanCodes(out.dcTables[t], state.dcCodes[t]);
+        }
+        if (out.usesAC[t])
+        {
+            buildOptimalHuffmanTable(state.acFreq[t], out.acTables[t]);
+            buildHuffmanCodes(out.acTables[t], state.acCodes[t]);
+        }
+    }
+
+    // 3. Coding
+    out.data.clear();
+    state.start(false, &out.data);
+    runScan(scan, state);
+    out.data.flush();
+}
@@ -0,0 +1,104 @@
+#ifndef _PROGRESSIVEENCODER_HPP_
+#define _PROGRESSIVEENCODER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "BlockStore.hpp"
+#include "BitWriter.hpp"
+#include "Huffman.hpp"
+
+using namespace std;
+
+/**
+ * @brief One scan of a progressive JPEG
+ *   Ss = Se = 0 codes the DC coefficients (one or several components),
+ *   1 <= Ss <= Se <= 63 a band of AC coefficients (one component only).
+ *   Ah = 0 is the first pass over a band, coefficients divided by 2^Al;
+ *   Ah > 0 refines it by one bit (Al = Ah - 1).
+ */
+struct ScanInfo
+{
+    int componentCount;
+    int components[4]; // component indexes (0 = Y, 1 = Cb, 2 = Cr)
+    int Ss, Se;        // spectral selection (zigzag indexes)
+    int Ah, Al;        // successive approximation
+};
+
+/**
+ * @brief Quantized blocks of one component, as laid out by the encoder
+ */
+struct ComponentBlocks
+{
+    const BlockStore<int16_t> *blocks;
+    size_t stride;     // blocks per row of the store
+    size_t blocksWide; // blocks covering the component (non interleaved scans)
+    size_t blocksHigh;
+    int h, v;          // sampling factors, blocks per MCU
+    int tableID;       // 0 = luminance tables, 1 = chrominance tables
+};
+
+/**
+ * @brief Entropy coded data of one scan and the tables it needs
+ */
+struct EncodedScan
+{
+    BitWriter data;
+    HuffmanTable dcTables[2];
+    HuffmanTable acTables[2];
+    bool usesDC[2];
+    bool usesAC[2];
+};
+
+/**
+ * @brief Scan script close to what common encoders use:
+ *   DC first (decodable after the first scan), low then high AC bands, then refinements
+ *
+ * @param componentCount 1 (grayscale) or 3 (YCbCr)
+ */
+vector<ScanInfo> defaultScanScript(int componentCount);
+
+/**
+ * @brief Check that a script is a valid progressive sequence (ITU T.81 G.1.1.1)
+ *
+ * @param error receives the reason when the script is rejected
+ * @return true if the script can be encoded
+ */
+bool validateScanScript(const vector<ScanInfo> &script, int componentCount, string &error);
+
+/**
+ * @brief Progressive (SOF2) entropy coder
+ *   Every scan is coded twice: a first pass counts the symbols, the second
+ *   one writes them with tables optimized for the scan (EOBRUN symbols are not
+ *   in the Annex K tables). Scans only read the blocks, so several of them
+ *   can be coded at the same time.
+ */
+class ProgressiveEncoder
+{
+public:
+    /**
+     * @param components componentCount (1..4) components, copied
+     */
+    ProgressiveEncoder(const ComponentBlocks *components, int componentCount, size_t mcuColumns, size_t mcuRows, int restartInterval);
+
+    /**
+     * @brief Code one scan, restart markers included
+     *
+     * @param scan a scan of a validated script
+     * @param out receives the data (flushed) and the tables to write before the SOS
+     */
+    void encodeScan(const ScanInfo &scan, EncodedScan &out) const;
+
+private:
+    struct ScanState;
+
+    void runScan(const ScanInfo &scan, ScanState &state) const;
+
+    ComponentBlocks components[4];
+    size_t mcuColumns;
+    size_t mcuRows;
+    int restartInterval;
+};
+
+#endif
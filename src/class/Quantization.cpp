@@ -0,0 +1,74 @@
+#include "Quantization.hpp"
+#include <algorithm>
+#include <mutex>
+
+const uint8_t standardLuminanceQuantTable[8][8] = {
+    {16, 11, 10, 16, 24, 40, 51, 61},
+    {12, 12, 14, 19, 26, 58, 60, 55},
+    {14, 13, 16, 24, 40, 57, 69, 56},
+    {14, 17, 22, 29, 51, 87, 80, 62},
+    {18, 22, 37, 56, 68, 109, 103, 77},
+    {24, 35, 55, 64, 81, 104, 113, 92},
+    {49, 64, 78, 87, 103, 121, 120, 101},
+    {72, 92, 95, 98, 112, 100, 103, 99}};
+
+const uint8_t standardChrominanceQuantTable[8][8] = {
+    {17, 18, 24, 47, 99, 99, 99, 99},
+    {18, 21, 26, 66, 99, 99, 99, 99},
+    {24, 26, 56, 99, 99, 99, 99, 99},
+    {47, 66, 99, 99, 99, 99, 99, 99},
+    {99, 99, 99, 99, 99, 99, 99, 99},
+    {99, 99, 99, 99, 99, 99, 99, 99},
+    {99, 99, 99, 99, 99, 99, 99, 99},
+    {99, 99, 99, 99, 99, 99, 99, 99}};
+
+int qualityScaleFactor(int quality)
+{
+    quality = std::max(1, std::min(quality, 100));
+    return quality < 50 ? 5000 / quality : 200 - quality * 2;
+}
+
+void scaleQuantizationTable(const uint8_t base[8][8], int quality, uint8_t out[8][8])
+{
+    int scale = qualityScaleFactor(quality);
+    for (int y = 0; y < 8; ++y)
+    {
+        for (int x = 0; x < 8; ++x)
+        {
+            int step = (base[y][x] * scale + 50) / 100;
+            out[y][x] = static_cast<uint8_t>(std::max(1, std::min(step, 255)));
+        }
+    }
+}
+
+void buildQuantizationTable(const uint8_t values[8][8], QuantizationTable &table)
+{
+    for (int i = 0; i < 64; ++i)
+    {
+        uint8_t step = values[i / 8][i % 8];
+        table.values[i / 8][i % 8] = step;
+        table.reciprocals[i] = 1.0 / step;
+        table.divisors[i] = step * 8;
+        table.divisorReciprocals[i] = 1.0f / table.divisors[i];
+    }
+}
+
+const QuantizationTables &quantizationTablesForQuality(int quality)
+{
+    static QuantizationTables cache[101];
+    static std::once_flag built[101];
+
+    quality = std::max(1, std::min(quality, 100));
+    std::call_once(built[quality], [quality]()
+                   {
+        QuantizationTables &tables = cache[quality];
+        uint8_t scaled[8][8];
+
+        tables.quality = quality;
+        scaleQuantizationTable(standardLuminanceQuantTable, quality, scaled);
+        buildQuantizationTable(scaled, tables.luminance);
+        scaleQuantizationTable(standardChrominanceQuantTable, quality, scaled);
+        buildQuantizationTable(scaled, tables.chrominance); });
+
+    return cache[quality];
+}
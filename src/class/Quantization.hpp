@@ -0,0 +1,83 @@
+#ifndef _QUANTIZATION_HPP_
+#define _QUANTIZATION_HPP_
+
+#include <cstdint>
+
+using namespace std;
+
+// Annex K example tables (IJG quality 50)
+extern const uint8_t standardLuminanceQuantTable[8][8];
+extern const uint8_t standardChrominanceQuantTable[8][8];
+
+/**
+ * @brief A quantization table with everything the DCT engines need precomputed
+ *   Dividing by a step becomes a multiplication by its reciprocal followed by
+ *   an exact correction, so the result is still the correctly rounded quotient.
+ */
+struct QuantizationTable
+{
+    uint8_t values[8][8];     // steps (row major), as written in the DQT
+    double reciprocals[64];   // 1 / step, floating point engines
+    int32_t divisors[64];     // step * 8, integer engine (islow output scale)
+    float divisorReciprocals[64]; // 1 / divisor
+};
+
+/**
+ * @brief Luminance and chrominance tables of one quality level
+ */
+struct QuantizationTables
+{
+    int quality;
+    QuantizationTable luminance;
+    QuantizationTable chrominance;
+};
+
+/**
+ * @brief IJG percentage scaling of the example tables (libjpeg jpeg_quality_scaling)
+ *
+ * @param quality 1..100 (clamped), 50 = example tables
+ */
+int qualityScaleFactor(int quality);
+
+/**
+ * @brief Scale a table with an IJG quality, steps clamped to 1..255 (baseline)
+ */
+void scaleQuantizationTable(const uint8_t base[8][8], int quality, uint8_t out[8][8]);
+
+/**
+ * @brief Fill the precomputed fields of table from its steps
+ */
+void buildQuantizationTable(const uint8_t values[8][8], QuantizationTable &table);
+
+/**
+ * @brief Tables of a quality level, built on first use and then shared
+ *   Safe to call from several threads.
+ *
+ * @param quality 1..100 (clamped)
+ */
+const QuantizationTables &quantizationTablesForQuality(int quality);
+
+/**
+ * @brief round(value / step), half away from zero, without a division
+ *
+ * @param step quantization step
+ * @param reciprocal 1 / step
+ */
+inline int16_t quantizeCoefficient(double value, double step, double reciprocal)
+{
+    double magnitude = value < 0 ? -value : value;
+    double n = static_cast<int32_t>(magnitude * reciprocal + 0.5);
+
+    // (n +- 1/2) * step is exact: the product only fixes the rare off-by-one
+    if ((n - 0.5) * step > magnitude)
+    {
+        n -= 1;
+    }
+    else if ((n + 0.5) * step <= magnitude)
+    {
+        n += 1;
+    }
+    return static_cast<int16_t>(value < 0 ? -n : n);
+}
+
+#endif
@@ -0,0 +1,199 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+
+// Set in pool workers: a parallelFor issued from inside a job runs inline
+static thread_local bool insidePoolWorker = false;
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // The caller of parallelFor is one of the threads
+    for (unsigned i = 1; i < threads; ++i)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+unsigned ThreadPool::getThreadCount() const
+{
+    return static_cast<unsigned>(workers.size()) + 1;
+}
+
+ThreadPool &ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+bool ThreadPool::ChunkQueue::popFront(pair<size_t, size_t> &chunk)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (chunks.empty())
+    {
+        return false;
+    }
+    chunk = chunks.front();
+    chunks.pop_front();
+    return true;
+}
+
+bool ThreadPool::ChunkQueue::popBack(pair<size_t, size_t> &chunk)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (chunks.empty())
+    {
+        return false;
+    }
+    chunk = chunks.back();
+    chunks.pop_back();
+    return true;
+}
+
+/**
+ * @brief Work on a job: own chunks first (in order), then steal from the others
+ */
+void ThreadPool::runSlot(Job &job, unsigned slot)
+{
+    pair<size_t, size_t> chunk;
+    while (true)
+    {
+        bool found = job.queues[slot]->popFront(chunk);
+        for (unsigned k = 1; !found && k < job.participants; ++k)
+        {
+            found = job.queues[(slot + k) % job.participants]->popBack(chunk);
+        }
+        if (!found)
+        {
+            return;
+        }
+
+        (*job.fn)(chunk.first, chunk.second);
+
+        if (job.pending.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> guard(job.doneLock);
+            job.done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    insidePoolWorker = true;
+
+    while (true)
+    {
+        shared_ptr<Job> job;
+        unsigned slot = 0;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wakeUp.wait(guard, [this]()
+                        { return stopping || !jobs.empty(); });
+            if (stopping)
+            {
+                return;
+            }
+
+            job = jobs.front();
+            slot = job->nextSlot++;
+            if (job->nextSlot >= job->participants)
+            {
+                jobs.pop_front(); // every slot is taken
+            }
+        }
+
+        runSlot(*job, slot);
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const function<void(size_t, size_t)> &fn, unsigned maxThreads)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    grain = std::max<size_t>(1, grain);
+    size_t chunkCount = (count + grain - 1) / grain;
+
+    unsigned participants = getThreadCount();
+    if (maxThreads > 0)
+    {
+        participants = std::min(participants, maxThreads);
+    }
+    participants = static_cast<unsigned>(std::min<size_t>(participants, chunkCount));
+
+    // Nothing to share (or already on a worker): run the chunks inline
+    if (participants <= 1 || insidePoolWorker)
+    {
+        for (size_t first = 0; first < count; first += grain)
+        {
+            fn(first, std::min(count, first + grain));
+        }
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->fn = &fn;
+    job->participants = participants;
+    job->pending = chunkCount;
+
+    // Contiguous share of chunks for every participant
+    for (unsigned p = 0; p < participants; ++p)
+    {
+        job->queues.emplace_back(new ChunkQueue());
+        size_t firstChunk = chunkCount * p / participants;
+        size_t lastChunk = chunkCount * (p + 1) / participants;
+        for (size_t c = firstChunk; c < lastChunk; ++c)
+        {
+            job->queues[p]->chunks.emplace_back(c * grain, std::min(count, (c + 1) * grain));
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.push_back(job);
+    }
+    if (participants == 2)
+    {
+        wakeUp.notify_one();
+    }
+    else
+    {
+        wakeUp.notify_all();
+    }
+
+    runSlot(*job, 0);
+
+    {
+        std::unique_lock<std::mutex> guard(job->doneLock);
+        job->done.wait(guard, [&job]()
+                       { return job->pending.load() == 0; });
+    }
+
+    // Workers that did not get a slot in time must not pick it up anymore
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = std::find(jobs.begin(), jobs.end(), job);
+    if (it != jobs.end())
+    {
+        jobs.erase(it);
+    }
+}
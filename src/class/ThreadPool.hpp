@@ -0,0 +1,88 @@
+#ifndef _THREADPOOL_HPP_
+#define _THREADPOOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Worker pool shared by the encoding stages
+ *   parallelFor() cuts a range in chunks, gives every participating thread a
+ *   contiguous share of them, and lets threads that run dry steal chunks from
+ *   the back of the others' queues. The calling thread always takes part, so
+ *   several encoders can use the same pool at once without deadlocking.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * @brief Start the workers
+     *
+     * @param threads total threads working on a job, caller included (0 = one per core)
+     */
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * @brief Run fn(begin, end) over [0, count), returns when everything is done
+     *
+     * @param count size of the range
+     * @param grain number of items per chunk
+     * @param fn work on one chunk (at most grain items), called concurrently
+     * @param maxThreads cap on the threads working on this call (0 = whole pool)
+     */
+    void parallelFor(size_t count, size_t grain, const function<void(size_t, size_t)> &fn, unsigned maxThreads = 0);
+
+    /**
+     * @brief Threads working on a job, caller included
+     */
+    unsigned getThreadCount() const;
+
+    /**
+     * @brief Process wide pool, one thread per core
+     */
+    static ThreadPool &shared();
+
+private:
+    struct ChunkQueue
+    {
+        mutex lock;
+        deque<pair<size_t, size_t>> chunks;
+
+        bool popFront(pair<size_t, size_t> &chunk);
+        bool popBack(pair<size_t, size_t> &chunk);
+    };
+
+    struct Job
+    {
+        const function<void(size_t, size_t)> *fn = nullptr;
+        vector<unique_ptr<ChunkQueue>> queues;
+        unsigned participants = 0;
+        unsigned nextSlot = 1; // slot 0 belongs to the caller
+        atomic<size_t> pending{0};
+        mutex doneLock;
+        condition_variable done;
+    };
+
+    vector<thread> workers;
+    deque<shared_ptr<Job>> jobs;
+    mutex lock;
+    condition_variable wakeUp;
+    bool stopping = false;
+
+    void workerLoop();
+    static void runSlot(Job &job, unsigned slot);
+};
+
+#endif
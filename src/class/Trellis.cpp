@@ -0,0 +1,113 @@
+#include "Trellis.hpp"
+#include <cmath>
+#include <cstdlib>
+
+// Natural (row major) index of the k-th coefficient of the zigzag scan
+static const uint8_t zigzagToNatural[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+static inline int bitLength(unsigned value)
+{
+    return value == 0 ? 0 : 32 - __builtin_clz(value);
+}
+
+void buildTrellisCosts(const HuffmanCode acCodes[256], TrellisCosts &costs)
+{
+    for (int symbol = 0; symbol < 256; ++symbol)
+    {
+        const HuffmanCode &code = acCodes[symbol];
+        costs.acBits[symbol] = code.length > 0 ? code.length + (symbol & 0x0F) : TrellisCosts::noCodeBits;
+    }
+    costs.eobBits = acCodes[0x00].length > 0 ? acCodes[0x00].length : TrellisCosts::noCodeBits;
+    costs.zrlBits = acCodes[0xF0].length > 0 ? acCodes[0xF0].length : TrellisCosts::noCodeBits;
+}
+
+void trellisQuantizeBlock(const double coefficients[64], const QuantizationTable &table,
+                          const TrellisCosts &costs, double lambda, int16_t out[64])
+{
+    out[0] = quantizeCoefficient(coefficients[0], table.values[0][0], table.reciprocals[0]);
+    for (int i = 1; i < 64; ++i)
+    {
+        out[i] = 0;
+    }
+
+    // 1. Magnitudes and steps in zigzag order, rounded magnitudes, squared
+    //    error of zeroing 1..k (prefix sums); a bit weighs lambda * mean step^2
+    double magnitude[64];
+    double step[64];
+    int rounded[64];
+    double zeroed[64];
+    double meanSquaredStep = 0;
+    zeroed[0] = 0;
+    for (int k = 1; k < 64; ++k)
+    {
+        int n = zigzagToNatural[k];
+        step[k] = table.values[n / 8][n % 8];
+        magnitude[k] = std::fabs(coefficients[n]);
+        rounded[k] = std::abs(quantizeCoefficient(coefficients[n], step[k], table.reciprocals[n]));
+        zeroed[k] = zeroed[k - 1] + magnitude[k] * magnitude[k];
+        meanSquaredStep += step[k] * step[k];
+    }
+    double bitWeight = lambda * meanSquaredStep / 63;
+
+    // 2. best[i]: cheapest coding of 1..i with coefficient i the last nonzero one
+    //    (i = 0: nothing coded yet)
+    double best[64];
+    int value[64];
+    int from[64];
+    int active[64];
+    int activeCount = 0;
+    best[0] = 0;
+    active[activeCount++] = 0;
+
+    for (int i = 1; i < 64; ++i)
+    {
+        best[i] = HUGE_VAL;
+        for (int candidate = rounded[i]; candidate >= 1 && candidate >= rounded[i] - 1; --candidate)
+        {
+            int size = bitLength(candidate);
+            double error = magnitude[i] - candidate * step[i];
+            double distortion = error * error;
+            for (int a = 0; a < activeCount; ++a)
+            {
+                int j = active[a];
+                int run = i - j - 1;
+                double bits = (run >> 4) * costs.zrlBits + costs.acBits[((run & 15) << 4) | size];
+                double cost = best[j] + (zeroed[i - 1] - zeroed[j]) + bitWeight * bits + distortion;
+                if (cost < best[i])
+                {
+                    best[i] = cost;
+                    value[i] = candidate;
+                    from[i] = j;
+                }
+            }
+        }
+        if (best[i] < HUGE_VAL)
+        {
+            active[activeCount++] = i;
+        }
+    }
+
+    // 3. Last nonzero coefficient: the rest is zeroed, EOB unless it is 63
+    int last = 0;
+    double lastCost = HUGE_VAL;
+    for (int a = 0; a < activeCount; ++a)
+    {
+        int j = active[a];
+        double cost = best[j] + (zeroed[63] - zeroed[j]) + (j < 63 ? bitWeight * costs.eobBits : 0);
+        if (cost <= lastCost)
+        {
+            lastCost = cost;
+            last = j;
+        }
+    }
+
+    for (int i = last; i > 0; i = from[i])
+    {
+        int n = zigzagToNatural[i];
+        out[n] = static_cast<int16_t>(coefficients[n] < 0 ? -value[i] : value[i]);
+    }
+}
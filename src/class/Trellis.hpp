@@ -0,0 +1,50 @@
+#ifndef _TRELLIS_HPP_
+#define _TRELLIS_HPP_
+
+#include <cstdint>
+#include "Huffman.hpp"
+#include "Quantization.hpp"
+
+using namespace std;
+
+/**
+ * @brief Bits spent by the AC symbols of one Huffman table
+ *   acBits[(run << 4) | size]: code length + size magnitude bits
+ *   A symbol without a code costs noCodeBits, so it is never chosen.
+ */
+struct TrellisCosts
+{
+    float acBits[256];
+    float eobBits;
+    float zrlBits;
+
+    static constexpr float noCodeBits = 1e6f;
+};
+
+/**
+ * @brief Costs of the AC codes of a table (as built by buildHuffmanCodes())
+ */
+void buildTrellisCosts(const HuffmanCode acCodes[256], TrellisCosts &costs);
+
+/**
+ * @brief Rate-distortion optimized quantization of one block (trellis)
+ *   DC is rounded as by quantizeCoefficient(). For the AC coefficients, in
+ *   zigzag order, every coefficient may keep its rounded value, lose one
+ *   unit, or become zero; a dynamic programme over the position of the last
+ *   nonzero coefficient picks the choice minimizing
+ *       sum (c - v * step)^2 + lambda * mean(step^2) * bits
+ *   bits counting the zero runs (ZRL), symbols, magnitude bits and EOB.
+ *   The error is the squared pixel error (the DCT is orthonormal), so the
+ *   choice follows PSNR; scaling lambda by the table lets one value suit
+ *   every quality.
+ *
+ * @param coefficients 64 DCT coefficients (row major, scale of forwardDCTFast())
+ * @param table quantization table
+ * @param costs bit costs of the AC table the block will be coded with
+ * @param lambda weight of a bit, 0 gives back the rounded block
+ * @param out 64 quantized coefficients (row major)
+ */
+void trellisQuantizeBlock(const double coefficients[64], const QuantizationTable &table,
+                          const TrellisCosts &costs, double lambda, int16_t out[64]);
+
+#endif
@@ -1,84 +1,238 @@
 #include "PPMImage.hpp"
+#include <cctype>
+#include <cstring>
 
-bool PPMImage::load(const string &filename)
+/**
+ * @brief Skip whitespace and comments (# up to the end of the line)
+ *
+ * @return position of the next token, size at the end of the data
+ */
+static size_t skipSeparators(const uint8_t *data, size_t size, size_t pos)
 {
-    string path = string(INPUT) + filename;
-    ifstream file(path, ios::binary);
+    while (pos < size)
+    {
+        if (data[pos] == '#')
+        {
+            while (pos < size && data[pos] != '\n' && data[pos] != '\r')
+            {
+                pos++;
+            }
+        }
+        else if (data[pos] == ' ' || (data[pos] >= '\t' && data[pos] <= '\r'))
+        {
+            pos++;
+        }
+        else
+        {
+            break;
+        }
+    }
+    return pos;
+}
 
-    // Ensure we can open image
-    if (!file.is_open())
+/**
+ * @brief Read a decimal integer (0..65535) at pos, after the separators
+ *
+ * @param pos moved past the digits
+ * @return false if there is no number
+ */
+static bool readInteger(const uint8_t *data, size_t size, size_t &pos, int &value)
+{
+    pos = skipSeparators(data, size, pos);
+    if (pos >= size || data[pos] < '0' || data[pos] > '9')
     {
-        cerr << "Error: cannot open " << path << endl;
         return false;
     }
 
-    // Check fileType
-    file >> this->fileType;
+    int result = 0;
+    while (pos < size && data[pos] >= '0' && data[pos] <= '9')
+    {
+        result = result * 10 + (data[pos++] - '0');
+        if (result > 65535)
+        {
+            return false;
+        }
+    }
+    value = result;
+    return true;
+}
 
-    if (this->fileType == "P3")
+/**
+ * @brief 8-bit value of every sample 0..maxVal (identity for 255)
+ */
+static vector<uint8_t> sampleScale(int maxVal)
+{
+    vector<uint8_t> scale(maxVal + 1);
+    for (int v = 0; v <= maxVal; ++v)
     {
-        return loadP3(file);
+        scale[v] = static_cast<uint8_t>((v * 255 + maxVal / 2) / maxVal);
     }
-    else if (this->fileType == "P6")
+    return scale;
+}
+
+bool PPMImage::load(const string &filename)
+{
+    return loadMapped(filename, false);
+}
+
+bool PPMImage::loadView(const string &filename)
+{
+    return loadMapped(filename, true);
+}
+
+bool PPMImage::loadHeader(const string &filename)
+{
+    // Mapping is lazy: only the first page of the file is read
+    MappedFile file;
+    size_t offset = 0;
+    if (!file.open(inputDirectory + filename) || !parseHeader(file.data(), file.size(), offset))
     {
-        return loadP6(file);
+        return false;
     }
-    else
+
+    // Dimensions without pixels: drop the previous ones
+    vector<Pixel>().swap(this->pixels);
+    this->pixelView = nullptr;
+    this->mapping.reset();
+    return true;
+}
+
+void PPMImage::setInputDirectory(const string &directory)
+{
+    this->inputDirectory = directory;
+}
+
+bool PPMImage::loadMapped(const string &filename, bool view)
+{
+    string path = inputDirectory + filename;
+    shared_ptr<MappedFile> file = make_shared<MappedFile>();
+
+    // Ensure we can open image
+    if (!file->open(path))
+    {
+        return false;
+    }
+
+    size_t offset = 0;
+    if (!parseHeader(file->data(), file->size(), offset))
     {
-        cerr << "Error: Format isn't handle yet : " << this->fileType << endl;
         return false;
     }
+
+    this->mapping.reset();
+    this->pixelView = nullptr;
+
+    // Zero copy: P6 data already is packed 8-bit RGB
+    if (view && this->fileType == "P6" && this->maxVal == 255)
+    {
+        size_t bytes = static_cast<size_t>(width) * height * 3;
+        if (file->size() - offset < bytes)
+        {
+            cerr << "Error: truncated pixel data in " << path << endl;
+            return false;
+        }
+        vector<Pixel>().swap(this->pixels);
+        this->pixelView = reinterpret_cast<const Pixel *>(file->data() + offset);
+        this->mapping = file;
+        return true;
+    }
+
+    bool loaded = this->fileType == "P3" ? loadP3(file->data(), file->size(), offset)
+                                         : loadP6(file->data(), file->size(), offset);
+    if (!loaded)
+    {
+        cerr << "Error: truncated or invalid pixel data in " << path << endl;
+    }
+    return loaded;
 }
 
-bool PPMImage::loadP3(ifstream &file)
+/**
+ * @brief Magic number, width, height and maxval, comments allowed between them
+ *
+ * @param offset receives the position of the first sample
+ *   (P6: after the single whitespace that ends the header)
+ */
+bool PPMImage::parseHeader(const uint8_t *data, size_t size, size_t &offset)
 {
+    // Check fileType
+    if (size < 2 || data[0] != 'P' || (data[1] != '3' && data[1] != '6'))
+    {
+        cerr << "Error: Format isn't handle yet : " << string(reinterpret_cast<const char *>(data), min<size_t>(size, 2)) << endl;
+        return false;
+    }
+    this->fileType = data[1] == '3' ? "P3" : "P6";
 
-    // Sauter les commentaires
-    while (file >> ws && file.peek() == '#')
+    size_t pos = 2;
+    int w, h, maxValue;
+    // Exactly one whitespace byte between maxval and the binary data
+    if (!readInteger(data, size, pos, w) || !readInteger(data, size, pos, h) ||
+        !readInteger(data, size, pos, maxValue) || w <= 0 || h <= 0 || maxValue <= 0 ||
+        pos >= size || !isspace(data[pos]))
     {
-        string comment;
-        getline(file, comment);
+        cerr << "Error: invalid PPM header" << endl;
+        return false;
     }
 
-    // Get width and height
-    file >> this->width >> this->height;
+    this->width = w;
+    this->height = h;
+    this->maxVal = maxValue;
+    offset = pos + 1;
+    return true;
+}
 
-    // Get the maxValue (0 - 255) of the ppm image
-    file >> this->maxVal;
+bool PPMImage::loadP3(const uint8_t *data, size_t size, size_t offset)
+{
+    size_t count = static_cast<size_t>(width) * height * 3;
+    vector<uint8_t> scale = sampleScale(maxVal);
 
     // Resize memory for every pixels
-    pixels.resize(this->width * this->height);
-    for (int i = 0; i < width * height; ++i)
+    pixels.resize(static_cast<size_t>(width) * height);
+    uint8_t *out = reinterpret_cast<uint8_t *>(pixels.data());
+
+    size_t pos = offset;
+    for (size_t i = 0; i < count; ++i)
     {
-        int r, g, b;
-        file >> r >> g >> b;
+        int value;
+        if (!readInteger(data, size, pos, value))
+        {
+            return false;
+        }
 
-        // Casts value to ensure type is uint8_t
-        pixels[i] = {static_cast<uint8_t>(r), static_cast<uint8_t>(g), static_cast<uint8_t>(b)};
+        // Scaled to 8 bits (values above maxval are clamped)
+        out[i] = scale[min(value, maxVal)];
     }
 
+    this->maxVal = 255;
     return true;
 }
 
-bool PPMImage::loadP6(ifstream &file)
+bool PPMImage::loadP6(const uint8_t *data, size_t size, size_t offset)
 {
-
-    while (file >> ws && file.peek() == '#')
+    size_t samples = static_cast<size_t>(width) * height * 3;
+    size_t sampleBytes = maxVal > 255 ? 2 : 1;
+    if (size - offset < samples * sampleBytes)
     {
-        string comment;
-        getline(file, comment);
+        return false;
     }
 
-    file >> this->width >> this->height;
-    file >> this->maxVal;
+    pixels.resize(static_cast<size_t>(width) * height);
+    uint8_t *out = reinterpret_cast<uint8_t *>(pixels.data());
+    const uint8_t *in = data + offset;
 
-    pixels.resize(width * height);
-    for (auto &p : pixels)
+    if (maxVal == 255)
     {
-        char rgb[3];
-        file.read(rgb, 3);
-        p = {static_cast<uint8_t>(rgb[0]), static_cast<uint8_t>(rgb[1]), static_cast<uint8_t>(rgb[2])};
+        memcpy(out, in, samples);
+        return true;
     }
+
+    // Other ranges: rescale to 8 bits, 16-bit samples are big endian
+    vector<uint8_t> scale = sampleScale(maxVal);
+    for (size_t i = 0; i < samples; ++i)
+    {
+        int value = sampleBytes == 2 ? (in[2 * i] << 8) | in[2 * i + 1] : in[i];
+        out[i] = scale[min(value, maxVal)];
+    }
+    this->maxVal = 255;
     return true;
 }
 
@@ -100,11 +254,12 @@ bool PPMImage::saveP3(const string &fileName)
          << this->width << " " << this->height << endl
          << this->maxVal << endl;
 
-    for (const auto &p : pixels)
+    const Pixel *data = getPixelData();
+    for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i)
     {
-        file << static_cast<int>(p.R) << " "
-             << static_cast<int>(p.G) << " "
-             << static_cast<int>(p.B) << "\n";
+        file << static_cast<int>(data[i].R) << " "
+             << static_cast<int>(data[i].G) << " "
+             << static_cast<int>(data[i].B) << "\n";
     }
 
     return true;
@@ -125,14 +280,8 @@ bool PPMImage::saveP6(const string &filename)
          << width << " " << height << endl
          << maxVal << endl;
 
-    // Write the file
-    for (const auto &p : pixels)
-    {
-        // Tells compilator that it's a char
-        file.write(reinterpret_cast<const char *>(&p.R), 1);
-        file.write(reinterpret_cast<const char *>(&p.G), 1);
-        file.write(reinterpret_cast<const char *>(&p.B), 1);
-    }
+    // Write the file, Pixel is packed RGB: one write for everything
+    file.write(reinterpret_cast<const char *>(getPixelData()), static_cast<streamsize>(width) * height * 3);
 
     return true;
 }
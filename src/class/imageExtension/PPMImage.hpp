@@ -2,9 +2,11 @@
 #define _PPMIMAGE_HPP_
 
 #include "../Image.hpp"
+#include "../MappedFile.hpp"
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <memory>
 
 class PPMImage : public Image
 {
@@ -12,14 +14,55 @@ protected:
     int maxVal;
     string fileType;
 
+    /**
+     * @brief File the pixels of loadView() point into, shared by the copies of the image
+     *
+     */
+    shared_ptr<MappedFile> mapping;
+
+    /**
+     * @brief Prefix of the names given to load(), loadView() and loadHeader()
+     *
+     */
+    string inputDirectory = INPUT;
+
 private:
-    bool loadP3(ifstream &fileName);
-    bool loadP6(ifstream &fileName);
+    bool loadMapped(const string &fileName, bool view);
+    bool parseHeader(const uint8_t *data, size_t size, size_t &offset);
+    bool loadP3(const uint8_t *data, size_t size, size_t offset);
+    bool loadP6(const uint8_t *data, size_t size, size_t offset);
     bool saveP3(const string &filename);
     bool saveP6(const string &filename);
 
 public:
+    /**
+     * @brief Load a P3 or P6 file into the pixel vector
+     *   The file is mapped, the header parsed once, then P6 data is copied with
+     *   a single memcpy and P3 samples go through an integer scanner.
+     *
+     */
     bool load(const string &fileName) override;
+
+    /**
+     * @brief Zero-copy load: P6 pixels (maxval 255) are used in place in the
+     *   mapped file, see getPixelData(). Other files are loaded as by load().
+     *
+     */
+    bool loadView(const string &fileName);
+
+    /**
+     * @brief Parse the header only (type, width, height, maxval), no pixels
+     *   are read and the image is left without any
+     *
+     */
+    bool loadHeader(const string &fileName);
+
+    /**
+     * @brief Directory the file names are relative to (INPUT by default,
+     *   "" to use them as given)
+     *
+     */
+    void setInputDirectory(const string &directory);
     bool save(const string &fileName) override;
     void setMaxVal(int maxVal);
     void setFileType(string fileType);
@@ -1,13 +1,146 @@
 #include "class/imageExtension/PPMImage.cpp"
 #include "class/JPEGCompressor.hpp"
+#include "class/BatchEncoder.hpp"
 
-#include "tools/utils.hpp"
 using namespace std;
 
+#include <cstdlib>
 #include <iostream>
 
-int main()
+static void printUsage(const char *program)
 {
+    cerr << "Usage: " << program << " [options] <file.ppm | directory>...\n"
+         << "  -o <directory>  output directory (default: .), the tree of input directories is mirrored\n"
+         << "  -l <file>       read inputs from a list, one path per line\n"
+         << "  -q <1..100>     quality (default: 50)\n"
+         << "  -t <bytes>      highest quality whose file fits in bytes (replaces -q)\n"
+         << "  -s <mode>       444, 422, 420 (default), 440 or gray\n"
+         << "  -r <mcus>       restart interval (default: 0)\n"
+         << "  -p              progressive\n"
+         << "  -O              optimized Huffman tables\n"
+         << "  -m              memoize uniform and repeated blocks (screenshots, documents)\n"
+         << "  -j <images>     images encoded at the same time (default: one per core)\n"
+         << "Without arguments, " << INPUT << "Poivron.ppm is encoded to sortie.jpg" << endl;
+}
+
+static bool parseSubsampling(const string &name, Subsampling &mode)
+{
+    const pair<const char *, Subsampling> modes[] = {{"444", Subsampling::Mode444}, {"422", Subsampling::Mode422},
+                                                     {"420", Subsampling::Mode420}, {"440", Subsampling::Mode440},
+                                                     {"gray", Subsampling::Grayscale}};
+    for (const auto &entry : modes)
+    {
+        if (name == entry.first)
+        {
+            mode = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Batch front end: encode files, directories and list files
+ *
+ * @return 0 if every image was encoded, 1 otherwise
+ */
+static int runBatch(int argc, char **argv)
+{
+    BatchSettings settings;
+    vector<string> inputs, lists;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-h" || arg == "--help")
+        {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else if (arg == "-p")
+        {
+            settings.progressive = true;
+        }
+        else if (arg == "-O")
+        {
+            settings.optimizeHuffman = true;
+        }
+        else if (arg == "-m")
+        {
+            settings.blockMemoization = true;
+        }
+        else if (hasValue && arg == "-o")
+        {
+            settings.outputDirectory = argv[++i];
+        }
+        else if (hasValue && arg == "-l")
+        {
+            lists.push_back(argv[++i]);
+        }
+        else if (hasValue && arg == "-q")
+        {
+            settings.quality = atoi(argv[++i]);
+        }
+        else if (hasValue && arg == "-t")
+        {
+            settings.targetBytes = static_cast<size_t>(max(0, atoi(argv[++i])));
+        }
+        else if (hasValue && arg == "-r")
+        {
+            settings.restartInterval = atoi(argv[++i]);
+        }
+        else if (hasValue && arg == "-j")
+        {
+            settings.inFlight = static_cast<unsigned>(max(0, atoi(argv[++i])));
+        }
+        else if (hasValue && arg == "-s")
+        {
+            if (!parseSubsampling(argv[++i], settings.subsampling))
+            {
+                cerr << "Unknown subsampling: " << argv[i] << endl;
+                return 1;
+            }
+        }
+        else if (!arg.empty() && arg[0] == '-')
+        {
+            cerr << "Unknown option: " << arg << endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            inputs.push_back(arg);
+        }
+    }
+
+    BatchEncoder batch(settings);
+    bool ok = true;
+    for (const string &input : inputs)
+    {
+        ok = batch.addInput(input) && ok;
+    }
+    for (const string &list : lists)
+    {
+        ok = batch.addListFile(list) && ok;
+    }
+    if (batch.inputCount() == 0)
+    {
+        cerr << "No input image" << endl;
+        return 1;
+    }
+
+    BatchResult result = batch.run();
+    BatchEncoder::printSummary(result, cout);
+    return ok && result.failures == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        return runBatch(argc, argv);
+    }
 
     string fileName = "Poivron.ppm";
     string outputFileName = "outputClown.ppm";
@@ -23,63 +156,4 @@ int main()
     compressor.writeJPEGFile("sortie.jpg");
 
     return 0;
-    // compressor.compress();
-
-    // 3. Convert RGB → YCbCr
-    // compressor.convertToYCbCr();
-    test_YcrCb(&img);
-
-    // // 4. Subsample (4:2:0)
-    // compressor.subsample420();
-    // PPMImage reconstructed = compressor.reconstructRGBImage();
-    // reconstructed.save("resampledImage.ppm");
-
-    // // 5. Split into 8x8 blocks
-    // compressor.splitIntoBlocks();
-
-    // // 6. Apply DCT to all blocks
-    // compressor.applyDCTToAllBlocks();
-
-    // // 7. Quantize all blocks
-    // compressor.quantizeAllBlocks();
-
-    // // 8. Print quantized first Y block (optional debug)
-    // compressor.printQuantizedBlockY(0);
-
-    // // 9. Zigzag scan first quantized Y block
-    // std::vector<int> zz = compressor.zigzagScan(compressor.getQuantizedYBlock(0));
-
-    // std::cout << "\nZigzag scan of first Y block:\n";
-    // for (int val : zz)
-    // {
-    //     std::cout << val << " ";
-    // }
-    // std::cout << "\n";
-
-    // // 10. Run-Length Encode the zigzag block
-    // auto rle = compressor.runLengthEncode(zz);
-
-    // std::cout << "\nRun-Length Encoding output:\n";
-    // for (const auto &[zeros, value] : rle)
-    // {
-    //     std::cout << "(" << zeros << "," << value << ") ";
-    // }
-    // std::cout << "\n";
-
-    // // 11. Huffman encode DC
-    // std::cout << "\nHuffman DC encoding:\n";
-    // std::cout << compressor.huffmanEncodeDC(rle[0].second) << "\n";
-
-    // // 12. Huffman encode AC
-    // std::cout << "\nHuffman AC encoding:\n";
-    // std::cout << compressor.huffmanEncodeAC(rle) << "\n";
-
-    // return 0;
 }
-
-// compressor.printQuantizedBlockY(0);
-
-// test_YcrCb(&img);
-
-// return 0;
-// }
\ No newline at end of file
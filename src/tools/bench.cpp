@@ -0,0 +1,350 @@
+#include "../class/JPEGCompressor.hpp"
+#include "../class/imageExtension/PPMImage.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Per-stage micro-benchmarks of the encoder
+ *
+ *   Every stage runs alone, single threaded, on synthetic images (flat,
+ *   gradient, noise, photo-like) at several resolutions: warm-up runs first,
+ *   then timed runs. Results go to stdout as CSV, one line per image and
+ *   stage, so two runs can be diffed; progress goes to stderr.
+ *
+ *   ns/block: time divided by the 8x8 blocks of the image (Y + Cb + Cr, 4:2:0)
+ *   MB/s: RGB input bytes (width * height * 3) per second
+ *
+ *   Usage: bench.bin [-r runs] [-w warmup] [--quick]
+ */
+
+struct Resolution
+{
+    int width, height;
+};
+
+enum class Pattern
+{
+    Flat,
+    Gradient,
+    Noise,
+    Photo
+};
+
+static const char *patternName(Pattern pattern)
+{
+    switch (pattern)
+    {
+    case Pattern::Flat:
+        return "flat";
+    case Pattern::Gradient:
+        return "gradient";
+    case Pattern::Noise:
+        return "noise";
+    default:
+        return "photo";
+    }
+}
+
+static uint8_t clampByte(double value)
+{
+    return static_cast<uint8_t>(std::max(0.0, std::min(255.0, value)));
+}
+
+/**
+ * @brief Packed RGB test image
+ *   photo: smooth low frequency shading, a few hard edges and light grain,
+ *   which keeps every coefficient band busy like a natural image does
+ */
+static vector<Pixel> makeImage(Pattern pattern, int width, int height)
+{
+    vector<Pixel> pixels(static_cast<size_t>(width) * height);
+    uint32_t seed = 2463534242u;
+    auto random = [&seed]()
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    };
+
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            Pixel &p = pixels[static_cast<size_t>(y) * width + x];
+            double u = static_cast<double>(x) / width, v = static_cast<double>(y) / height;
+            switch (pattern)
+            {
+            case Pattern::Flat:
+                p = {128, 96, 64};
+                break;
+            case Pattern::Gradient:
+                p = {clampByte(255 * u), clampByte(255 * v), clampByte(255 * (1 - u) * v)};
+                break;
+            case Pattern::Noise:
+            {
+                uint32_t r = random();
+                p = {static_cast<uint8_t>(r), static_cast<uint8_t>(r >> 8), static_cast<uint8_t>(r >> 16)};
+                break;
+            }
+            case Pattern::Photo:
+            {
+                double shade = 120 + 60 * sin(6.1 * u + 2.3 * v) * cos(4.7 * v - 1.3 * u);
+                double edge = ((x / 97 + y / 61) % 3 == 0) ? 40 : 0;
+                double grain = static_cast<int>(random() % 17) - 8;
+                p = {clampByte(shade + edge + grain), clampByte(0.8 * shade + grain + 20), clampByte(0.6 * shade - edge + grain + 30)};
+                break;
+            }
+            }
+        }
+    }
+    return pixels;
+}
+
+/**
+ * @brief In-memory Image around generated pixels
+ */
+class SyntheticImage : public Image
+{
+public:
+    SyntheticImage(vector<Pixel> pixels, int width, int height)
+    {
+        this->width = width;
+        this->height = height;
+        this->pixels = std::move(pixels);
+    }
+
+    bool load(const string &) override
+    {
+        return false;
+    }
+
+    bool save(const string &) override
+    {
+        return false;
+    }
+};
+
+struct Timing
+{
+    double minimum, median, mean, deviation; // seconds per run
+    int runs;
+};
+
+/**
+ * @brief Run setup() then stage() warmup + runs times, time the stages only
+ */
+template <typename Setup, typename Stage>
+static Timing measure(int warmup, int runs, Setup setup, Stage stage)
+{
+    vector<double> seconds;
+    for (int i = 0; i < warmup + runs; i++)
+    {
+        setup();
+        auto start = chrono::steady_clock::now();
+        stage();
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (i >= warmup)
+        {
+            seconds.push_back(elapsed);
+        }
+    }
+
+    std::sort(seconds.begin(), seconds.end());
+    Timing t;
+    t.runs = runs;
+    t.minimum = seconds.front();
+    t.median = seconds[seconds.size() / 2];
+    t.mean = 0;
+    for (double s : seconds)
+        t.mean += s;
+    t.mean /= seconds.size();
+    t.deviation = 0;
+    for (double s : seconds)
+        t.deviation += (s - t.mean) * (s - t.mean);
+    t.deviation = sqrt(t.deviation / seconds.size());
+    return t;
+}
+
+// Keeps results alive so the compiler cannot drop the work
+static volatile long sink;
+
+int main(int argc, char **argv)
+{
+    int runs = 7, warmup = 2;
+    bool quick = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-r") && i + 1 < argc)
+            runs = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+            warmup = std::max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--quick"))
+            quick = true;
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [-r runs] [-w warmup] [--quick]" << endl;
+            return 1;
+        }
+    }
+
+    vector<Resolution> resolutions = {{256, 256}, {1024, 768}, {1920, 1080}};
+    if (quick)
+    {
+        resolutions = {{256, 256}, {640, 480}};
+    }
+    const Pattern patterns[4] = {Pattern::Flat, Pattern::Gradient, Pattern::Noise, Pattern::Photo};
+
+    cout << "image,width,height,stage,blocks,runs,min_ns_per_block,median_ns_per_block,mean_ns_per_block,stddev_ns_per_block,median_mb_per_s" << endl;
+
+    for (const Resolution &res : resolutions)
+    {
+        for (Pattern pattern : patterns)
+        {
+            cerr << "Benchmark " << patternName(pattern) << " " << res.width << "x" << res.height << endl;
+            SyntheticImage image(makeImage(pattern, res.width, res.height), res.width, res.height);
+
+            JPEGCompressor compressor(image);
+            compressor.setMaxThreads(1);
+            compressor.setSubsampling(Subsampling::Mode420);
+
+            size_t chromaBlocks = static_cast<size_t>((res.width + 15) / 16) * ((res.height + 15) / 16);
+            size_t blocks = 6 * chromaBlocks;
+            double bytes = 3.0 * res.width * res.height;
+
+            auto report = [&](const char *stage, const Timing &t)
+            {
+                double perBlock = 1e9 / blocks;
+                char line[512];
+                snprintf(line, sizeof(line), "%s,%d,%d,%s,%zu,%d,%.2f,%.2f,%.2f,%.2f,%.1f",
+                         patternName(pattern), res.width, res.height, stage, blocks, t.runs,
+                         t.minimum * perBlock, t.median * perBlock, t.mean * perBlock, t.deviation * perBlock,
+                         bytes / t.median / 1e6);
+                cout << line << endl;
+            };
+            auto nothing = []() {};
+
+            // Colour conversion: floating point reference, SIMD planes, fused with 4:2:0
+            const Pixel *pixels = image.getPixelData();
+            size_t pixelCount = static_cast<size_t>(res.width) * res.height;
+            report("RGBtoYCbCr", measure(warmup, runs, nothing, [&]()
+                                         {
+                double sum = 0;
+                for (size_t i = 0; i < pixelCount; i++)
+                {
+                    YCbCrPixel p = compressor.RGBtoYCbCr(pixels[i]);
+                    sum += p.y + p.cb + p.cr;
+                }
+                sink = static_cast<long>(sum); }));
+            report("convertToYCbCr", measure(warmup, runs, nothing, [&]()
+                                             { compressor.convertToYCbCr(); }));
+            report("subsample420", measure(warmup, runs, nothing, [&]()
+                                           { compressor.subsample420(); }));
+            report("convertImage", measure(warmup, runs, nothing, [&]()
+                                           { compressor.convertImage(); }));
+            report("splitIntoBlocks", measure(warmup, runs, nothing, [&]()
+                                              { compressor.splitIntoBlocks(); }));
+
+            // DCT of every block (split blocks kept as input)
+            BlockStore<double> *planes[3] = {&compressor.blocksY, &compressor.blocksCb, &compressor.blocksCr};
+            BlockStore<double> dctOut[3];
+            for (int c = 0; c < 3; c++)
+                dctOut[c].resize(planes[c]->size());
+            auto dctAll = [&]()
+            {
+                for (int c = 0; c < 3; c++)
+                    for (size_t i = 0; i < planes[c]->size(); i++)
+                        compressor.applyDCT((*planes[c])[i], dctOut[c][i]);
+            };
+            compressor.setDCTMode(DCTMode::Reference);
+            report("applyDCT.reference", measure(warmup, runs, nothing, dctAll));
+            compressor.setDCTMode(DCTMode::Fast);
+            report("applyDCT.fast", measure(warmup, runs, nothing, dctAll));
+
+            BlockStore<int16_t> integerOut[3];
+            const QuantizationTable *tables[3] = {&compressor.quantTables->luminance, &compressor.quantTables->chrominance,
+                                                  &compressor.quantTables->chrominance};
+            report("integerDCTQuantize", measure(warmup, runs, nothing, [&]()
+                                                 {
+                for (int c = 0; c < 3; c++)
+                    compressor.integerDCTQuantizeChannel(*planes[c], integerOut[c], *tables[c]); }));
+
+            // Quantization of the fast DCT output
+            BlockStore<int16_t> quantized[3];
+            for (int c = 0; c < 3; c++)
+                quantized[c].resize(planes[c]->size());
+            report("quantizeBlock", measure(warmup, runs, nothing, [&]()
+                                            {
+                for (int c = 0; c < 3; c++)
+                    for (size_t i = 0; i < dctOut[c].size(); i++)
+                        compressor.quantizeBlock(dctOut[c][i], *tables[c], quantized[c][i]); }));
+
+            // Entropy coding inputs: the encoder's own quantized blocks
+            compressor.applyDCTToAllBlocks();
+            compressor.quantizeAllBlocks();
+            BlockStore<int16_t> *qPlanes[3] = {&compressor.qBlocksY, &compressor.qBlocksCb, &compressor.qBlocksCr};
+            report("zigzag+RLE", measure(warmup, runs, nothing, [&]()
+                                         {
+                long count = 0;
+                for (int c = 0; c < 3; c++)
+                {
+                    for (size_t i = 0; i < qPlanes[c]->size(); i++)
+                    {
+                        int zz[64];
+                        std::pair<int, int> rle[64];
+                        compressor.zigzagScan((*qPlanes[c])[i], zz);
+                        count += compressor.runLengthEncode(zz, rle);
+                    }
+                }
+                sink = count; }));
+
+            // Huffman emission with the Annex K tables (headers build the codes)
+            MemorySink headers;
+            compressor.chooseHuffmanTables(false);
+            compressor.writeHeaders(headers, false);
+            size_t totalMCUs = compressor.mcuColumnCount() * compressor.mcuRowCount();
+            report("huffmanEncode", measure(warmup, runs, [&]()
+                                            { compressor.entropyWriter.clear(); },
+                                            [&]()
+                                            {
+                compressor.encodeMCUs(0, totalMCUs, compressor.entropyWriter);
+                compressor.entropyWriter.flush(); }));
+
+            // PPM loading from a P6 file: copied and zero-copy
+            const string file = "bench_input.ppm";
+            {
+                ofstream out(file, ios::binary);
+                out << "P6\n" << res.width << " " << res.height << "\n255\n";
+                out.write(reinterpret_cast<const char *>(pixels), pixelCount * 3);
+            }
+            report("PPMImage.load", measure(warmup, runs, nothing, [&]()
+                                            {
+                PPMImage loaded;
+                loaded.setInputDirectory("");
+                loaded.load(file);
+                sink = loaded.getPixelData()[pixelCount - 1].G; }));
+            report("PPMImage.loadView", measure(warmup, runs, nothing, [&]()
+                                                {
+                PPMImage loaded;
+                loaded.setInputDirectory("");
+                loaded.loadView(file);
+                long sum = 0;
+                const uint8_t *bytes = reinterpret_cast<const uint8_t *>(loaded.getPixelData());
+                for (size_t i = 0; i < pixelCount * 3; i += 4096)
+                    sum += bytes[i];
+                sink = sum; }));
+            remove(file.c_str());
+        }
+    }
+    return 0;
+}
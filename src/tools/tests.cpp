@@ -0,0 +1,157 @@
+#include "../class/imageExtension/PPMImage.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief Test program: runs the test_* checks of utils.cpp on one image
+ *
+ *   Every test prints its figures, then a PASS / FAIL line; the exit code is
+ *   0 only if every selected test passed.
+ *
+ *   Usage: test.bin [-i image.ppm] [-l] [test name...]
+ *     -i  input image, in assets/input (default: Poivron.ppm)
+ *     -l  list the tests
+ *     names select tests (default: all of them)
+ */
+
+// Heap allocations of the test program, for test_encoderReuse()
+static std::atomic<size_t> heapAllocations{0};
+
+void *operator new(size_t size)
+{
+    heapAllocations++;
+    if (void *memory = std::malloc(size != 0 ? size : 1))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    heapAllocations++;
+    size_t align = static_cast<size_t>(alignment);
+    if (void *memory = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, size_t, std::align_val_t) noexcept
+{
+    std::free(memory);
+}
+
+size_t heapAllocationCount()
+{
+    return heapAllocations;
+}
+
+struct TestCase
+{
+    const char *name;
+    bool (*run)(Image *img);
+};
+
+static const TestCase tests[] = {
+    {"DCTEngines", test_DCTEngines},
+    {"integerDCT", test_integerDCT},
+    {"streamingEncoder", test_streamingEncoder},
+    {"restartIntervals", test_restartIntervals},
+    {"threadPool", test_threadPool},
+    {"optimizedHuffman", test_optimizedHuffman},
+    {"progressive", test_progressive},
+    {"quality", test_quality},
+    {"colorConversion", test_colorConversion},
+    {"fusedSubsampling", test_fusedSubsampling},
+    {"subsamplingModes", test_subsamplingModes},
+    {"ppmLoader", test_ppmLoader},
+    {"imageView", test_imageView},
+    {"outputSinks", test_outputSinks},
+    {"encodeStats", test_encodeStats},
+    {"decoder", test_decoder},
+    {"trellis", test_trellis},
+    {"rateControl", test_rateControl},
+    {"renditions", test_renditions},
+    {"encoderReuse", test_encoderReuse},
+    {"blockMemoization", test_blockMemoization},
+    {"batchEncoder", test_batchEncoder}};
+
+int main(int argc, char **argv)
+{
+    string fileName = "Poivron.ppm";
+    vector<string> selected;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "-i" && i + 1 < argc)
+        {
+            fileName = argv[++i];
+        }
+        else if (arg == "-l")
+        {
+            for (const TestCase &test : tests)
+            {
+                cout << test.name << endl;
+            }
+            return 0;
+        }
+        else
+        {
+            bool known = std::any_of(std::begin(tests), std::end(tests), [&arg](const TestCase &test)
+                                     { return arg == test.name; });
+            if (!known)
+            {
+                cerr << "Unknown test: " << arg << " (-l lists them)" << endl;
+                return 1;
+            }
+            selected.push_back(arg);
+        }
+    }
+
+    PPMImage img;
+    if (!img.load(fileName))
+    {
+        return 1;
+    }
+
+    int run = 0, failures = 0;
+    for (const TestCase &test : tests)
+    {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), test.name) == selected.end())
+        {
+            continue;
+        }
+        ++run;
+        bool passed = test.run(&img);
+        cout << (passed ? "PASS " : "FAIL ") << test.name << endl;
+        failures += passed ? 0 : 1;
+    }
+
+    cout << run - failures << "/" << run << " tests passed" << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -1,6 +1,15 @@
 #include "utils.hpp"
 #include "../class/JPEGCompressor.hpp"
+#include "../class/BatchEncoder.hpp"
+#include "../class/JPEGDecoder.hpp"
 #include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
 #include <string>
 
 #include "../class/imageExtension/PPMImage.hpp"
@@ -86,6 +95,1353 @@ void test_YcrCb(Image *img)
     testImg.save("Clown_Rouge.ppm");
 }
 
+/**
+ * @brief Check the fast DCT engine against the reference one
+ *   on every Y block of the image and on random blocks
+ *
+ * @return true if every coefficient matches within tolerance
+ */
+bool test_DCTEngines(Image *img)
+{
+    const double tolerance = 1e-6;
+    double maxError = 0.0;
+
+    auto compare = [&maxError](const double samples[64])
+    {
+        double reference[64], fast[64];
+        forwardDCTReference(samples, reference);
+        forwardDCTFast(samples, fast);
+        for (int i = 0; i < 64; ++i)
+        {
+            maxError = max(maxError, std::abs(reference[i] - fast[i]));
+        }
+    };
+
+    // Blocks coming from the image
+    JPEGCompressor compressor(*img);
+    compressor.convertToYCbCr();
+    compressor.subsample420();
+    compressor.splitIntoBlocks();
+
+    for (size_t b = 0; b < compressor.blocksY.size(); b++)
+    {
+        double samples[64];
+        for (int i = 0; i < 64; i++)
+            samples[i] = compressor.blocksY[b][i] - 128.0;
+        compare(samples);
+    }
+
+    // Random blocks over the whole level-shifted range
+    srand(42);
+    for (int i = 0; i < 1000; i++)
+    {
+        double samples[64];
+        for (int k = 0; k < 64; k++)
+            samples[k] = (rand() % 256) - 128.0;
+        compare(samples);
+    }
+
+    cout << "DCT engines max error : " << maxError << " (tolerance " << tolerance << ")" << endl;
+    return maxError <= tolerance;
+}
+
+/**
+ * @brief Check the integer DCT + quantization engine
+ *   - the AVX2 kernel must give exactly the scalar result
+ *   - quantized values may differ from the floating point path by at most 1
+ *
+ * @return true if both checks pass
+ */
+bool test_integerDCT(Image *img)
+{
+    // Scalar vs SIMD on random blocks (a count that is not a multiple of 8)
+    const size_t count = 1003;
+    vector<int16_t> samples(count * 64), scalar(count * 64), simd(count * 64);
+    srand(7);
+    for (auto &s : samples)
+        s = static_cast<int16_t>((rand() % 256) - 128);
+
+    // Small steps stress the rounding, large ones the zero run
+    uint8_t steps[8][8];
+    for (int i = 0; i < 64; i++)
+        steps[i / 8][i % 8] = static_cast<uint8_t>(1 + (i * 7) % 40);
+    QuantizationTable table;
+    buildQuantizationTable(steps, table);
+
+    forwardDCTQuantizeIntegerScalar(samples.data(), scalar.data(), count, table);
+    forwardDCTQuantizeInteger(samples.data(), simd.data(), count, table);
+    bool identical = (scalar == simd);
+
+    // Integer vs floating point engine on the image
+    JPEGCompressor floating(*img), integer(*img);
+    floating.setDCTMode(DCTMode::Fast);
+    integer.setDCTMode(DCTMode::Integer);
+    floating.compress();
+    integer.compress();
+
+    int maxDiff = 0;
+    size_t mismatches = 0;
+    for (size_t b = 0; b < floating.qBlocksY.size(); b++)
+        for (int i = 0; i < 64; i++)
+        {
+            int diff = std::abs(floating.qBlocksY[b][i] - integer.qBlocksY[b][i]);
+            maxDiff = max(maxDiff, diff);
+            mismatches += (diff != 0);
+        }
+
+    cout << "Integer DCT : AVX2 " << (hasAVX2DCT() ? "on" : "off")
+         << ", SIMD == scalar : " << (identical ? "yes" : "no")
+         << ", max diff vs float : " << maxDiff
+         << " (" << mismatches << " coefficients)" << endl;
+    return identical && maxDiff <= 1;
+}
+
+/**
+ * @brief The streaming encoder must write exactly what compress() + writeJPEGFile() write
+ *
+ * @return true if both files are identical
+ */
+bool test_streamingEncoder(Image *img)
+{
+    JPEGCompressor full(*img), streaming(*img);
+    full.compress();
+    full.writeJPEGFile("test_full.jpg");
+    streaming.writeJPEGFileStreaming("test_streaming.jpg");
+
+    ifstream a("test_full.jpg", ios::binary), b("test_streaming.jpg", ios::binary);
+    string fullBytes((istreambuf_iterator<char>(a)), istreambuf_iterator<char>());
+    string streamingBytes((istreambuf_iterator<char>(b)), istreambuf_iterator<char>());
+
+    bool identical = !fullBytes.empty() && fullBytes == streamingBytes;
+    cout << "Streaming encoder identical to full frame : " << (identical ? "yes" : "no") << endl;
+
+    // The streaming encoder is sequential: with setProgressive(true) it still
+    // writes the baseline file, which must decode
+    bool decoded = true;
+    const Subsampling modes[3] = {Subsampling::Mode420, Subsampling::Mode444, Subsampling::Grayscale};
+    for (Subsampling mode : modes)
+    {
+        for (int interval : {0, 8})
+        {
+            MemorySink baseline, progressive;
+            JPEGCompressor compressor(*img);
+            compressor.setSubsampling(mode);
+            compressor.setRestartInterval(interval);
+            compressor.encodeStreaming(baseline);
+            compressor.setProgressive(true);
+            bool written = compressor.encodeStreaming(progressive);
+
+            JPEGDecoder decoder;
+            PPMImage image;
+            decoded = decoded && written && progressive.buffer() == baseline.buffer() &&
+                      decoder.decode(progressive.buffer(), image) && image.getWidth() == img->getWidth();
+        }
+    }
+    cout << "Streaming encoder with progressive set : " << (decoded ? "baseline, decoded" : "not decodable") << endl;
+    return identical && decoded;
+}
+
+/**
+ * @brief Restart intervals: the parallel segment coder must match the serial
+ *   streaming coder byte for byte, with one RSTn marker between segments
+ *
+ * @return true if both files are identical and the marker count is right
+ */
+bool test_restartIntervals(Image *img)
+{
+    const int interval = 7;
+
+    JPEGCompressor parallel(*img), serial(*img);
+    parallel.setRestartInterval(interval);
+    serial.setRestartInterval(interval);
+    parallel.compress();
+    parallel.writeJPEGFile("test_restart_parallel.jpg");
+    serial.writeJPEGFileStreaming("test_restart_serial.jpg");
+
+    ifstream a("test_restart_parallel.jpg", ios::binary), b("test_restart_serial.jpg", ios::binary);
+    string parallelBytes((istreambuf_iterator<char>(a)), istreambuf_iterator<char>());
+    string serialBytes((istreambuf_iterator<char>(b)), istreambuf_iterator<char>());
+
+    size_t markers = 0;
+    for (size_t i = 0; i + 1 < parallelBytes.size(); i++)
+    {
+        uint8_t next = static_cast<uint8_t>(parallelBytes[i + 1]);
+        if (static_cast<uint8_t>(parallelBytes[i]) == 0xFF && next >= 0xD0 && next <= 0xD7)
+            markers++;
+    }
+
+    size_t totalMCUs = static_cast<size_t>((img->getWidth() + 15) / 16) * ((img->getHeight() + 15) / 16);
+    size_t expected = (totalMCUs + interval - 1) / interval - 1;
+
+    bool identical = !parallelBytes.empty() && parallelBytes == serialBytes;
+    cout << "Restart interval " << interval << " : " << markers << " RST markers (expected " << expected
+         << "), parallel == serial : " << (identical ? "yes" : "no") << endl;
+    return identical && markers == expected;
+}
+
+/**
+ * @brief Multi-threaded encode must be bit-identical to the single-threaded one
+ *   (every DCT engine, with and without restart intervals)
+ *
+ * @return true if every pair of files is identical
+ */
+bool test_threadPool(Image *img)
+{
+    ThreadPool pool(8);
+    bool ok = true;
+
+    for (DCTMode mode : {DCTMode::Fast, DCTMode::Integer})
+    {
+        for (int interval : {0, 5})
+        {
+            JPEGCompressor single(*img), multi(*img);
+            single.setDCTMode(mode);
+            multi.setDCTMode(mode);
+            single.setRestartInterval(interval);
+            multi.setRestartInterval(interval);
+            single.setMaxThreads(1);
+            multi.setThreadPool(&pool);
+
+            single.compress();
+            multi.compress();
+            single.writeJPEGFile("test_single.jpg");
+            multi.writeJPEGFile("test_multi.jpg");
+
+            ifstream a("test_single.jpg", ios::binary), b("test_multi.jpg", ios::binary);
+            string singleBytes((istreambuf_iterator<char>(a)), istreambuf_iterator<char>());
+            string multiBytes((istreambuf_iterator<char>(b)), istreambuf_iterator<char>());
+            ok = ok && !singleBytes.empty() && singleBytes == multiBytes;
+        }
+    }
+
+    cout << "Thread pool (" << pool.getThreadCount() << " threads) identical to single thread : "
+         << (ok ? "yes" : "no") << endl;
+    return ok;
+}
+
+/**
+ * @brief Optimized Huffman tables: parallel statistics equal the serial ones,
+ *   every code fits in 16 bits and the file is smaller than with Annex K tables
+ *
+ * @return true if all checks pass
+ */
+bool test_optimizedHuffman(Image *img)
+{
+    bool ok = true;
+
+    for (int interval : {0, 3})
+    {
+        JPEGCompressor standard(*img), optimized(*img);
+        standard.setRestartInterval(interval);
+        optimized.setRestartInterval(interval);
+        optimized.setOptimizeHuffman(true);
+        standard.compress();
+        optimized.compress();
+
+        HuffmanStatistics parallel, serial;
+        optimized.gatherStatistics(parallel);
+        serial.clear();
+        size_t totalMCUs = static_cast<size_t>((img->getWidth() + 15) / 16) * ((img->getHeight() + 15) / 16);
+        optimized.countMCUs(0, totalMCUs, serial);
+        ok = ok && memcmp(&parallel, &serial, sizeof(HuffmanStatistics)) == 0;
+
+        standard.writeJPEGFile("test_huffman_standard.jpg");
+        optimized.writeJPEGFile("test_huffman_optimized.jpg");
+
+        for (const HuffmanTable *table : {&optimized.dcLumaTable, &optimized.acLumaTable,
+                                          &optimized.dcChromaTable, &optimized.acChromaTable})
+        {
+            // Kraft sum below 1: the all-ones code is never used
+            int count = 0;
+            double kraft = 0.0;
+            for (int L = 1; L <= 16; L++)
+            {
+                count += table->bits[L - 1];
+                kraft += table->bits[L - 1] / double(1 << L);
+            }
+            ok = ok && count == table->count && kraft < 1.0;
+        }
+
+        ifstream a("test_huffman_standard.jpg", ios::binary | ios::ate), b("test_huffman_optimized.jpg", ios::binary | ios::ate);
+        long standardSize = a.tellg();
+        long optimizedSize = b.tellg();
+        ok = ok && optimizedSize > 0 && optimizedSize < standardSize;
+
+        cout << "Huffman (restart " << interval << ") : standard " << standardSize << " bytes, optimized "
+             << optimizedSize << " bytes (" << fixed << setprecision(1)
+             << 100.0 * (standardSize - optimizedSize) / standardSize << "% smaller)" << endl;
+    }
+
+    // Counts whose merged trees pass 1e9 (large images, summed statistics)
+    uint32_t large[256] = {};
+    for (int symbol = 0; symbol < 12; symbol++)
+    {
+        large[symbol] = 600000000u + symbol;
+    }
+    HuffmanTable largeTable;
+    buildOptimalHuffmanTable(large, largeTable);
+    int largeCount = 0;
+    double largeKraft = 0.0;
+    for (int L = 1; L <= 16; L++)
+    {
+        largeCount += largeTable.bits[L - 1];
+        largeKraft += largeTable.bits[L - 1] / double(1 << L);
+    }
+    bool largeOk = largeTable.count == 12 && largeCount == 12 && largeKraft < 1.0;
+    cout << "Huffman table from counts above 1e9 : " << (largeOk ? "ok" : "wrong") << endl;
+    ok = ok && largeOk;
+
+    cout << "Optimized Huffman tables : " << (ok ? "ok" : "FAILED") << endl;
+    return ok;
+}
+
+/**
+ * @brief Progressive encode: SOF2 with one SOS per scan of the script,
+ *   invalid scripts rejected
+ *
+ * @return true if all checks pass
+ */
+bool test_progressive(Image *img)
+{
+    JPEGCompressor compressor(*img);
+    compressor.setProgressive(true);
+    compressor.compress();
+
+    // AC before DC, AC scan with two components, refinement without first pass
+    bool rejected = !compressor.setScanScript({{1, {0}, 1, 63, 0, 0}, {3, {0, 1, 2}, 0, 0, 0, 0}}) &&
+                    !compressor.setScanScript({{3, {0, 1, 2}, 0, 0, 0, 0}, {2, {1, 2}, 1, 63, 0, 0}}) &&
+                    !compressor.setScanScript({{3, {0, 1, 2}, 0, 0, 0, 0}, {1, {0}, 1, 63, 1, 0}});
+
+    bool ok = rejected;
+    for (int interval : {0, 4})
+    {
+        compressor.setRestartInterval(interval);
+        compressor.writeJPEGFile("test_progressive.jpg");
+
+        ifstream file("test_progressive.jpg", ios::binary);
+        string bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+        size_t sof2 = 0, sos = 0;
+        for (size_t i = 0; i + 1 < bytes.size(); i++)
+        {
+            if (static_cast<uint8_t>(bytes[i]) != 0xFF)
+                continue;
+            uint8_t marker = static_cast<uint8_t>(bytes[i + 1]);
+            sof2 += marker == 0xC2;
+            sos += marker == 0xDA;
+        }
+
+        size_t expected = defaultScanScript(3).size();
+        cout << "Progressive (restart " << interval << ") : " << bytes.size() << " bytes, " << sos
+             << " scans (expected " << expected << ")" << endl;
+        ok = ok && sof2 == 1 && sos == expected;
+    }
+
+    cout << "Progressive encoder : " << (ok ? "ok" : "FAILED") << endl;
+    return ok;
+}
+
+/**
+ * @brief Quality factor: IJG scaling of the tables, reciprocal quantization
+ *   rounding like a division, smaller files at lower quality
+ *
+ * @return true if all checks pass
+ */
+bool test_quality(Image *img)
+{
+    // Quality 50 = example tables, cached tables are shared
+    const QuantizationTables &q50 = quantizationTablesForQuality(50);
+    bool ok = memcmp(q50.luminance.values, standardLuminanceQuantTable, 64) == 0 &&
+              memcmp(q50.chrominance.values, standardChrominanceQuantTable, 64) == 0 &&
+              &quantizationTablesForQuality(50) == &q50 &&
+              quantizationTablesForQuality(100).luminance.values[7][7] == 1 &&
+              quantizationTablesForQuality(1).luminance.values[0][0] == 255;
+
+    // Reciprocal rounding vs division, ties included
+    srand(11);
+    size_t wrong = 0;
+    for (int step = 1; step <= 255; step++)
+    {
+        for (int i = 0; i < 2000; i++)
+        {
+            double value = (i < 100) ? (i - 50 + 0.5) * step : (rand() % 20001 - 10000) / 7.0;
+            double reciprocal = 1.0 / step;
+            wrong += quantizeCoefficient(value, step, reciprocal) != static_cast<int16_t>(std::round(value / step));
+        }
+    }
+    ok = ok && wrong == 0;
+
+    long previous = 0;
+    for (int quality : {10, 50, 75, 95})
+    {
+        JPEGCompressor compressor(*img);
+        compressor.setQuality(quality);
+        compressor.compress();
+        compressor.writeJPEGFile("test_quality.jpg");
+
+        ifstream file("test_quality.jpg", ios::binary | ios::ate);
+        long size = file.tellg();
+        cout << "Quality " << quality << " : " << size << " bytes" << endl;
+        ok = ok && size > previous;
+        previous = size;
+    }
+
+    cout << "Quality factor : " << (ok ? "ok" : "FAILED") << " (" << wrong << " rounding mismatches)" << endl;
+    return ok;
+}
+
+/**
+ * @brief Colour conversion kernels: SSE2 and AVX2 identical to scalar (8-bit and
+ *   int16 outputs), and within 1 of the floating point conversion
+ *
+ * @return true if all checks pass
+ */
+bool test_colorConversion(Image *img)
+{
+    vector<Pixel> pixels = img->getPixels();
+    // Extremes (pure red/blue saturate Cb/Cr) and an odd count for the tails
+    pixels.push_back({255, 0, 0});
+    pixels.push_back({0, 0, 255});
+    pixels.push_back({255, 255, 255});
+    size_t count = pixels.size();
+
+    vector<uint8_t> planes[3][3];
+    vector<int16_t> shifted[3][3];
+    const ColorKernel kernels[3] = {ColorKernel::Scalar, ColorKernel::SSE2, ColorKernel::AVX2};
+    for (int k = 0; k < 3; k++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            planes[k][c].resize(count);
+            shifted[k][c].resize(count);
+        }
+        rgbToYCbCr(pixels.data(), count, planes[k][0].data(), planes[k][1].data(), planes[k][2].data(), kernels[k]);
+        rgbToYCbCr(pixels.data(), count, shifted[k][0].data(), shifted[k][1].data(), shifted[k][2].data(), kernels[k]);
+    }
+
+    bool identical = true;
+    for (int k = 1; k < 3; k++)
+        for (int c = 0; c < 3; c++)
+            identical = identical && planes[k][c] == planes[0][c] && shifted[k][c] == shifted[0][c];
+    for (int c = 0; c < 3; c++)
+        for (size_t i = 0; i < count; i++)
+            identical = identical && shifted[0][c][i] == planes[0][c][i] - 128;
+
+    JPEGCompressor compressor(*img);
+    double maxError = 0.0;
+    for (size_t i = 0; i < count; i++)
+    {
+        YCbCrPixel reference = compressor.RGBtoYCbCr(pixels[i]);
+        maxError = max(maxError, fabs(min(255.0, reference.y) - planes[0][0][i]));
+        maxError = max(maxError, fabs(min(255.0, reference.cb) - planes[0][1][i]));
+        maxError = max(maxError, fabs(min(255.0, reference.cr) - planes[0][2][i]));
+    }
+
+    const char *best = bestColorKernel() == ColorKernel::AVX2 ? "AVX2" : (bestColorKernel() == ColorKernel::SSE2 ? "SSE2" : "scalar");
+    cout << "Colour conversion (" << best << ") : kernels identical : " << (identical ? "yes" : "no")
+         << ", max error vs floating point : " << maxError << endl;
+    return identical && maxError <= 1.0;
+}
+
+/**
+ * @brief Fused conversion + 4:2:0 subsampling: every kernel gives the same
+ *   planes (odd widths/heights included), and they stay within one level of
+ *   the two separate passes (which round before averaging)
+ */
+bool test_fusedSubsampling(Image *img)
+{
+    JPEGCompressor compressor(*img);
+    compressor.convertToYCbCr();
+    compressor.subsample420();
+    vector<uint8_t> separateY = compressor.Y;
+    vector<uint8_t> separateCb = compressor.Cb_sub;
+    vector<uint8_t> separateCr = compressor.Cr_sub;
+
+    compressor.convertImage();
+    bool sameLuma = compressor.Y == separateY;
+    int maxDifference = 0;
+    for (size_t i = 0; i < separateCb.size(); i++)
+    {
+        maxDifference = max(maxDifference, abs(compressor.Cb_sub[i] - separateCb[i]));
+        maxDifference = max(maxDifference, abs(compressor.Cr_sub[i] - separateCr[i]));
+    }
+
+    // Kernels on every row pair, and one pixel narrower for the odd width case
+    const Pixel *pixels = img->getPixelData();
+    size_t width = compressor.width;
+    size_t height = compressor.height;
+    size_t widths[2] = {width, width - 1};
+    const ColorKernel kernels[3] = {ColorKernel::Scalar, ColorKernel::SSE2, ColorKernel::AVX2};
+    bool identical = true;
+    for (size_t w : widths)
+    {
+        size_t halfWidth = (w + 1) / 2;
+        vector<uint8_t> out[3][4];
+        for (size_t y = 0; y < height; y += 2)
+        {
+            const Pixel *row1 = y + 1 < height ? &pixels[(y + 1) * width] : nullptr;
+            for (int k = 0; k < 3; k++)
+            {
+                out[k][0].assign(w, 0);
+                out[k][1].assign(w, 0);
+                out[k][2].assign(halfWidth, 0);
+                out[k][3].assign(halfWidth, 0);
+                rgbToYCbCr420(&pixels[y * width], row1, w, out[k][0].data(), out[k][1].data(),
+                              out[k][2].data(), out[k][3].data(), kernels[k]);
+            }
+            for (int k = 1; k < 3; k++)
+                for (int c = 0; c < 4; c++)
+                    identical = identical && out[k][c] == out[0][c];
+
+            // 4:4:0: vertical pairs only, full width chroma
+            for (int k = 0; k < 3; k++)
+            {
+                out[k][0].assign(w, 0);
+                out[k][1].assign(w, 0);
+                out[k][2].assign(w, 0);
+                out[k][3].assign(w, 0);
+                rgbToYCbCr440(&pixels[y * width], row1, w, out[k][0].data(), out[k][1].data(),
+                              out[k][2].data(), out[k][3].data(), kernels[k]);
+            }
+            for (int k = 1; k < 3; k++)
+                for (int c = 0; c < 4; c++)
+                    identical = identical && out[k][c] == out[0][c];
+        }
+    }
+
+    cout << "Fused 4:2:0 / 4:4:0 conversion : kernels identical : " << (identical ? "yes" : "no")
+         << ", luma identical : " << (sameLuma ? "yes" : "no")
+         << ", max chroma difference vs separate passes : " << maxDifference << endl;
+    return identical && sameLuma && maxDifference <= 1;
+}
+
+/**
+ * @brief Subsampling modes: for each one the streaming encoder must match the
+ *   full frame encoder (baseline and restart intervals), and the SOF must
+ *   declare the right components and sampling factors
+ */
+bool test_subsamplingModes(Image *img)
+{
+    const Subsampling modes[5] = {Subsampling::Mode444, Subsampling::Mode422, Subsampling::Mode420,
+                                  Subsampling::Mode440, Subsampling::Grayscale};
+    const char *names[5] = {"4:4:4", "4:2:2", "4:2:0", "4:4:0", "grayscale"};
+    const int samplings[5] = {0x11, 0x21, 0x22, 0x12, 0x11};
+    const int components[5] = {3, 3, 3, 3, 1};
+
+    bool ok = true;
+    for (int m = 0; m < 5; m++)
+    {
+        for (int interval : {0, 5})
+        {
+            JPEGCompressor full(*img), streaming(*img);
+            full.setSubsampling(modes[m]);
+            streaming.setSubsampling(modes[m]);
+            full.setRestartInterval(interval);
+            streaming.setRestartInterval(interval);
+            full.compress();
+            full.writeJPEGFile("test_full.jpg");
+            streaming.writeJPEGFileStreaming("test_streaming.jpg");
+
+            ifstream a("test_full.jpg", ios::binary), b("test_streaming.jpg", ios::binary);
+            string fullBytes((istreambuf_iterator<char>(a)), istreambuf_iterator<char>());
+            string streamingBytes((istreambuf_iterator<char>(b)), istreambuf_iterator<char>());
+
+            // SOF0: FF C0, length, precision, height, width, Nf, then ID / HV / Tq per component
+            size_t sof = fullBytes.find("\xFF\xC0");
+            bool header = sof != string::npos && sof + 12 < fullBytes.size() &&
+                          static_cast<uint8_t>(fullBytes[sof + 9]) == components[m] &&
+                          static_cast<uint8_t>(fullBytes[sof + 11]) == samplings[m];
+            bool identical = !fullBytes.empty() && fullBytes == streamingBytes;
+
+            if (interval == 0)
+            {
+                cout << "Subsampling " << names[m] << " : " << fullBytes.size() << " bytes, streaming identical : "
+                     << (identical ? "yes" : "no") << ", header : " << (header ? "ok" : "wrong") << endl;
+            }
+            ok = ok && identical && header;
+        }
+    }
+    return ok;
+}
+
+/**
+ * @brief PPM loader: P6 and P3 files with comments in the header, loaded by
+ *   copy and as a zero-copy view, must give back the pixels of img
+ */
+bool test_ppmLoader(Image *img)
+{
+    size_t count = static_cast<size_t>(img->getWidth()) * img->getHeight();
+    const Pixel *reference = img->getPixelData();
+
+    // Files written in the temporary directory, loaded by full path, removed at the end
+    namespace fs = std::filesystem;
+    const string p6Path = (fs::temp_directory_path() / "test_loader_p6.ppm").string();
+    const string p3Path = (fs::temp_directory_path() / "test_loader_p3.ppm").string();
+    {
+        ofstream p6(p6Path, ios::binary);
+        p6 << "P6\n# comment\n" << img->getWidth() << " # width\n#\n" << img->getHeight() << "\n255\n";
+        p6.write(reinterpret_cast<const char *>(reference), count * 3);
+
+        ofstream p3(p3Path);
+        p3 << "P3 " << img->getWidth() << " " << img->getHeight() << "\n# maxval\n255\n";
+        for (size_t i = 0; i < count; i++)
+        {
+            p3 << int(reference[i].R) << " " << int(reference[i].G) << " " << int(reference[i].B) << "\n";
+        }
+    }
+
+    bool ok = true;
+    for (const string &file : {p6Path, p3Path})
+    {
+        PPMImage copied, viewed;
+        copied.setInputDirectory("");
+        viewed.setInputDirectory("");
+        bool loaded = copied.load(file) && viewed.loadView(file);
+        bool same = loaded && copied.getWidth() == img->getWidth() && copied.getHeight() == img->getHeight() &&
+                    memcmp(copied.getPixelData(), reference, count * 3) == 0 &&
+                    memcmp(viewed.getPixelData(), reference, count * 3) == 0;
+        cout << "PPM loader " << file << " : " << (same ? "ok" : "wrong") << endl;
+        ok = ok && same;
+    }
+
+    std::remove(p6Path.c_str());
+    std::remove(p3Path.c_str());
+    return ok;
+}
+
+/**
+ * @brief Image views: the image copied to RGB, BGR, RGBA and BGRA buffers with
+ *   padded rows must encode to the same file as the Image itself (streaming
+ *   and full frame), and every kernel must convert each format the same way
+ */
+bool test_imageView(Image *img)
+{
+    int width = img->getWidth();
+    int height = img->getHeight();
+    const Pixel *pixels = img->getPixelData();
+
+    JPEGCompressor reference(*img);
+    reference.compress();
+    reference.writeJPEGFile("test_view_reference.jpg");
+    ifstream r("test_view_reference.jpg", ios::binary);
+    string referenceBytes((istreambuf_iterator<char>(r)), istreambuf_iterator<char>());
+
+    const PixelFormat formats[4] = {PixelFormat::RGB, PixelFormat::BGR, PixelFormat::RGBA, PixelFormat::BGRA};
+    const char *names[4] = {"RGB", "BGR", "RGBA", "BGRA"};
+    const ColorKernel kernels[3] = {ColorKernel::Scalar, ColorKernel::SSE2, ColorKernel::AVX2};
+    bool ok = !referenceBytes.empty();
+    for (int f = 0; f < 4; f++)
+    {
+        int bpp = bytesPerPixel(formats[f]);
+        bool swap = formats[f] == PixelFormat::BGR || formats[f] == PixelFormat::BGRA;
+        size_t stride = static_cast<size_t>(width) * bpp + 13;
+        vector<uint8_t> buffer(stride * height, 0xAA);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                const Pixel &p = pixels[static_cast<size_t>(y) * width + x];
+                uint8_t *out = &buffer[y * stride + static_cast<size_t>(x) * bpp];
+                out[0] = swap ? p.B : p.R;
+                out[1] = p.G;
+                out[2] = swap ? p.R : p.B;
+                if (bpp == 4)
+                    out[3] = 0x55;
+            }
+        }
+        ImageView view(buffer.data(), width, height, stride, formats[f]);
+
+        JPEGCompressor full(view), streaming(view);
+        full.compress();
+        full.writeJPEGFile("test_view_full.jpg");
+        streaming.writeJPEGFileStreaming("test_view_streaming.jpg");
+        ifstream a("test_view_full.jpg", ios::binary), b("test_view_streaming.jpg", ios::binary);
+        string fullBytes((istreambuf_iterator<char>(a)), istreambuf_iterator<char>());
+        string streamingBytes((istreambuf_iterator<char>(b)), istreambuf_iterator<char>());
+        bool sameFile = fullBytes == referenceBytes && streamingBytes == referenceBytes;
+
+        // Kernels on the first row (minus one pixel to leave a scalar tail)
+        size_t count = width - 1;
+        vector<uint8_t> planes[3][3];
+        vector<uint8_t> luma[3];
+        bool sameKernels = true;
+        for (int k = 0; k < 3; k++)
+        {
+            for (int c = 0; c < 3; c++)
+                planes[k][c].assign(count, 0);
+            luma[k].assign(count, 0);
+            rgbToYCbCr(view.row(0), formats[f], count, planes[k][0].data(), planes[k][1].data(), planes[k][2].data(), kernels[k]);
+            rgbToLuma(view.row(0), formats[f], count, luma[k].data(), kernels[k]);
+            sameKernels = sameKernels && luma[k] == planes[k][0];
+            for (int c = 0; c < 3; c++)
+                sameKernels = sameKernels && planes[k][c] == planes[0][c];
+        }
+
+        cout << "Image view " << names[f] << " : same file : " << (sameFile ? "yes" : "no")
+             << ", kernels identical : " << (sameKernels ? "yes" : "no") << endl;
+        ok = ok && sameFile && sameKernels;
+    }
+    return ok;
+}
+
+/**
+ * @brief Output sinks: memory, fixed buffer and callback output must match the
+ *   files, a fixed buffer one byte too small must fail, and maxEncodedSize()
+ *   must hold for noise at quality 100 (the worst case for the entropy coder)
+ */
+bool test_outputSinks(Image *img)
+{
+    auto readFile = [](const char *name)
+    {
+        ifstream in(name, ios::binary);
+        string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        return vector<uint8_t>(bytes.begin(), bytes.end());
+    };
+
+    bool ok = true;
+    for (bool progressive : {false, true})
+    {
+        JPEGCompressor compressor(*img);
+        compressor.setProgressive(progressive);
+        compressor.setRestartInterval(progressive ? 0 : 6);
+        compressor.compress();
+        compressor.writeJPEGFile("test_sink.jpg");
+        vector<uint8_t> expected = readFile("test_sink.jpg");
+
+        MemorySink memory(compressor.maxEncodedSize());
+        bool encoded = compressor.encode(memory);
+        vector<uint8_t> exact(expected.size()), tooSmall(expected.size() - 1);
+        FixedBufferSink fixed(exact.data(), exact.size()), overflow(tooSmall.data(), tooSmall.size());
+        encoded = encoded && compressor.encode(fixed) && !compressor.encode(overflow);
+
+        bool same = encoded && memory.buffer() == expected && exact == expected &&
+                    memory.bytesWritten() == expected.size() && expected.size() <= compressor.maxEncodedSize();
+        cout << "Output sinks (" << (progressive ? "progressive" : "baseline") << ") : "
+             << (same ? "ok" : "wrong") << endl;
+        ok = ok && same;
+    }
+
+    // Streaming: chunks of the callback concatenated give the file back
+    {
+        JPEGCompressor compressor(*img);
+        compressor.writeJPEGFileStreaming("test_sink.jpg");
+        vector<uint8_t> expected = readFile("test_sink.jpg");
+        vector<uint8_t> chunks;
+        size_t calls = 0;
+        CallbackSink callback([&chunks, &calls](const uint8_t *data, size_t size)
+                              {
+            chunks.insert(chunks.end(), data, data + size);
+            calls++;
+            return true; });
+        bool same = compressor.encodeStreaming(callback) && chunks == expected;
+        cout << "Callback sink (streaming) : " << calls << " chunks, " << (same ? "ok" : "wrong") << endl;
+        ok = ok && same;
+    }
+
+    // Worst case: noise, every quantizer 1, restart markers, all subsamplings
+    int width = 67, height = 45;
+    vector<uint8_t> noise(static_cast<size_t>(width) * height * 3);
+    uint32_t seed = 12345;
+    for (uint8_t &sample : noise)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        sample = static_cast<uint8_t>(seed >> 24);
+    }
+    ImageView view(noise.data(), width, height, static_cast<size_t>(width) * 3, PixelFormat::RGB);
+    const Subsampling modes[3] = {Subsampling::Mode444, Subsampling::Mode420, Subsampling::Grayscale};
+    for (Subsampling mode : modes)
+    {
+        for (bool progressive : {false, true})
+        {
+            JPEGCompressor compressor(view);
+            compressor.setSubsampling(mode);
+            compressor.setQuality(100);
+            compressor.setRestartInterval(1);
+            compressor.setProgressive(progressive);
+            compressor.compress();
+            MemorySink memory;
+            bool fits = compressor.encode(memory) && memory.buffer().size() <= compressor.maxEncodedSize();
+            if (!fits)
+            {
+                cout << "Worst case bound exceeded : " << memory.buffer().size() << " > " << compressor.maxEncodedSize() << endl;
+            }
+            ok = ok && fits;
+        }
+    }
+    cout << "Output size bound : " << (ok ? "ok" : "wrong") << endl;
+    return ok;
+}
+
+bool test_encodeStats(Image *img)
+{
+    auto sameFigures = [](const EncodeStats &a, const EncodeStats &b)
+    {
+        bool same = a.headerBytes == b.headerBytes && a.entropyBytes == b.entropyBytes && a.componentCount == b.componentCount;
+        for (int c = 0; c < 3; ++c)
+        {
+            const ComponentStats &x = a.components[c], &y = b.components[c];
+            same = same && x.blocks == y.blocks && x.zeroACBlocks == y.zeroACBlocks &&
+                   x.nonzeroCoefficients == y.nonzeroCoefficients && x.dcBits == y.dcBits && x.acBits == y.acBits;
+        }
+        return same;
+    };
+
+    JPEGCompressor compressor(*img);
+    bool ok = compressor.getStats() == nullptr;
+
+    // Baseline: byte counts add up to the file, Huffman bits fill the entropy bytes
+    EncodeStats frame;
+    compressor.setStats(&frame);
+    compressor.setRestartInterval(4);
+    compressor.compress();
+    MemorySink memory;
+    ok = compressor.encode(memory) && ok;
+
+    uint64_t bits = 0;
+    for (const ComponentStats &component : frame.components)
+    {
+        bits += component.dcBits + component.acBits;
+    }
+    ok = ok && frame.headerBytes + frame.entropyBytes == memory.buffer().size();
+    ok = ok && bits <= frame.entropyBytes * 8 && bits > frame.entropyBytes * 8 * 9 / 10;
+    ok = ok && frame.components[0].blocks == compressor.qBlocksY.size() &&
+         frame.components[1].blocks == compressor.qBlocksCb.size() && frame.components[2].blocks == compressor.qBlocksCr.size();
+    ok = ok && frame.totalSeconds() > 0 && frame.zeroACFraction() <= 1;
+
+    string json = frame.toJSON();
+    ok = ok && json.front() == '{' && json.back() == '}' && json.find("\"componentStats\"") != string::npos;
+    cout << "Encode stats (baseline) : " << json << endl;
+
+    // Streaming: same figures as the full frame encode
+    EncodeStats streaming;
+    compressor.setStats(&streaming);
+    MemorySink streamed;
+    ok = compressor.encodeStreaming(streamed) && sameFigures(frame, streaming) && ok;
+    cout << "Encode stats (streaming) : " << (sameFigures(frame, streaming) ? "same" : "different") << endl;
+
+    // Progressive: the scans add up to the file
+    EncodeStats progressive;
+    compressor.setStats(&progressive);
+    compressor.setRestartInterval(0);
+    compressor.setProgressive(true);
+    compressor.compress();
+    MemorySink scans;
+    ok = compressor.encode(scans) && ok;
+    ok = ok && progressive.progressive && progressive.headerBytes + progressive.entropyBytes == scans.buffer().size();
+
+    compressor.setStats(nullptr);
+    cout << "Encode stats : " << (ok ? "ok" : "wrong") << endl;
+    return ok;
+}
+
+/**
+ * @brief Round trip through the decoder: every subsampling mode, with and
+ *   without restart markers, must come back close to img (PSNR); grayscale
+ *   is compared with the luma of img. Progressive and truncated files must
+ *   be refused.
+ */
+bool test_decoder(Image *img)
+{
+    const Subsampling modes[5] = {Subsampling::Mode444, Subsampling::Mode422, Subsampling::Mode420,
+                                  Subsampling::Mode440, Subsampling::Grayscale};
+    const char *names[5] = {"4:4:4", "4:2:2", "4:2:0", "4:4:0", "grayscale"};
+    const Pixel *source = img->getPixelData();
+    size_t count = static_cast<size_t>(img->getWidth()) * img->getHeight();
+
+    auto psnr = [source, count](const PPMImage &decoded, bool gray)
+    {
+        const Pixel *pixels = decoded.getPixelData();
+        double error = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            const Pixel &a = source[i], &b = pixels[i];
+            if (gray)
+            {
+                double luma = 0.299 * a.R + 0.587 * a.G + 0.114 * a.B;
+                error += 3 * (luma - b.R) * (luma - b.R);
+            }
+            else
+            {
+                error += (a.R - b.R) * (a.R - b.R) + (a.G - b.G) * (a.G - b.G) + (a.B - b.B) * (a.B - b.B);
+            }
+        }
+        double mse = error / (3.0 * count);
+        return mse > 0 ? 10 * log10(255.0 * 255.0 / mse) : 99.0;
+    };
+
+    bool ok = true;
+    JPEGDecoder decoder;
+    for (int m = 0; m < 5; m++)
+    {
+        for (int interval : {0, 5})
+        {
+            JPEGCompressor compressor(*img);
+            compressor.setSubsampling(modes[m]);
+            compressor.setRestartInterval(interval);
+            compressor.setQuality(90);
+            MemorySink jpeg;
+            compressor.compress();
+            compressor.encode(jpeg);
+
+            PPMImage decoded;
+            bool read = decoder.decode(jpeg.buffer(), decoded) && decoded.getWidth() == img->getWidth() &&
+                        decoded.getHeight() == img->getHeight() && decoder.getRestartInterval() == interval;
+            double quality = read ? psnr(decoded, modes[m] == Subsampling::Grayscale) : 0;
+            if (interval == 0)
+            {
+                cout << "Decoder " << names[m] << " : " << (read ? "decoded" : decoder.getError()) << ", PSNR "
+                     << std::fixed << std::setprecision(2) << quality << " dB" << std::defaultfloat << endl;
+            }
+            ok = ok && read && quality > 27;
+        }
+    }
+
+    JPEGCompressor progressive(*img);
+    progressive.setProgressive(true);
+    progressive.compress();
+    MemorySink jpeg;
+    progressive.encode(jpeg);
+    PPMImage refused;
+    bool rejected = !decoder.decode(jpeg.buffer(), refused);
+    vector<uint8_t> truncated(jpeg.buffer().begin(), jpeg.buffer().begin() + jpeg.buffer().size() / 2);
+    rejected = rejected && !decoder.decode(truncated, refused);
+    cout << "Decoder refuses progressive / truncated files : " << (rejected ? "yes" : "no") << endl;
+    return ok && rejected;
+}
+
+/**
+ * @brief Trellis quantization: lambda 0 gives the rounded blocks back, the
+ *   streaming encoder writes the same file, and rounding needs more bytes
+ *   than the trellis to reach the trellis PSNR
+ */
+bool test_trellis(Image *img)
+{
+    const Pixel *source = img->getPixelData();
+    size_t count = static_cast<size_t>(img->getWidth()) * img->getHeight();
+
+    // Size and PSNR of the file of one setting
+    auto encode = [img, source, count](int quality, bool trellis, double lambda, MemorySink &jpeg)
+    {
+        JPEGCompressor compressor(*img);
+        compressor.setQuality(quality);
+        compressor.setTrellisQuantization(trellis);
+        compressor.setTrellisLambda(lambda);
+        compressor.compress();
+        compressor.encode(jpeg);
+
+        JPEGDecoder decoder;
+        PPMImage decoded;
+        if (!decoder.decode(jpeg.buffer(), decoded))
+        {
+            return 0.0;
+        }
+        double error = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            const Pixel &a = source[i], &b = decoded.getPixelData()[i];
+            error += (a.R - b.R) * (a.R - b.R) + (a.G - b.G) * (a.G - b.G) + (a.B - b.B) * (a.B - b.B);
+        }
+        return 10 * log10(255.0 * 255.0 * 3.0 * count / std::max(error, 1.0));
+    };
+
+    MemorySink rounded, zeroLambda;
+    encode(75, false, 0, rounded);
+    encode(75, true, 0, zeroLambda);
+    bool ok = rounded.buffer() == zeroLambda.buffer();
+    cout << "Trellis lambda 0 == rounding : " << (ok ? "yes" : "no") << endl;
+
+    JPEGCompressor streaming(*img);
+    streaming.setQuality(75);
+    streaming.setTrellisQuantization(true);
+    streaming.setDCTMode(DCTMode::Integer);
+    MemorySink streamed, trellis;
+    streaming.encodeStreaming(streamed);
+    double trellisPSNR = encode(75, true, JPEGCompressor(*img).getTrellisLambda(), trellis);
+    bool same = streamed.buffer() == trellis.buffer();
+    cout << "Trellis streaming identical : " << (same ? "yes" : "no") << endl;
+
+    // Lowest rounding quality reaching the PSNR of the trellis
+    int quality = 75;
+    MemorySink reference;
+    double referencePSNR = encode(quality, false, 0, reference);
+    size_t referenceBytes = reference.buffer().size();
+    for (;;)
+    {
+        MemorySink lower;
+        double lowerPSNR = encode(quality - 1, false, 0, lower);
+        if (lowerPSNR < trellisPSNR)
+        {
+            break;
+        }
+        quality--;
+        referencePSNR = lowerPSNR;
+        referenceBytes = lower.buffer().size();
+    }
+    double saving = 1.0 - static_cast<double>(trellis.buffer().size()) / referenceBytes;
+    cout << "Trellis q75 : " << trellis.buffer().size() << " bytes, " << std::fixed << std::setprecision(2) << trellisPSNR
+         << " dB ; rounding q" << quality << " : " << referenceBytes << " bytes, " << referencePSNR
+         << " dB ; saving " << 100 * saving << " %" << std::defaultfloat << endl;
+    return ok && same && saving > 0;
+}
+
+/**
+ * @brief Rate control: the file fits the budget, one quality more would not,
+ *   and it is the file compress() + encode() give at that quality
+ */
+bool test_rateControl(Image *img)
+{
+    bool ok = true;
+    for (bool progressive : {false, true})
+    {
+        // A budget far above any file must not be reserved as is
+        for (size_t target : {size_t(15000), size_t(30000), size_t(2000000000)})
+        {
+            JPEGCompressor compressor(*img);
+            compressor.setProgressive(progressive);
+            MemorySink fitted;
+            bool encoded = compressor.encodeToSize(fitted, target);
+            int quality = compressor.getQuality();
+
+            auto sizeAt = [img, progressive](int q, MemorySink &sink)
+            {
+                JPEGCompressor reference(*img);
+                reference.setProgressive(progressive);
+                reference.setQuality(q);
+                reference.compress();
+                reference.encode(sink);
+                return sink.buffer().size();
+            };
+            MemorySink same, above;
+            bool fits = encoded && fitted.buffer().size() <= target;
+            bool highest = quality == 100 || sizeAt(quality + 1, above) > target;
+            bool identical = sizeAt(quality, same) == fitted.buffer().size() && same.buffer() == fitted.buffer();
+
+            cout << "Rate control " << (progressive ? "progressive " : "") << target << " bytes : quality " << quality << ", "
+                 << fitted.buffer().size() << " bytes, " << (fits && highest && identical ? "ok" : "wrong") << endl;
+            ok = ok && fits && highest && identical;
+        }
+    }
+
+    // Integer DCT mode: the search runs on the fast engine's coefficients,
+    // same file as in fast mode, and the mode is kept
+    MemorySink fast, integer;
+    JPEGCompressor fastCompressor(*img);
+    fastCompressor.encodeToSize(fast, 30000);
+    JPEGCompressor integerCompressor(*img);
+    integerCompressor.setDCTMode(DCTMode::Integer);
+    bool integerEncoded = integerCompressor.encodeToSize(integer, 30000);
+    bool integerOk = integerEncoded && integer.buffer() == fast.buffer() &&
+                     integerCompressor.getQuality() == fastCompressor.getQuality() &&
+                     integerCompressor.getDCTMode() == DCTMode::Integer;
+    cout << "Rate control integer DCT mode : quality " << integerCompressor.getQuality() << ", "
+         << integer.buffer().size() << " bytes, " << (integerOk ? "ok" : "wrong") << endl;
+    ok = ok && integerOk;
+
+    // A budget below the smallest file: nothing written, quality unchanged
+    JPEGCompressor compressor(*img);
+    compressor.setQuality(80);
+    MemorySink tooSmall;
+    bool refused = !compressor.encodeToSize(tooSmall, 200) && tooSmall.bytesWritten() == 0 &&
+                   compressor.getQuality() == 80;
+    cout << "Rate control impossible budget refused : " << (refused ? "yes" : "no") << endl;
+    return ok && refused;
+}
+
+bool test_renditions(Image *img)
+{
+    // One shared front end for every quality and Huffman mode, 4:2:0
+    vector<Rendition> renditions(5);
+    MemorySink outputs[5];
+    const int qualities[5] = {30, 50, 70, 85, 95};
+    for (int r = 0; r < 5; ++r)
+    {
+        renditions[r].quality = qualities[r];
+        renditions[r].optimizeHuffman = r % 2 == 1;
+        renditions[r].progressive = r == 4;
+        renditions[r].out = &outputs[r];
+    }
+
+    JPEGCompressor compressor(*img);
+    compressor.setSubsampling(Subsampling::Mode420);
+    auto start = chrono::steady_clock::now();
+    bool written = compressor.encodeRenditions(renditions);
+    double shared = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    // Every file identical to its own full encode
+    bool ok = written;
+    start = chrono::steady_clock::now();
+    for (int r = 0; r < 5; ++r)
+    {
+        JPEGCompressor reference(*img);
+        reference.setSubsampling(Subsampling::Mode420);
+        reference.setQuality(qualities[r]);
+        reference.setOptimizeHuffman(renditions[r].optimizeHuffman);
+        reference.setProgressive(renditions[r].progressive);
+        reference.compress();
+        MemorySink expected;
+        reference.encode(expected);
+        bool identical = renditions[r].written && expected.buffer() == outputs[r].buffer();
+        cout << "Rendition quality " << qualities[r] << (renditions[r].optimizeHuffman ? " optimized" : "")
+             << (renditions[r].progressive ? " progressive" : "") << " : " << outputs[r].buffer().size() << " bytes, "
+             << (identical ? "ok" : "wrong") << endl;
+        ok = ok && identical;
+    }
+    double separate = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Renditions : " << shared * 1000 << " ms shared, " << separate * 1000 << " ms separately" << endl;
+
+    // Same encoder again, into fixed buffers: the back ends are reused, so the
+    // call after a warm-up makes no allocation, and the files are the same
+    compressor.setMaxThreads(1);
+    vector<vector<uint8_t>> buffers(5, vector<uint8_t>(compressor.maxEncodedSize()));
+    vector<FixedBufferSink> sinks;
+    sinks.reserve(5);
+    size_t allocations = 0;
+    bool again = true;
+    for (int call = 0; call < 2; ++call)
+    {
+        sinks.clear();
+        for (int r = 0; r < 5; ++r)
+        {
+            sinks.emplace_back(buffers[r].data(), buffers[r].size());
+            renditions[r].out = &sinks[r];
+        }
+        size_t before = heapAllocationCount();
+        again = compressor.encodeRenditions(renditions);
+        allocations = heapAllocationCount() - before;
+    }
+    for (int r = 0; r < 5; ++r)
+    {
+        again = again && sinks[r].size() == outputs[r].buffer().size() &&
+                std::equal(outputs[r].buffer().begin(), outputs[r].buffer().end(), buffers[r].begin());
+    }
+    cout << "Renditions reused : " << allocations << " allocations, " << (again ? "identical" : "different") << endl;
+    return ok && again && allocations == 0;
+}
+
+bool test_encoderReuse(Image *img)
+{
+    // A smaller image: the top left quarter, read in place
+    ImageView full(*img);
+    ImageView quarter(full.data, full.width / 2, full.height / 2, full.stride, full.format);
+
+    enum Path
+    {
+        Baseline,
+        Optimized,
+        Restart,
+        Progressive,
+        Streaming
+    };
+    const char *names[] = {"baseline", "optimized", "restart 4:4:0", "progressive", "streaming"};
+
+    bool ok = true;
+    for (int path = Baseline; path <= Streaming; ++path)
+    {
+        auto configure = [path](JPEGCompressor &compressor)
+        {
+            compressor.setMaxThreads(1);
+            compressor.setOptimizeHuffman(path == Optimized);
+            compressor.setRestartInterval(path == Restart ? 8 : 0);
+            compressor.setSubsampling(path == Restart ? Subsampling::Mode440 : Subsampling::Mode420);
+            compressor.setProgressive(path == Progressive);
+        };
+        auto run = [path](JPEGCompressor &compressor, OutputSink &out)
+        {
+            if (path == Streaming)
+            {
+                return compressor.encodeStreaming(out);
+            }
+            compressor.compress();
+            return compressor.encode(out);
+        };
+
+        JPEGCompressor context;
+        configure(context);
+        context.reset(full);
+        vector<uint8_t> buffer(context.maxEncodedSize());
+
+        // Large, small, large: the buffers of the first encode fit the others
+        size_t allocations = 0;
+        bool identical = true;
+        const ImageView *views[] = {&full, &quarter, &full, &quarter};
+        for (int i = 0; i < 4; ++i)
+        {
+            const ImageView *view = views[i];
+            context.reset(*view);
+            FixedBufferSink out(buffer.data(), buffer.size());
+            size_t before = heapAllocationCount();
+            bool written = run(context, out);
+            if (i > 0)
+            {
+                allocations += heapAllocationCount() - before;
+            }
+
+            JPEGCompressor fresh(*view);
+            configure(fresh);
+            MemorySink expected;
+            run(fresh, expected);
+            identical = identical && written && expected.buffer().size() == out.size() &&
+                        std::equal(expected.buffer().begin(), expected.buffer().end(), buffer.begin());
+        }
+        cout << "Reused encoder " << names[path] << " : " << allocations << " allocations, "
+             << (identical ? "identical" : "different") << endl;
+        ok = ok && identical && allocations == 0;
+    }
+    return ok;
+}
+
+bool test_blockMemoization(Image *img)
+{
+    // Screenshot-like frame: flat background and title bar, "text" made of a
+    // few 16x16 glyphs (MCU aligned) cut from the image, and a photo
+    const int width = 1024, height = 768;
+    ImageView photo(*img);
+    vector<uint8_t> frame(static_cast<size_t>(width) * height * 3);
+    auto fill = [&frame](int x, int y, const uint8_t *rgb)
+    {
+        std::memcpy(&frame[(static_cast<size_t>(y) * width + x) * 3], rgb, 3);
+    };
+    const uint8_t background[3] = {236, 236, 236}, titleBar[3] = {40, 90, 160};
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            fill(x, y, y < 32 ? titleBar : background);
+        }
+    }
+    unsigned seed = 7;
+    for (int line = 64; line + 16 <= 480; line += 32)
+    {
+        for (int x = 32; x + 16 <= 960; x += 16)
+        {
+            seed = seed * 1103515245 + 12345;
+            int glyph = (seed >> 16) % 12;
+            for (int dy = 0; dy < 16; ++dy)
+            {
+                for (int dx = 0; dx < 16; ++dx)
+                {
+                    fill(x + dx, line + dy, photo.row(100 + dy) + (glyph * 24 + dx) * 3);
+                }
+            }
+        }
+    }
+    for (int y = 0; y < std::min(photo.height, 256); ++y)
+    {
+        for (int x = 0; x < std::min(photo.width, 256); ++x)
+        {
+            fill(704 + x, 496 + y, photo.row(y) + x * 3);
+        }
+    }
+    ImageView screenshot(frame.data(), width, height, static_cast<size_t>(width) * 3, PixelFormat::RGB);
+
+    struct Mode
+    {
+        const char *name;
+        DCTMode dct;
+        bool trellis, optimize, progressive, streaming;
+    };
+    const Mode modes[] = {{"fast", DCTMode::Fast, false, false, false, false},
+                          {"reference", DCTMode::Reference, false, false, false, false},
+                          {"integer (fast)", DCTMode::Integer, false, false, false, false},
+                          {"trellis", DCTMode::Fast, true, false, false, false},
+                          {"optimized progressive", DCTMode::Fast, false, true, true, false},
+                          {"streaming", DCTMode::Fast, false, false, false, true}};
+
+    bool ok = true;
+    for (const ImageView *view : {&screenshot, &photo})
+    {
+        for (const Mode &mode : modes)
+        {
+            auto encodeWith = [&mode, view](bool memoize, DCTMode dct, EncodeStats *stats, MemorySink &out)
+            {
+                JPEGCompressor compressor(*view);
+                compressor.setDCTMode(dct);
+                compressor.setTrellisQuantization(mode.trellis);
+                compressor.setOptimizeHuffman(mode.optimize);
+                compressor.setProgressive(mode.progressive);
+                compressor.setBlockMemoization(memoize);
+                compressor.setStats(stats);
+                if (mode.streaming)
+                {
+                    compressor.encodeStreaming(out);
+                    return;
+                }
+                compressor.compress();
+                compressor.encode(out);
+            };
+
+            // The integer engine runs as the fast one when memoizing
+            EncodeStats stats;
+            MemorySink memoized, plain;
+            encodeWith(true, mode.dct, &stats, memoized);
+            encodeWith(false, mode.dct == DCTMode::Integer ? DCTMode::Fast : mode.dct, nullptr, plain);
+            bool identical = memoized.buffer() == plain.buffer();
+            cout << "Memoization " << (view == &screenshot ? "screenshot " : "photo ") << mode.name << " : "
+                 << 100.0 * (stats.flatBlocks + stats.repeatedBlocks) / std::max<uint64_t>(1, stats.totalBlocks())
+                 << " % of the blocks flat or repeated, " << (identical ? "identical" : "different") << endl;
+            ok = ok && identical;
+        }
+    }
+
+    // Transform + quantization time of the screenshot, with and without
+    for (bool memoize : {false, true})
+    {
+        JPEGCompressor compressor(screenshot);
+        compressor.setBlockMemoization(memoize);
+        EncodeStats stats;
+        compressor.setStats(&stats);
+        compressor.compress();
+        double seconds = stats.stageSeconds[static_cast<int>(EncodeStage::Transform)] +
+                         stats.stageSeconds[static_cast<int>(EncodeStage::Quantize)];
+        cout << "Screenshot DCT + quantization " << (memoize ? "memoized" : "plain") << " : " << seconds * 1000 << " ms" << endl;
+    }
+    return ok;
+}
+
+/**
+ * @brief Batch outputs: the tree below an input directory is mirrored, so
+ *   a/img.ppm and b/img.ppm give two files; an input given again, whose
+ *   output is taken, fails instead of overwriting it
+ */
+bool test_batchEncoder(Image *img)
+{
+    namespace fs = std::filesystem;
+    const fs::path root = "test_batch";
+    std::error_code error;
+    fs::remove_all(root, error);
+
+    // 16x16 corner of the image, written twice under the same name
+    int side = std::min(16, std::min(img->getWidth(), img->getHeight()));
+    const Pixel *pixels = img->getPixelData();
+    for (const char *directory : {"a", "b"})
+    {
+        fs::create_directories(root / "in" / directory);
+        ofstream ppm(root / "in" / directory / "img.ppm", ios::binary);
+        ppm << "P6\n" << side << " " << side << "\n255\n";
+        for (int y = 0; y < side; ++y)
+        {
+            ppm.write(reinterpret_cast<const char *>(pixels + static_cast<size_t>(y) * img->getWidth()), side * 3);
+        }
+    }
+
+    BatchSettings settings;
+    settings.outputDirectory = (root / "out").string();
+    BatchEncoder batch(settings);
+    batch.addInput((root / "in").string());                   // out/a/img.jpg, out/b/img.jpg
+    batch.addInput((root / "in" / "a" / "img.ppm").string()); // out/img.jpg
+    batch.addInput((root / "in" / "b" / "img.ppm").string()); // out/img.jpg again: rejected
+    BatchResult result = batch.run();
+
+    bool mirrored = fs::exists(root / "out" / "a" / "img.jpg") && fs::exists(root / "out" / "b" / "img.jpg");
+    bool ok = mirrored && result.images == 3 && result.failures == 1 && fs::exists(root / "out" / "img.jpg");
+    cout << "Batch outputs : " << result.images << " encoded, " << result.failures << " rejected, "
+         << (mirrored ? "tree mirrored" : "tree not mirrored") << endl;
+
+    fs::remove_all(root, error);
+    return ok;
+}
+
 // void test_splitYToBlocks(Image *img)
 // {
 
@@ -239,4 +1595,4 @@ void test_YcrCb(Image *img)
 //     }
 
 //     return zz;
-// }
\ No newline at end of file
+// }
@@ -1,6 +1,7 @@
 #ifndef _UTILS_HPP
 #define _UTILS_HPP
 #include "../class/Image.hpp"
+#include <array>
 
 using namespace std;
 
@@ -9,6 +10,36 @@ void test_splitYToBlocks(Image *img);
 void test_DCT(Image *img);
 void test_quantification(Image *img);
 array<int, 64UL> test_zigzag(Image *img);
+bool test_DCTEngines(Image *img);
+bool test_integerDCT(Image *img);
+bool test_streamingEncoder(Image *img);
+bool test_restartIntervals(Image *img);
+bool test_threadPool(Image *img);
+bool test_optimizedHuffman(Image *img);
+bool test_progressive(Image *img);
+bool test_quality(Image *img);
+bool test_colorConversion(Image *img);
+bool test_fusedSubsampling(Image *img);
+bool test_subsamplingModes(Image *img);
+bool test_ppmLoader(Image *img);
+bool test_imageView(Image *img);
+bool test_outputSinks(Image *img);
+bool test_encodeStats(Image *img);
+bool test_decoder(Image *img);
+bool test_trellis(Image *img);
+bool test_rateControl(Image *img);
+bool test_renditions(Image *img);
+bool test_encoderReuse(Image *img);
+bool test_blockMemoization(Image *img);
+bool test_batchEncoder(Image *img);
+
+/**
+ * @brief Heap allocations made so far by the program
+ *
+ *   Defined by the test program (tests.cpp), which replaces the global
+ *   operator new to count them; main.bin keeps the standard allocator.
+ */
+size_t heapAllocationCount();
 
 
 